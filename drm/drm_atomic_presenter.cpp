@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+#include "Logger.h"
+#include "Times.h"
+#include "drm_display.h"
+#include "drm_atomic_presenter.h"
+
+using namespace Tls;
+
+#define TAG "rlib:drm_atomic_presenter"
+
+DrmAtomicPresenter::DrmAtomicPresenter(DrmDisplay *drmDisplay, int logCategory)
+{
+    mDrmDisplay = drmDisplay;
+    mLogCategory = logCategory;
+    mDrmFd = -1;
+    mCrtcId = 0;
+    mCrtcIndex = -1;
+    mPlaneId = 0;
+    mOutFencePropId = 0;
+    memset(&mPlaneProps, 0, sizeof(mPlaneProps));
+    mFlipPending = false;
+    mPendingFenceFd = -1;
+    mFlipTimeUs = 0;
+    mFlipSequence = 0;
+}
+
+DrmAtomicPresenter::~DrmAtomicPresenter()
+{
+    abandonPendingFlip();
+}
+
+bool DrmAtomicPresenter::init(bool pip)
+{
+    struct drm_display *drmHandle = mDrmDisplay->getDrmHandle();
+    DrmMesonLib *drmMesonLib = mDrmDisplay->getDrmMesonLib();
+
+    if (!drmHandle || !drmMesonLib || !drmMesonLib->libDrmModeAsyncAtomicCommit) {
+        ERROR(mLogCategory,"no drm handle or atomic commit api");
+        return false;
+    }
+    mDrmFd = drmHandle->drm_fd;
+
+    if (drmSetClientCap(mDrmFd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+        drmSetClientCap(mDrmFd, DRM_CLIENT_CAP_ATOMIC, 1)) {
+        ERROR(mLogCategory,"drm atomic not supported,errno:%d",errno);
+        return false;
+    }
+
+    if (!findCrtc() || !findVideoPlane(pip)) {
+        return false;
+    }
+
+    mOutFencePropId = getPropertyId(mCrtcId, DRM_MODE_OBJECT_CRTC, "OUT_FENCE_PTR");
+    mPlaneProps.fbId = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "FB_ID");
+    mPlaneProps.crtcId = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "CRTC_ID");
+    mPlaneProps.srcX = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "SRC_X");
+    mPlaneProps.srcY = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "SRC_Y");
+    mPlaneProps.srcW = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "SRC_W");
+    mPlaneProps.srcH = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "SRC_H");
+    mPlaneProps.crtcX = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "CRTC_X");
+    mPlaneProps.crtcY = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "CRTC_Y");
+    mPlaneProps.crtcW = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "CRTC_W");
+    mPlaneProps.crtcH = getPropertyId(mPlaneId, DRM_MODE_OBJECT_PLANE, "CRTC_H");
+
+    //commit adds every property, a zero id fails the whole commit
+    if (!mOutFencePropId || !mPlaneProps.fbId || !mPlaneProps.crtcId ||
+        !mPlaneProps.srcX || !mPlaneProps.srcY || !mPlaneProps.srcW || !mPlaneProps.srcH ||
+        !mPlaneProps.crtcX || !mPlaneProps.crtcY || !mPlaneProps.crtcW || !mPlaneProps.crtcH) {
+        ERROR(mLogCategory,"missing atomic property,out fence:%d,fb:%d,crtc:%d,src:%d,%d,%d,%d,crtc rect:%d,%d,%d,%d",
+            mOutFencePropId,mPlaneProps.fbId,mPlaneProps.crtcId,
+            mPlaneProps.srcX,mPlaneProps.srcY,mPlaneProps.srcW,mPlaneProps.srcH,
+            mPlaneProps.crtcX,mPlaneProps.crtcY,mPlaneProps.crtcW,mPlaneProps.crtcH);
+        return false;
+    }
+
+    INFO(mLogCategory,"atomic present,crtc:%d(index %d),plane:%d",mCrtcId,mCrtcIndex,mPlaneId);
+    return true;
+}
+
+bool DrmAtomicPresenter::findCrtc()
+{
+    drmModeResPtr res = drmModeGetResources(mDrmFd);
+    if (!res) {
+        ERROR(mLogCategory,"drmModeGetResources failed,errno:%d",errno);
+        return false;
+    }
+
+    //crtc driving the first connected connector
+    for (int i = 0; i < res->count_connectors && !mCrtcId; i++) {
+        drmModeConnectorPtr conn = drmModeGetConnector(mDrmFd, res->connectors[i]);
+        if (!conn) {
+            continue;
+        }
+        if (conn->connection == DRM_MODE_CONNECTED && conn->encoder_id) {
+            drmModeEncoderPtr enc = drmModeGetEncoder(mDrmFd, conn->encoder_id);
+            if (enc) {
+                mCrtcId = enc->crtc_id;
+                drmModeFreeEncoder(enc);
+            }
+        }
+        drmModeFreeConnector(conn);
+    }
+
+    for (int i = 0; i < res->count_crtcs; i++) {
+        if (res->crtcs[i] == mCrtcId) {
+            mCrtcIndex = i;
+            break;
+        }
+    }
+    drmModeFreeResources(res);
+
+    if (!mCrtcId || mCrtcIndex < 0) {
+        ERROR(mLogCategory,"no active crtc found");
+        return false;
+    }
+    return true;
+}
+
+bool DrmAtomicPresenter::findVideoPlane(bool pip)
+{
+    int videoPlaneIdx = 0;
+    drmModePlaneResPtr planeRes = drmModeGetPlaneResources(mDrmFd);
+    if (!planeRes) {
+        ERROR(mLogCategory,"drmModeGetPlaneResources failed,errno:%d",errno);
+        return false;
+    }
+
+    /*video planes are the overlay planes accepting yuv frames,
+     the first one is VD1 and the second one is VD2*/
+    for (uint32_t i = 0; i < planeRes->count_planes && !mPlaneId; i++) {
+        drmModePlanePtr plane = drmModeGetPlane(mDrmFd, planeRes->planes[i]);
+        bool isVideo = false;
+        if (!plane) {
+            continue;
+        }
+        if (plane->possible_crtcs & (1 << mCrtcIndex)) {
+            for (uint32_t j = 0; j < plane->count_formats; j++) {
+                if (plane->formats[j] == DRM_FORMAT_NV21 || plane->formats[j] == DRM_FORMAT_NV12) {
+                    isVideo = true;
+                    break;
+                }
+            }
+        }
+        if (isVideo) {
+            drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(mDrmFd, plane->plane_id, DRM_MODE_OBJECT_PLANE);
+            uint32_t typeId = getPropertyId(plane->plane_id, DRM_MODE_OBJECT_PLANE, "type");
+            for (uint32_t j = 0; props && j < props->count_props; j++) {
+                if (props->props[j] == typeId && props->prop_values[j] != DRM_PLANE_TYPE_OVERLAY) {
+                    isVideo = false;
+                }
+            }
+            if (props) {
+                drmModeFreeObjectProperties(props);
+            }
+        }
+        if (isVideo) {
+            if (videoPlaneIdx == (pip ? 1 : 0)) {
+                mPlaneId = plane->plane_id;
+            }
+            videoPlaneIdx++;
+        }
+        drmModeFreePlane(plane);
+    }
+    drmModeFreePlaneResources(planeRes);
+
+    if (!mPlaneId) {
+        ERROR(mLogCategory,"no video plane found,pip:%d",pip);
+        return false;
+    }
+    return true;
+}
+
+uint32_t DrmAtomicPresenter::getPropertyId(uint32_t objectId, uint32_t objectType, const char *name)
+{
+    uint32_t id = 0;
+    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(mDrmFd, objectId, objectType);
+    if (!props) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < props->count_props && !id; i++) {
+        drmModePropertyPtr prop = drmModeGetProperty(mDrmFd, props->props[i]);
+        if (prop) {
+            if (strcmp(prop->name, name) == 0) {
+                id = prop->prop_id;
+            }
+            drmModeFreeProperty(prop);
+        }
+    }
+    drmModeFreeObjectProperties(props);
+    return id;
+}
+
+int DrmAtomicPresenter::commit(FrameEntity *frameEntity, int *outFenceFd)
+{
+    int rc;
+    int32_t outFence = -1;
+    struct drm_buf *drmBuf = frameEntity->drmBuf;
+    DrmMesonLib *drmMesonLib = mDrmDisplay->getDrmMesonLib();
+    drmModeAtomicReqPtr req;
+
+    *outFenceFd = -1;
+    if (mFlipPending) {
+        WARNING(mLogCategory,"commit while flip pending");
+        return -EBUSY;
+    }
+
+    req = drmModeAtomicAlloc();
+    if (!req) {
+        return -ENOMEM;
+    }
+
+    //src coordinates are 16.16 fixed point
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.fbId, drmBuf->fb_id);
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.crtcId, mCrtcId);
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.srcX, ((uint64_t)drmBuf->src_x) << 16);
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.srcY, ((uint64_t)drmBuf->src_y) << 16);
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.srcW, ((uint64_t)drmBuf->src_w) << 16);
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.srcH, ((uint64_t)drmBuf->src_h) << 16);
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.crtcX, drmBuf->crtc_x);
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.crtcY, drmBuf->crtc_y);
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.crtcW, drmBuf->crtc_w);
+    drmModeAtomicAddProperty(req, mPlaneId, mPlaneProps.crtcH, drmBuf->crtc_h);
+    drmModeAtomicAddProperty(req, mCrtcId, mOutFencePropId, (uint64_t)(uintptr_t)&outFence);
+
+    rc = drmMesonLib->libDrmModeAsyncAtomicCommit(mDrmFd, req,
+                DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, this);
+    drmModeAtomicFree(req);
+    if (rc) {
+        ERROR(mLogCategory,"atomic commit error %d,errno:%d",rc,errno);
+        if (outFence >= 0) {
+            close(outFence);
+        }
+        return rc;
+    }
+
+    mFlipPending = true;
+    if (outFence >= 0) {
+        mPendingFenceFd = dup(outFence);
+    }
+    *outFenceFd = outFence;
+    return 0;
+}
+
+void DrmAtomicPresenter::pageFlipHandler(int fd, unsigned int sequence, unsigned int sec,
+                        unsigned int usec, unsigned int crtcId, void *userData)
+{
+    DrmAtomicPresenter *self = static_cast<DrmAtomicPresenter *>(userData);
+    if (!self || crtcId != self->mCrtcId) {
+        return;
+    }
+    self->finishFlip(sec*1000000LL + usec, sequence);
+}
+
+void DrmAtomicPresenter::finishFlip(int64_t flipTimeUs, unsigned int sequence)
+{
+    mFlipPending = false;
+    mFlipTimeUs = flipTimeUs;
+    mFlipSequence = sequence;
+    if (mPendingFenceFd >= 0) {
+        close(mPendingFenceFd);
+        mPendingFenceFd = -1;
+    }
+}
+
+bool DrmAtomicPresenter::waitFlipDone(int timeoutMs, int64_t *flipTimeUs, unsigned int *sequence)
+{
+    struct pollfd fds[2];
+    int fdCnt = 1;
+    int64_t deadlineMs = Tls::Times::getSystemTimeMs() + timeoutMs;
+    drmEventContext evctx;
+
+    memset(&evctx, 0, sizeof(drmEventContext));
+    evctx.version = 3;
+    evctx.page_flip_handler2 = DrmAtomicPresenter::pageFlipHandler;
+
+    while (mFlipPending) {
+        int64_t leftMs = deadlineMs - Tls::Times::getSystemTimeMs();
+        if (leftMs < 0) {
+            return false;
+        }
+        fds[0].fd = mDrmFd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fdCnt = 1;
+        if (mPendingFenceFd >= 0) {
+            fds[1].fd = mPendingFenceFd;
+            fds[1].events = POLLIN;
+            fds[1].revents = 0;
+            fdCnt = 2;
+        }
+        int rc = poll(fds, fdCnt, (int)leftMs);
+        if (rc < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            ERROR(mLogCategory,"poll flip event error %d",errno);
+            return false;
+        }
+        if (rc == 0) {
+            return false;
+        }
+        if (fds[0].revents & POLLIN) {
+            drmHandleEvent(mDrmFd, &evctx);
+        }
+        //the flip event may be read by libdrm meson, out fence still tells the flip
+        if (mFlipPending && fdCnt > 1 && (fds[1].revents & (POLLIN | POLLERR))) {
+            TRACE(mLogCategory,"flip done by out fence");
+            finishFlip(Tls::Times::getSystemTimeUs(), 0);
+        }
+    }
+
+    if (flipTimeUs) {
+        *flipTimeUs = mFlipTimeUs;
+    }
+    if (sequence) {
+        *sequence = mFlipSequence;
+    }
+    return true;
+}
+
+void DrmAtomicPresenter::abandonPendingFlip()
+{
+    mFlipPending = false;
+    if (mPendingFenceFd >= 0) {
+        close(mPendingFenceFd);
+        mPendingFenceFd = -1;
+    }
+}
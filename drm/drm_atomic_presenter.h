@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __DRM_ATOMIC_PRESENTER_H__
+#define __DRM_ATOMIC_PRESENTER_H__
+#include <stdint.h>
+
+class DrmDisplay;
+struct FrameEntity;
+
+/**
+ * @brief post frames to video plane with non blocking drm atomic
+ * commits, every commit requests a page flip event and a crtc out
+ * fence. the out fence signals when the commit is latched, that is
+ * when the frame shown before it leaves the screen.
+ * only one commit is in flight, it is only used by frame post thread
+ */
+class DrmAtomicPresenter
+{
+  public:
+    DrmAtomicPresenter(DrmDisplay *drmDisplay, int logCategory);
+    virtual ~DrmAtomicPresenter();
+    /**
+     * @brief find crtc, video plane and their properties
+     *
+     * @param pip use the second video plane if true
+     * @return true if atomic commit can be used
+     */
+    bool init(bool pip);
+    /**
+     * @brief commit frame to video plane without blocking
+     *
+     * @param frameEntity frame to show
+     * @param outFenceFd crtc out fence fd,caller owns it, -1 if not got
+     * @return int 0 success, otherwise failed
+     */
+    int commit(FrameEntity *frameEntity, int *outFenceFd);
+    bool isFlipPending() {
+        return mFlipPending;
+    };
+    /**
+     * @brief wait the pending commit flipped
+     *
+     * @param timeoutMs max wait time
+     * @param flipTimeUs flip time in monotonic us
+     * @param sequence vblank sequence of flip
+     * @return true if flipped, false if timeout or error
+     */
+    bool waitFlipDone(int timeoutMs, int64_t *flipTimeUs, unsigned int *sequence);
+    /**
+     * @brief drop the pending flip state,called when the flip is
+     * never coming, e.g. display is off
+     */
+    void abandonPendingFlip();
+    uint32_t getCrtcId() {
+        return mCrtcId;
+    };
+    int getCrtcIndex() {
+        return mCrtcIndex;
+    };
+  private:
+    static void pageFlipHandler(int fd, unsigned int sequence, unsigned int sec,
+                        unsigned int usec, unsigned int crtcId, void *userData);
+    uint32_t getPropertyId(uint32_t objectId, uint32_t objectType, const char *name);
+    bool findCrtc();
+    bool findVideoPlane(bool pip);
+    void finishFlip(int64_t flipTimeUs, unsigned int sequence);
+
+    DrmDisplay *mDrmDisplay;
+    int mLogCategory;
+    int mDrmFd;
+
+    uint32_t mCrtcId;
+    int mCrtcIndex;
+    uint32_t mPlaneId;
+    uint32_t mOutFencePropId; //crtc OUT_FENCE_PTR
+    struct {
+        uint32_t fbId;
+        uint32_t crtcId;
+        uint32_t srcX;
+        uint32_t srcY;
+        uint32_t srcW;
+        uint32_t srcH;
+        uint32_t crtcX;
+        uint32_t crtcY;
+        uint32_t crtcW;
+        uint32_t crtcH;
+    } mPlaneProps;
+
+    bool mFlipPending;
+    /*dup of pending commit out fence, the flip is treated done
+     when it signals if the flip event was read by other thread*/
+    int mPendingFenceFd;
+    int64_t mFlipTimeUs;
+    unsigned int mFlipSequence;
+};
+
+#endif /*__DRM_ATOMIC_PRESENTER_H__*/
@@ -15,6 +15,7 @@
  */
 #include <errno.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
@@ -25,6 +26,7 @@
 #include "drm_framepost.h"
 #include "drm_framerecycle.h"
 #include "ErrorCode.h"
+#include "Times.h"
 
 using namespace Tls;
 
@@ -53,11 +55,22 @@ DrmDisplay::DrmDisplay(DrmPlugin *plugin, int logcategory)
     mBlackFrameAddr = NULL;
     mHideVideo = false;
     mKeepLastFrame = false;
+    mAtomicPresent = false;
+    mDisplayWidth = 0;
+    mDisplayHeight = 0;
+    mDisplayModeValid = false;
+    mCreatedFrameCnt = 0;
+    mCreateFrameCostUs = 0;
+    mModeQueryCnt = 0;
+    mImportHitCnt = 0;
+    mImportMissCnt = 0;
+    mFrameEntityPool = new Tls::ObjectPool(sizeof(FrameEntity), FRAME_ENTITY_POOL_SIZE);
     mDrmMesonLib = drmMesonLoadLib(logcategory);
 }
 
 DrmDisplay::~DrmDisplay()
 {
+    invalidateImportCache();
     if (mDrmHandle) {
         if (mDrmMesonLib) {
             mDrmMesonLib->libDrmDisplayDestroy(mDrmHandle);
@@ -69,6 +82,10 @@ DrmDisplay::~DrmDisplay()
         drmMesonUnloadLib(mLogCategory, mDrmMesonLib);
         mDrmMesonLib = NULL;
     }
+    if (mFrameEntityPool) {
+        delete mFrameEntityPool;
+        mFrameEntityPool = NULL;
+    }
 }
 
 bool DrmDisplay::start(bool pip)
@@ -94,6 +111,12 @@ bool DrmDisplay::start(bool pip)
     INFO(mLogCategory, "set keep last frame %d", mDrmHandle->freeze);
 #endif
 
+    //refresh cached display mode when resolution changed
+    invalidateDisplayMode();
+    if (mDrmMesonLib->libDrmDisplayRegisterResCb) {
+        mDrmMesonLib->libDrmDisplayRegisterResCb(mDrmHandle, (void *)DrmDisplay::displayModeChangedCallback, this);
+    }
+
     if (!mDrmFramePost) {
         mDrmFramePost = new DrmFramePost(this, mLogCategory);
         mDrmFramePost->start();
@@ -115,6 +138,19 @@ bool DrmDisplay::start(bool pip)
 
 bool DrmDisplay::stop()
 {
+    if (mCreatedFrameCnt > 0) {
+        INFO(mLogCategory, "created frames:%lld,avg cost:%lld us,display mode queries:%lld",
+            mCreatedFrameCnt, mCreateFrameCostUs/mCreatedFrameCnt, mModeQueryCnt);
+        INFO(mLogCategory, "import cache hit:%lld,miss:%lld",mImportHitCnt,mImportMissCnt);
+        INFO(mLogCategory, "frame entity pool size:%d,high water:%d,exhausted:%d",
+            mFrameEntityPool->getCapacity(),mFrameEntityPool->getHighWaterMark(),mFrameEntityPool->getExhaustedCnt());
+    }
+    mFrameEntityPool->resetStats();
+    mCreatedFrameCnt = 0;
+    mCreateFrameCostUs = 0;
+    mModeQueryCnt = 0;
+    mImportHitCnt = 0;
+    mImportMissCnt = 0;
     if (mDrmFramePost) {
         DEBUG(mLogCategory, "stop frame post thread");
         mDrmFramePost->stop();
@@ -127,6 +163,8 @@ bool DrmDisplay::stop()
         delete mDrmFrameRecycle;
         mDrmFrameRecycle = NULL;
     }
+    //all frames had released, free cached drm bufs before drm display destroyed
+    invalidateImportCache();
     if (mBlackFrameAddr) {
         munmap (mBlackFrameAddr, mBlackFrame->width * mBlackFrame->height * 2);
         mBlackFrameAddr = NULL;
@@ -150,23 +188,79 @@ bool DrmDisplay::stop()
     return true;
 }
 
-bool DrmDisplay::displayFrame(RenderBuffer *buf, int64_t displayTime)
+FrameEntity *DrmDisplay::acceptFrame(RenderBuffer *buf, int64_t displayTime)
 {
-    int ret;
+    FrameEntity *frameEntity = NULL;
+    PluginDropReason reason = PLUGIN_DROP_REASON_LATE;
+
+    //drop a hopelessly late frame before import, decoder gets it back at once
+    if (mDrmFramePost && mDrmFramePost->isFrameLate(displayTime)) {
+        DEBUG(mLogCategory,"drop late frame,display time:%lld(pts:%lld ms)",displayTime,buf->pts/1000000);
+        goto tag_drop;
+    }
+
+    frameEntity = createFrameEntity(buf, displayTime);
+    if (!frameEntity) {
+        reason = PLUGIN_DROP_REASON_ERROR;
+        goto tag_drop;
+    }
+    if (!mDrmFramePost) {
+        WARNING(mLogCategory,"no frame post service");
+        handleDropedFrameEntity(frameEntity, PLUGIN_DROP_REASON_ERROR);
+        handleReleaseFrameEntity(frameEntity);
+        return NULL;
+    }
+    return frameEntity;
+
+tag_drop: //drop and release render buffer
+    if (mPlugin) {
+        mPlugin->handleFrameDropped(buf, reason);
+        mPlugin->handleBufferRelease(buf);
+    }
+    return NULL;
+}
 
-    FrameEntity *frameEntity = createFrameEntity(buf, displayTime);
+bool DrmDisplay::displayFrame(RenderBuffer *buf, int64_t displayTime)
+{
+    FrameEntity *frameEntity = acceptFrame(buf, displayTime);
     if (frameEntity) {
-        if (mDrmFramePost) {
-            mDrmFramePost->readyPostFrame(frameEntity);
-        } else {
-            WARNING(mLogCategory,"no frame post service");
-            handleDropedFrameEntity(frameEntity);
+        if (!mDrmFramePost->readyPostFrame(frameEntity)) {
+            handleDropedFrameEntity(frameEntity, PLUGIN_DROP_REASON_QUEUE_FULL);
             handleReleaseFrameEntity(frameEntity);
+        } else {
+            traceFrameEntity(frameEntity, PLUGIN_FRAME_STAGE_QUEUED);
         }
-    } else { //drop and release render buffer
-        if (mPlugin) {
-            mPlugin->handleFrameDropped(buf);
-            mPlugin->handleBufferRelease(buf);
+    }
+
+    return true;
+}
+
+bool DrmDisplay::displayFrames(RenderBuffer **bufs, int64_t *displayTimes, int count)
+{
+    FrameEntity *frameEntities[DRM_DISPLAY_BATCH_FRAMES];
+    int entityCnt;
+    int postCnt;
+    int i = 0;
+
+    while (i < count) {
+        entityCnt = 0;
+        for (; i < count && entityCnt < DRM_DISPLAY_BATCH_FRAMES; i++) {
+            FrameEntity *frameEntity = acceptFrame(bufs[i], displayTimes[i]);
+            if (frameEntity) {
+                frameEntities[entityCnt++] = frameEntity;
+            }
+        }
+        if (entityCnt == 0) {
+            continue;
+        }
+        //post thread sees the whole batch at once
+        for (int j = 0; j < entityCnt; j++) {
+            traceFrameEntity(frameEntities[j], PLUGIN_FRAME_STAGE_QUEUED);
+        }
+        postCnt = mDrmFramePost->readyPostFrames(frameEntities, entityCnt);
+        for (int j = postCnt; j < entityCnt; j++) {
+            handleDropedFrameEntity(frameEntities[j], PLUGIN_DROP_REASON_QUEUE_FULL);
+            handleReleaseFrameEntity(frameEntities[j]);
         }
     }
 
@@ -180,6 +274,8 @@ void DrmDisplay::flush()
     if (mDrmFramePost) {
         mDrmFramePost->flush();
     }
+    //decoder may reallocate its buffers after flush
+    invalidateImportCache();
 }
 
 void DrmDisplay::pause()
@@ -194,6 +290,9 @@ void DrmDisplay::resume()
 
 void DrmDisplay::setVideoFormat(RenderVideoFormat videoFormat)
 {
+    if (mVideoFormat != videoFormat) {
+        invalidateImportCache();
+    }
     mVideoFormat = videoFormat;
     DEBUG(mLogCategory,"video format:%d",mVideoFormat);
 }
@@ -212,6 +311,9 @@ void DrmDisplay::setWindowSize(int x, int y, int w, int h)
 
 void DrmDisplay::setFrameSize(int width, int height)
 {
+    if (mFrameWidth != width || mFrameHeight != height) {
+        invalidateImportCache();
+    }
     mFrameWidth = width;
     mFrameHeight = height;
     DEBUG(mLogCategory,"frame size:%dx%d",width, height);
@@ -331,21 +433,62 @@ void DrmDisplay::setKeepLastFrame(bool keep)
 #endif
 }
 
+void DrmDisplay::setAtomicPresent(bool on)
+{
+    mAtomicPresent = on;
+    INFO(mLogCategory, "set atomic present %d", on);
+}
+
+void DrmDisplay::invalidateDisplayMode()
+{
+    mDisplayModeValid.store(false);
+}
+
+void DrmDisplay::displayModeChangedCallback(void *priv)
+{
+    DrmDisplay *self = static_cast<DrmDisplay *>(priv);
+    INFO(self->mLogCategory, "display mode changed");
+    self->invalidateDisplayMode();
+}
+
+void DrmDisplay::updateDisplayMode()
+{
+    DisplayMode displayMode;
+
+    if (mDisplayModeValid.exchange(true)) {
+        return;
+    }
+    if (!mDrmHandle || !mDrmMesonLib) {
+        mDisplayModeValid.store(false);
+        return;
+    }
+
+    memset(&displayMode, 0, sizeof(DisplayMode));
+    mDrmMesonLib->libDrmGetModeInfo(mDrmHandle->drm_fd, MESON_CONNECTOR_RESERVED, &displayMode);
+    mModeQueryCnt++;
+    if (displayMode.w != mDisplayWidth || displayMode.h != mDisplayHeight) {
+        INFO(mLogCategory, "display mode %dx%d -> %dx%d",mDisplayWidth,mDisplayHeight,displayMode.w,displayMode.h);
+    }
+    mDisplayWidth = displayMode.w;
+    mDisplayHeight = displayMode.h;
+}
+
 FrameEntity *DrmDisplay::createFrameEntity(RenderBuffer *buf, int64_t displayTime)
 {
     struct drm_buf_import info;
     FrameEntity* frame = NULL;
     struct drm_buf * drmBuf = NULL;
-    int displayWidth = 0, displayHeight = 0;
+    int64_t startUs = Tls::Times::getSystemTimeUs();
 
-    frame = (FrameEntity*)calloc(1, sizeof(FrameEntity));
+    frame = (FrameEntity*)mFrameEntityPool->alloc();
     if (!frame) {
-        ERROR(mLogCategory,"oom calloc FrameEntity mem failed");
+        ERROR(mLogCategory,"oom alloc FrameEntity mem failed");
         goto tag_error;
     }
 
     frame->displayTime = displayTime;
     frame->renderBuf = buf;
+    frame->releaseFenceFd = -1;
 
     memset(&info, 0 , sizeof(struct drm_buf_import));
 
@@ -373,17 +516,7 @@ FrameEntity *DrmDisplay::createFrameEntity(RenderBuffer *buf, int64_t displayTim
         info.flags |= MESON_USE_VD2;
     }
 
-    /*warning: must dup fd, because drm_free_buf will close buf fd
-    if not dup buf fd, fd will be double free*/
-    for (int i = 0; i < buf->dma.planeCnt; i++) {
-        info.fd[i] = dup(buf->dma.fd[i]);
-        TRACE(mLogCategory,"dup fd[%d]:%d->%d",i,buf->dma.fd[i],info.fd[i]);
-    }
-
-    if (mDrmHandle && mDrmMesonLib) {
-        drmBuf = mDrmMesonLib->libDrmImportBuf(mDrmHandle, &info);
-    }
-
+    drmBuf = importDrmBuf(buf, &info, &frame->importEntry);
     if (!drmBuf) {
         ERROR(mLogCategory, "unable drm_import_buf");
         goto tag_error;
@@ -399,19 +532,13 @@ FrameEntity *DrmDisplay::createFrameEntity(RenderBuffer *buf, int64_t displayTim
      *if window size set,the crtc size will be reset
      *before post drm buffer
      */
-    //get current display mode
-    if (mDrmHandle && mDrmMesonLib) {
-        DisplayMode displayMode;
-        mDrmMesonLib->libDrmGetModeInfo(mDrmHandle->drm_fd, MESON_CONNECTOR_RESERVED, &displayMode);
-        displayWidth = displayMode.w;
-        displayHeight = displayMode.h;
-        ERROR(mLogCategory, "displayWidth:%d,displayHeight:%d",displayWidth,displayHeight);
-    }
+    //get current display mode, it is cached until display mode changed
+    updateDisplayMode();
     drmBuf->crtc_x = 0;
     drmBuf->crtc_y = 0;
-    if (displayWidth > 0 && displayHeight > 0) {
-        drmBuf->crtc_w = displayWidth;
-        drmBuf->crtc_h = displayHeight;
+    if (mDisplayWidth > 0 && mDisplayHeight > 0) {
+        drmBuf->crtc_w = mDisplayWidth;
+        drmBuf->crtc_h = mDisplayHeight;
     } else {
         drmBuf->crtc_w = mDrmHandle->width;
         drmBuf->crtc_h = mDrmHandle->height;
@@ -421,38 +548,183 @@ FrameEntity *DrmDisplay::createFrameEntity(RenderBuffer *buf, int64_t displayTim
     TRACE(mLogCategory,"crtc(%d,%d,%d,%d),src(%d,%d,%d,%d)",drmBuf->crtc_x,drmBuf->crtc_y,drmBuf->crtc_w,drmBuf->crtc_h,
         drmBuf->src_x,drmBuf->src_y,drmBuf->src_w,drmBuf->src_h);
 
+    mCreatedFrameCnt++;
+    mCreateFrameCostUs += Tls::Times::getSystemTimeUs() - startUs;
+    traceFrameEntity(frame, PLUGIN_FRAME_STAGE_READY);
     return frame;
 tag_error:
-    for (int i = 0; i < buf->dma.planeCnt; i++) {
-        if (info.fd[i] > 0) {
-            close(info.fd[i]);
-            info.fd[i] = -1;
-        }
-    }
     if (frame) {
-        free(frame);
+        mFrameEntityPool->release(frame);
     }
     return NULL;
 }
 
 void DrmDisplay::destroyFrameEntity(FrameEntity * frameEntity)
 {
-    int rc;
-
     if (!frameEntity) {
         return;
     }
+    if (frameEntity->releaseFenceFd >= 0) {
+        close(frameEntity->releaseFenceFd);
+        frameEntity->releaseFenceFd = -1;
+    }
     if (frameEntity->drmBuf) {
+        releaseDrmBuf(frameEntity);
+        TRACE(mLogCategory,"release drm buf displaytime:%lld(pts:%lld ms)",frameEntity->displayTime,frameEntity->renderBuf->pts/1000000);
+    }
+    mFrameEntityPool->release(frameEntity);
+}
+
+struct drm_buf *DrmDisplay::importDrmBuf(RenderBuffer *buf, struct drm_buf_import *info, DrmImportEntry **entry)
+{
+    DrmImportKey key;
+    DrmImportEntry *importEntry = NULL;
+    struct drm_buf *drmBuf = NULL;
+    bool cacheable = true;
+    struct stat st;
+
+    *entry = NULL;
+    if (!mDrmHandle || !mDrmMesonLib) {
+        return NULL;
+    }
+
+    memset(&key, 0, sizeof(DrmImportKey));
+    key.planeCnt = buf->dma.planeCnt;
+    key.width = info->width;
+    key.height = info->height;
+    key.fourcc = info->fourcc;
+    for (int i = 0; i < buf->dma.planeCnt && i < RENDER_MAX_PLANES; i++) {
+        if (fstat(buf->dma.fd[i], &st) != 0) {
+            WARNING(mLogCategory,"fstat fd[%d]:%d failed %d, not cache it",i,buf->dma.fd[i],errno);
+            cacheable = false;
+            break;
+        }
+        key.dev[i] = st.st_dev;
+        key.ino[i] = st.st_ino;
+        key.fd[i] = buf->dma.fd[i];
+    }
+
+    Tls::Mutex::Autolock _l(mImportMutex);
+    if (cacheable) {
+        for (auto it = mImportCache.begin(); it != mImportCache.end(); ++it) {
+            if (memcmp(&(*it)->key, &key, sizeof(DrmImportKey)) == 0) {
+                importEntry = *it;
+                //move to back, front entry is the least recently used
+                mImportCache.erase(it);
+                mImportCache.push_back(importEntry);
+                importEntry->useCnt++;
+                mImportHitCnt++;
+                *entry = importEntry;
+                return importEntry->drmBuf;
+            }
+        }
+    }
+
+    /*warning: must dup fd, because drm_free_buf will close buf fd
+    if not dup buf fd, fd will be double free*/
+    for (int i = 0; i < buf->dma.planeCnt; i++) {
+        info->fd[i] = dup(buf->dma.fd[i]);
+        TRACE(mLogCategory,"dup fd[%d]:%d->%d",i,buf->dma.fd[i],info->fd[i]);
+    }
+
+    drmBuf = mDrmMesonLib->libDrmImportBuf(mDrmHandle, info);
+    if (!drmBuf) {
+        for (int i = 0; i < buf->dma.planeCnt; i++) {
+            if (info->fd[i] > 0) {
+                close(info->fd[i]);
+                info->fd[i] = -1;
+            }
+        }
+        return NULL;
+    }
+    mImportMissCnt++;
+
+    if (!cacheable) {
+        return drmBuf;
+    }
+
+    //cache is full, evict the least recently used idle entry
+    if (mImportCache.size() >= DRM_IMPORT_CACHE_SIZE) {
+        for (auto it = mImportCache.begin(); it != mImportCache.end(); ++it) {
+            if ((*it)->useCnt == 0) {
+                DrmImportEntry *evicted = *it;
+                mImportCache.erase(it);
+                freeImportEntry(evicted);
+                break;
+            }
+        }
+        //all entries are in use, the buffer pool is larger than cache
+        if (mImportCache.size() >= DRM_IMPORT_CACHE_SIZE) {
+            return drmBuf;
+        }
+    }
+
+    importEntry = (DrmImportEntry *)calloc(1, sizeof(DrmImportEntry));
+    if (!importEntry) {
+        return drmBuf;
+    }
+    importEntry->key = key;
+    importEntry->drmBuf = drmBuf;
+    importEntry->useCnt = 1;
+    importEntry->stale = false;
+    mImportCache.push_back(importEntry);
+    *entry = importEntry;
+    TRACE(mLogCategory,"cache drm buf %p,cached cnt:%d",drmBuf,(int)mImportCache.size());
+    return drmBuf;
+}
+
+void DrmDisplay::releaseDrmBuf(FrameEntity *frameEntity)
+{
+    int rc = 0;
+    DrmImportEntry *entry = frameEntity->importEntry;
+
+    if (!entry) {
         if (mDrmMesonLib) {
             rc = mDrmMesonLib->libDrmFreeBuf(frameEntity->drmBuf);
         }
-
         if (rc) {
             WARNING(mLogCategory, "drm_free_buf free %p failed",frameEntity->drmBuf);
         }
-        TRACE(mLogCategory,"drm_free_buf displaytime:%lld(pts:%lld ms)",frameEntity->displayTime,frameEntity->renderBuf->pts/1000000);
+        return;
+    }
+
+    Tls::Mutex::Autolock _l(mImportMutex);
+    entry->useCnt--;
+    if (entry->stale && entry->useCnt <= 0) {
+        freeImportEntry(entry);
+    }
+}
+
+void DrmDisplay::freeImportEntry(DrmImportEntry *entry)
+{
+    int rc = 0;
+
+    if (mDrmMesonLib && entry->drmBuf) {
+        rc = mDrmMesonLib->libDrmFreeBuf(entry->drmBuf);
+    }
+    if (rc) {
+        WARNING(mLogCategory, "drm_free_buf free %p failed",entry->drmBuf);
+    }
+    free(entry);
+}
+
+void DrmDisplay::invalidateImportCache()
+{
+    Tls::Mutex::Autolock _l(mImportMutex);
+    if (mImportCache.empty()) {
+        return;
+    }
+    DEBUG(mLogCategory,"invalidate import cache,cached cnt:%d",(int)mImportCache.size());
+    for (auto it = mImportCache.begin(); it != mImportCache.end(); ++it) {
+        DrmImportEntry *entry = *it;
+        if (entry->useCnt > 0) {
+            //still on screen or waiting fence, free it when frame released
+            entry->stale = true;
+        } else {
+            freeImportEntry(entry);
+        }
     }
-    free(frameEntity);
+    mImportCache.clear();
 }
 
 void DrmDisplay::handlePostedFrameEntity(FrameEntity * frameEntity)
@@ -462,17 +734,31 @@ void DrmDisplay::handlePostedFrameEntity(FrameEntity * frameEntity)
     }
 }
 
-void DrmDisplay::handleDropedFrameEntity(FrameEntity * frameEntity)
+void DrmDisplay::traceFrameEntity(FrameEntity * frameEntity, int stage)
+{
+    if (mPlugin) {
+        mPlugin->getFrameMonitor()->traceFrame(frameEntity->renderBuf, stage);
+    }
+}
+
+void DrmDisplay::handleDropedFrameEntity(FrameEntity * frameEntity, PluginDropReason reason)
+{
+    if (mPlugin) {
+        mPlugin->handleFrameDropped(frameEntity->renderBuf, reason);
+    }
+}
+
+void DrmDisplay::handleDisplayedFrameEntity(FrameEntity * frameEntity, int64_t presentTime)
 {
     if (mPlugin) {
-        mPlugin->handleFrameDropped(frameEntity->renderBuf);
+        mPlugin->handleFrameDisplayed(frameEntity->renderBuf, presentTime);
     }
 }
 
-void DrmDisplay::handleDisplayedFrameEntity(FrameEntity * frameEntity)
+void DrmDisplay::reportQueueDepth(int depth)
 {
     if (mPlugin) {
-        mPlugin->handleFrameDisplayed(frameEntity->renderBuf);
+        mPlugin->getFrameMonitor()->queueDepth(depth);
     }
 }
 
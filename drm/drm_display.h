@@ -16,6 +16,8 @@
 #ifndef __DRM_DISPLAY_WRAPPER_H__
 #define __DRM_DISPLAY_WRAPPER_H__
 #include <list>
+#include <atomic>
+#include <sys/types.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
@@ -23,14 +25,52 @@
 #include "Mutex.h"
 #include "Thread.h"
 #include "Queue.h"
+#include "ObjectPool.h"
 #include "drm_plugin.h"
 #include "drm_lib_wrap.h"
 
+/*max dma buffers that keep imported drm buf,decoders usually
+ cycle 8~16 buffers, so the cache covers a whole buffer pool*/
+#define DRM_IMPORT_CACHE_SIZE 32
+
+/*identity of an imported dma buffer, a dma buffer inode is unique
+ while the cached drm buf holds a dup fd of it on kernel 5.3 and later,
+ older kernels give all dma buffers one anon inode, so the fd of
+ the app is kept in key too to tell buffers apart*/
+typedef struct DrmImportKey
+{
+    int planeCnt;
+    dev_t dev[RENDER_MAX_PLANES];
+    ino_t ino[RENDER_MAX_PLANES];
+    int fd[RENDER_MAX_PLANES];
+    uint32_t width;
+    uint32_t height;
+    uint32_t fourcc;
+} DrmImportKey;
+
+typedef struct DrmImportEntry
+{
+    DrmImportKey key;
+    struct drm_buf *drmBuf;
+    int useCnt; //frames that are using drmBuf
+    bool stale; //removed from cache, free drmBuf when useCnt is 0
+} DrmImportEntry;
+
+/*max frames in flight from displayFrame to release,frame entities
+ are preallocated for them, it is bounded by frame post queue size*/
+#define FRAME_ENTITY_POOL_SIZE 64
+/*max frames imported before a batch is handed to post thread*/
+#define DRM_DISPLAY_BATCH_FRAMES 16
+
 typedef struct FrameEntity
 {
     RenderBuffer *renderBuf;
     int64_t displayTime;
     struct drm_buf *drmBuf;
+    DrmImportEntry *importEntry; //NULL if drmBuf is not cached
+    /*explicit fence signaled when frame leaves screen, -1 if
+     the implicit fence of dma buffer is used,recycle closes it*/
+    int releaseFenceFd;
 } FrameEntity;
 
 class DrmPlugin;
@@ -45,6 +85,7 @@ class DrmDisplay
     bool start(bool pip);
     bool stop();
     bool displayFrame(RenderBuffer *buf, int64_t displayTime);
+    bool displayFrames(RenderBuffer **bufs, int64_t *displayTimes, int count);
     void flush();
     void pause();
     void resume();
@@ -59,6 +100,14 @@ class DrmDisplay
     DrmMesonLib *getDrmMesonLib() {
       return mDrmMesonLib;
     }
+    bool isPip() {
+        return mIsPip;
+    };
+    /*post frames by drm atomic commit,must be set before start*/
+    void setAtomicPresent(bool on);
+    bool isAtomicPresent() {
+        return mAtomicPresent;
+    };
     void setHideVideo(bool hide);
     bool isHideVideo() {
       return mHideVideo;
@@ -67,6 +116,20 @@ class DrmDisplay
     /*set keeping last frame yes or not when stop playing*/
     void setKeepLastFrame(bool keep);
 
+    /**
+     * @brief drop the cached display mode, it will be
+     * queried again when next frame is created.
+     * call it when display mode or output changed
+     */
+    void invalidateDisplayMode();
+
+    /**
+     * @brief free all cached imported drm bufs, the drm bufs that
+     * are still used by frames are freed when the frames released.
+     * call it when video format or frame size changed
+     */
+    void invalidateImportCache();
+
     /**
      * @brief handle frame that had posted to drm display,must commit this posted frame
      * to frame recycle service to wait frame display
@@ -79,14 +142,20 @@ class DrmDisplay
      * one vsync duration
      *
      * @param frameEntity frame resource info
+     * @param reason why the frame is dropped
      */
-    void handleDropedFrameEntity(FrameEntity * frameEntity);
+    void handleDropedFrameEntity(FrameEntity * frameEntity, PluginDropReason reason);
+    //record frame reached stage, refer to PluginFrameStage
+    void traceFrameEntity(FrameEntity * frameEntity, int stage);
     /**
      * @brief handle displayed frame
      *
      * @param frameEntity
+     * @param presentTime monotonic time the frame showed,us
      */
-    void handleDisplayedFrameEntity(FrameEntity * frameEntity);
+    void handleDisplayedFrameEntity(FrameEntity * frameEntity, int64_t presentTime);
+    //report frame count waiting to be posted
+    void reportQueueDepth(int depth);
     /**
      * @brief handle displayed frame and ready to release
      *
@@ -97,7 +166,19 @@ class DrmDisplay
     void handleMsg(int type, void *detail);
   private:
     FrameEntity *createFrameEntity(RenderBuffer *buf, int64_t displayTime);
+    /*drop late frame and create frame entity to post,NULL if
+     the frame is dropped and released*/
+    FrameEntity *acceptFrame(RenderBuffer *buf, int64_t displayTime);
     void destroyFrameEntity(FrameEntity * frameEntity);
+    //query display mode from drm if cached mode is invalid
+    void updateDisplayMode();
+    //drm display resolution changed callback
+    static void displayModeChangedCallback(void *priv);
+    //get drm buf of render buffer from import cache,import it if not cached
+    struct drm_buf *importDrmBuf(RenderBuffer *buf, struct drm_buf_import *info, DrmImportEntry **entry);
+    //release drm buf of frame, cached drm buf is only freed if it is stale
+    void releaseDrmBuf(FrameEntity *frameEntity);
+    void freeImportEntry(DrmImportEntry *entry);
 
     DrmPlugin *mPlugin;
     int mLogCategory;
@@ -123,6 +204,26 @@ class DrmDisplay
 
     bool mKeepLastFrame;
     bool mPaused;
+    bool mAtomicPresent;
+
+    //cached display mode, only touched by frame creating thread
+    int mDisplayWidth;
+    int mDisplayHeight;
+    std::atomic<bool> mDisplayModeValid;
+
+    //per frame cost counter of createFrameEntity
+    int64_t mCreatedFrameCnt;
+    int64_t mCreateFrameCostUs;
+    int64_t mModeQueryCnt;
+
+    //frame entities are allocated from it instead of heap
+    Tls::ObjectPool *mFrameEntityPool;
+
+    //imported drm buf cache,the most recently used entry is at back
+    mutable Tls::Mutex mImportMutex;
+    std::list<DrmImportEntry *> mImportCache;
+    int64_t mImportHitCnt;
+    int64_t mImportMissCnt;
 };
 
 #endif /*__DRM_DISPLAY_WRAPPER_H__*/
\ No newline at end of file
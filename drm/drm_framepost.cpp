@@ -18,12 +18,25 @@
 #include "Logger.h"
 #include "drm_display.h"
 #include "drm_framepost.h"
+#include "drm_atomic_presenter.h"
 #include "ErrorCode.h"
+#include "Times.h"
 
 using namespace Tls;
 
 #define TAG "rlib:drm_framepost"
 
+/*max frames queued for posting, decoders hold far fewer buffers*/
+#define FRAME_POST_QUEUE_SIZE 64
+
+/*max time to wait a committed frame flipped, the post thread
+ checks stop request after it*/
+#define FLIP_WAIT_TIMEOUT_MS 100
+
+/*sleep at most this vblanks ahead when waiting a future frame,
+ so that a frame queued later with an earlier time is not missed*/
+#define VBLANK_MAX_WAIT_CNT 4
+
 DrmFramePost::DrmFramePost(DrmDisplay *drmDisplay,int logCategory)
 {
     mDrmDisplay = drmDisplay;
@@ -31,11 +44,23 @@ DrmFramePost::DrmFramePost(DrmDisplay *drmDisplay,int logCategory)
     mPaused = false;
     mStop = false;
     mImmediatelyOutput = false;
-    mQueue = new Tls::Queue();
+    mQueue = new Tls::SpscQueue(FRAME_POST_QUEUE_SIZE);
+    mScheduler = new Tls::FrameScheduler(FRAME_POST_QUEUE_SIZE);
     mWinRect.x = 0;
     mWinRect.y = 0;
     mWinRect.w = 0;
     mWinRect.h = 0;
+    mAtomicPresenter = NULL;
+    mPendingFrame = NULL;
+    mOnScreenFrame = NULL;
+    mLastFlipTimeUs = 0;
+    mVsyncClock = new Tls::VsyncClock();
+    mLateFrameFilter = new Tls::LateFrameFilter(mVsyncClock);
+    mVblankSeqValid = false;
+    mVblankSeq = 0;
+    mLastVblankSeq = 0;
+    mPostSeqValid = false;
+    mLastPostSeq = 0;
 }
 
 DrmFramePost::~DrmFramePost()
@@ -46,16 +71,40 @@ DrmFramePost::~DrmFramePost()
         requestExitAndWait();
     }
 
+    releasePresentedFrames();
+    if (mAtomicPresenter) {
+        delete mAtomicPresenter;
+        mAtomicPresenter = NULL;
+    }
     if (mQueue) {
-        mQueue->flush();
         delete mQueue;
         mQueue = NULL;
     }
+    if (mScheduler) {
+        delete mScheduler;
+        mScheduler = NULL;
+    }
+    if (mLateFrameFilter) {
+        delete mLateFrameFilter;
+        mLateFrameFilter = NULL;
+    }
+    if (mVsyncClock) {
+        delete mVsyncClock;
+        mVsyncClock = NULL;
+    }
 }
 
 bool DrmFramePost::start()
 {
     DEBUG(mLogCategory,"start frame post thread");
+    if (mDrmDisplay->isAtomicPresent() && !mAtomicPresenter) {
+        mAtomicPresenter = new DrmAtomicPresenter(mDrmDisplay, mLogCategory);
+        if (!mAtomicPresenter->init(mDrmDisplay->isPip())) {
+            WARNING(mLogCategory,"atomic present init fail, use drm_post_buf");
+            delete mAtomicPresenter;
+            mAtomicPresenter = NULL;
+        }
+    }
     run("frame post thread");
     return true;
 }
@@ -69,26 +118,65 @@ bool DrmFramePost::stop()
         requestExitAndWait();
     }
     flush();
+    releasePresentedFrames();
+    DEBUG(mLogCategory,"late frames dropped before queue:%lld",mLateFrameFilter->getDropCnt());
     return true;
 }
 
 bool DrmFramePost::readyPostFrame(FrameEntity * frameEntity)
 {
-    Tls::Mutex::Autolock _l(mMutex);
-    mQueue->push(frameEntity);
+    if (mQueue->push(frameEntity) != Q_OK) {
+        ERROR(mLogCategory,"post queue full,cnt:%d",mQueue->getCnt());
+        return false;
+    }
     TRACE(mLogCategory,"queue cnt:%d",mQueue->getCnt());
     return true;
 }
 
+int DrmFramePost::readyPostFrames(FrameEntity **frameEntities, int count)
+{
+    int cnt = (int)mQueue->pushBatch((void **)frameEntities, count);
+    if (cnt < count) {
+        ERROR(mLogCategory,"post queue full,cnt:%d,queued %d/%d",mQueue->getCnt(),cnt,count);
+    }
+    TRACE(mLogCategory,"queue cnt:%d",mQueue->getCnt());
+    return cnt;
+}
+
+bool DrmFramePost::isFrameLate(int64_t displayTime)
+{
+    if (mImmediatelyOutput || mPaused) {
+        return false;
+    }
+    //a frame queued now is posted at the first vblank after now
+    return mLateFrameFilter->isHopeless(displayTime, Tls::Times::getSystemTimeUs());
+}
+
+void DrmFramePost::fetchQueuedFrames()
+{
+    FrameEntity *entity;
+    while (mQueue->pop((void **)&entity) == Q_OK)
+    {
+        if (mScheduler->push(entity, entity->displayTime) != Q_OK) {
+            ERROR(mLogCategory,"schedule frame fail,frame time:%lld",entity->displayTime);
+            mDrmDisplay->handleDropedFrameEntity(entity, PLUGIN_DROP_REASON_QUEUE_FULL);
+            mDrmDisplay->handleReleaseFrameEntity(entity);
+        }
+    }
+    mDrmDisplay->reportQueueDepth(mScheduler->getCnt());
+}
+
 void DrmFramePost::flush()
 {
     FrameEntity *entity;
     Tls::Mutex::Autolock _l(mMutex);
-    while (mQueue->pop((void **)&entity) == Q_OK)
+    fetchQueuedFrames();
+    while (mScheduler->popEarliest((void **)&entity, NULL) == Q_OK)
     {
-        mDrmDisplay->handleDropedFrameEntity(entity);
+        mDrmDisplay->handleDropedFrameEntity(entity, PLUGIN_DROP_REASON_FLUSH);
         mDrmDisplay->handleReleaseFrameEntity(entity);
     }
+    mLateFrameFilter->reset();
 }
 
 void DrmFramePost::pause()
@@ -119,118 +207,309 @@ void DrmFramePost::readyToRun()
 {
 }
 
-bool DrmFramePost::threadLoop()
+FrameEntity *DrmFramePost::popExpiredFrame(int64_t vBlankTime)
 {
-    int rc;
-    drmVBlank vbl;
-    int64_t vBlankTime;
     FrameEntity *curFrameEntity = NULL;
     FrameEntity *expiredFrameEntity = NULL;
-    long long refreshInterval= 0LL;
-    struct drm_display *drmHandle = mDrmDisplay->getDrmHandle();
-    DrmMesonLib *drmMesonLib = mDrmDisplay->getDrmMesonLib();
 
-    //stop thread
-    if (mStop) {
-        return false;
+    //we output video frame asap
+    if (mImmediatelyOutput) {
+        //pop the earliest frame
+        mScheduler->popEarliest((void **)&expiredFrameEntity, NULL);
+        return expiredFrameEntity;
     }
 
-    if (!drmHandle) {
-        ERROR(mLogCategory,"drm handle is NULL");
-        return false;
+    //pop all frames expired at next vblank, in display time order
+    while (mScheduler->popExpired(vBlankTime, (void **)&curFrameEntity, NULL) == Q_OK)
+    {
+        TRACE(mLogCategory,"vBlankTime:%lld,frame time:%lld(pts:%lld ms)",vBlankTime,curFrameEntity->displayTime,curFrameEntity->renderBuf->pts/1000000);
+
+        //drop last expired frame,got a new expired frame
+        if (expiredFrameEntity) {
+            DEBUG(mLogCategory,"drop frame,vBlankTime:%lld,frame time:%lld(pts:%lld ms)",vBlankTime,expiredFrameEntity->displayTime,expiredFrameEntity->renderBuf->pts/1000000);
+            mDrmDisplay->handleDropedFrameEntity(expiredFrameEntity, PLUGIN_DROP_REASON_EXPIRED);
+            mDrmDisplay->handleReleaseFrameEntity(expiredFrameEntity);
+            expiredFrameEntity = NULL;
+        }
+
+        expiredFrameEntity = curFrameEntity;
+        TRACE(mLogCategory,"expire,frame time:%lld(pts:%lld ms)",expiredFrameEntity->displayTime,expiredFrameEntity->renderBuf->pts/1000000);
     }
+    return expiredFrameEntity;
+}
+
+void DrmFramePost::applyWindowSize(FrameEntity *frameEntity)
+{
+    //double check window size before post drm buffer
+    if (mWinRect.w > 0 && mWinRect.h > 0) {
+        struct drm_buf * drmBuf = frameEntity->drmBuf;
+        drmBuf->crtc_x = mWinRect.x;
+        drmBuf->crtc_y = mWinRect.y;
+        drmBuf->crtc_w = mWinRect.w;
+        drmBuf->crtc_h = mWinRect.h;
+        TRACE(mLogCategory,"postBuf crtc(%d,%d,%d,%d),src(%d,%d,%d,%d)",drmBuf->crtc_x,drmBuf->crtc_y,drmBuf->crtc_w,drmBuf->crtc_h,
+        drmBuf->src_x,drmBuf->src_y,drmBuf->src_w,drmBuf->src_h);
+    }
+}
+
+void DrmFramePost::releasePresentedFrames()
+{
+    if (!mAtomicPresenter) {
+        return;
+    }
+    //let the last commit finish before its frame is released
+    if (mAtomicPresenter->isFlipPending()) {
+        if (!mAtomicPresenter->waitFlipDone(FLIP_WAIT_TIMEOUT_MS, NULL, NULL)) {
+            mAtomicPresenter->abandonPendingFlip();
+        }
+    }
+    if (mOnScreenFrame) {
+        mDrmDisplay->handlePostedFrameEntity(mOnScreenFrame);
+        mOnScreenFrame = NULL;
+    }
+    if (mPendingFrame) {
+        mDrmDisplay->handlePostedFrameEntity(mPendingFrame);
+        mPendingFrame = NULL;
+    }
+}
+
+bool DrmFramePost::queryVblank(unsigned int *sequence, int64_t *timeUs)
+{
+    int rc;
+    drmVBlank vbl;
+    struct drm_display *drmHandle = mDrmDisplay->getDrmHandle();
 
     memset(&vbl, 0, sizeof(drmVBlank));
 
+    //sequence 0 returns at once with the last vblank
     vbl.request.type = DRM_VBLANK_RELATIVE;
-    vbl.request.sequence = 1;
+    vbl.request.sequence = 0;
     vbl.request.signal = 0;
 
     //drmWaitBland need link libdrm.so
     rc = drmWaitVBlank(drmHandle->drm_fd, &vbl);
     if (rc) {
         ERROR(mLogCategory,"drmWaitVBlank error %d", rc);
-        usleep(4000);
-        return true;
+        return false;
     }
+    *sequence = vbl.reply.sequence;
+    *timeUs = vbl.reply.tval_sec*1000000LL + vbl.reply.tval_usec;
+    return true;
+}
 
-    if (drmHandle->vrefresh)
-    {
-        refreshInterval= (1000000LL+(drmHandle->vrefresh/2))/drmHandle->vrefresh;
+void DrmFramePost::waitVblank(unsigned int sequence)
+{
+    drmVBlank vbl;
+    struct drm_display *drmHandle = mDrmDisplay->getDrmHandle();
+
+    memset(&vbl, 0, sizeof(drmVBlank));
+    vbl.request.type = DRM_VBLANK_ABSOLUTE;
+    vbl.request.sequence = sequence;
+    vbl.request.signal = 0;
+    if (drmWaitVBlank(drmHandle->drm_fd, &vbl)) {
+        usleep(4000);
     }
+}
+
+void DrmFramePost::updateVsyncClock(unsigned int sequence, int64_t timeUs)
+{
+    struct drm_display *drmHandle = mDrmDisplay->getDrmHandle();
 
-    vBlankTime = vbl.reply.tval_sec*1000000LL + vbl.reply.tval_usec;
-    vBlankTime += refreshInterval; //check next blank time
+    if (drmHandle->vrefresh > 0) {
+        mVsyncClock->setNominalPeriod((1000000LL+(drmHandle->vrefresh/2))/drmHandle->vrefresh);
+    }
+    //extend 32 bits vblank sequence, so it never wraps in vsync clock
+    if (!mVblankSeqValid) {
+        mVblankSeq = sequence;
+        mVblankSeqValid = true;
+    } else {
+        mVblankSeq += (int32_t)(sequence - mLastVblankSeq);
+    }
+    mLastVblankSeq = sequence;
+    mVsyncClock->addVsync(timeUs, mVblankSeq);
+}
 
-    Tls::Mutex::Autolock _l(mMutex);
+FrameEntity *DrmFramePost::scheduleFrame(unsigned int *waitSeq)
+{
+    FrameEntity *frameEntity = NULL;
+    int64_t frameTime = 0;
+    int64_t curSeq = mVblankSeq;
+    int64_t nextSeq = curSeq + 1;
+    int64_t targetSeq;
+    int64_t sleepSeq = nextSeq;
+
+    *waitSeq = (unsigned int)nextSeq;
+    fetchQueuedFrames();
     //if queue is empty or paused, loop next
-    if (mQueue->isEmpty() || mPaused) {
-        //TRACE(mLogCategory,"empty or paused");
-        goto tag_next;
+    if (mScheduler->isEmpty() || mPaused) {
+        return NULL;
+    }
+
+    //a frame was posted for next vblank, only one frame is shown each vblank
+    if (mPostSeqValid && nextSeq <= mLastPostSeq) {
+        *waitSeq = (unsigned int)mLastPostSeq;
+        return NULL;
     }
 
-    //we output video frame asap
     if (mImmediatelyOutput) {
-        //pop the peeked frame
-        mQueue->pop((void **)&expiredFrameEntity);
-        goto tag_post;
+        frameEntity = popExpiredFrame(0);
+    } else {
+        //frames whose nearest vblank is not after next vblank are due
+        frameEntity = popExpiredFrame(mVsyncClock->getVsyncTime(nextSeq) + mVsyncClock->getPeriodUs()/2 - 1);
+    }
+    if (frameEntity) {
+        TRACE(mLogCategory,"frame time:%lld(pts:%lld ms) to vblank %lld",frameEntity->displayTime,frameEntity->renderBuf->pts/1000000,nextSeq);
+        mPostSeqValid = true;
+        mLastPostSeq = nextSeq;
+        return frameEntity;
     }
 
-    while (mQueue->peek((void **)&curFrameEntity, 0) == Q_OK)
-    {
-        TRACE(mLogCategory,"vBlankTime:%lld,frame time:%lld(pts:%lld ms),refreshInterval:%lld",vBlankTime,curFrameEntity->displayTime,curFrameEntity->renderBuf->pts/1000000,refreshInterval);
-        //no frame expired,loop next
-        if (vBlankTime < curFrameEntity->displayTime) {
-            break;
+    //sleep until the vblank before the target of earliest frame
+    if (mScheduler->peekEarliest((void **)&frameEntity, &frameTime) == Q_OK) {
+        targetSeq = mVsyncClock->getSequence(frameTime);
+        if (targetSeq - 1 > sleepSeq) {
+            sleepSeq = targetSeq - 1;
+        }
+        if (sleepSeq - curSeq > VBLANK_MAX_WAIT_CNT) {
+            sleepSeq = curSeq + VBLANK_MAX_WAIT_CNT;
         }
+        *waitSeq = (unsigned int)sleepSeq;
+    }
+    return NULL;
+}
 
-        //pop the peeked frame
-        mQueue->pop((void **)&curFrameEntity);
+bool DrmFramePost::atomicPostLoop()
+{
+    int rc;
+    int fenceFd = -1;
+    unsigned int curSeq;
+    unsigned int waitSeq;
+    int64_t vBlankTime;
+    int64_t flipTimeUs;
+    unsigned int flipSeq = 0;
+    FrameEntity *frameEntity = NULL;
+
+    //only one commit is in flight, the flip is the vblank the frame showed
+    if (mAtomicPresenter->isFlipPending()) {
+        if (!mAtomicPresenter->waitFlipDone(FLIP_WAIT_TIMEOUT_MS, &flipTimeUs, &flipSeq)) {
+            WARNING(mLogCategory,"wait flip timeout");
+            mAtomicPresenter->abandonPendingFlip();
+            flipTimeUs = Tls::Times::getSystemTimeUs();
+            flipSeq = 0;
+        }
+        mLastFlipTimeUs = flipTimeUs;
+        //flip event is the vblank the frame latched, feed it to vsync clock
+        if (flipSeq != 0) {
+            updateVsyncClock(flipSeq, flipTimeUs);
+        }
+        if (mPendingFrame) {
+            mOnScreenFrame = mPendingFrame;
+            mPendingFrame = NULL;
+            TRACE(mLogCategory,"flipped,frame time:%lld(pts:%lld ms),flip time:%lld,vblank:%u",mOnScreenFrame->displayTime,mOnScreenFrame->renderBuf->pts/1000000,flipTimeUs,flipSeq);
+            mDrmDisplay->handleDisplayedFrameEntity(mOnScreenFrame, flipTimeUs);
+        }
+        if (mStop) {
+            return false;
+        }
+    }
 
-        //drop last expired frame,got a new expired frame
-        if (expiredFrameEntity) {
-            DEBUG(mLogCategory,"drop frame,vBlankTime:%lld,frame time:%lld(pts:%lld ms)",vBlankTime,expiredFrameEntity->displayTime,expiredFrameEntity->renderBuf->pts/1000000);
-            mDrmDisplay->handleDropedFrameEntity(expiredFrameEntity);
-            mDrmDisplay->handleReleaseFrameEntity(expiredFrameEntity);
-            expiredFrameEntity = NULL;
+    if (!queryVblank(&curSeq, &vBlankTime)) {
+        usleep(4000);
+        return true;
+    }
+    updateVsyncClock(curSeq, vBlankTime);
+
+    {
+        Tls::Mutex::Autolock _l(mMutex);
+        frameEntity = scheduleFrame(&waitSeq);
+        if (frameEntity) {
+            applyWindowSize(frameEntity);
+            rc = mAtomicPresenter->commit(frameEntity, &fenceFd);
+            if (rc) {
+                mPostSeqValid = false;
+                mDrmDisplay->handleDropedFrameEntity(frameEntity, PLUGIN_DROP_REASON_ERROR);
+                mDrmDisplay->handleReleaseFrameEntity(frameEntity);
+                return true;
+            }
+            TRACE(mLogCategory,"atomic commit,frame time:%lld(pts:%lld ms),out fence:%d",frameEntity->displayTime,frameEntity->renderBuf->pts/1000000,fenceFd);
+            mDrmDisplay->traceFrameEntity(frameEntity, PLUGIN_FRAME_STAGE_POSTED);
+
+            //the on screen frame is released when this commit latched
+            if (mOnScreenFrame) {
+                mOnScreenFrame->releaseFenceFd = fenceFd;
+                mDrmDisplay->handlePostedFrameEntity(mOnScreenFrame);
+                mOnScreenFrame = NULL;
+            } else if (fenceFd >= 0) {
+                close(fenceFd);
+            }
+            mPendingFrame = frameEntity;
+            return true;
         }
+    }
 
-        expiredFrameEntity = curFrameEntity;
-        TRACE(mLogCategory,"expire,frame time:%lld(pts:%lld ms)",expiredFrameEntity->displayTime,expiredFrameEntity->renderBuf->pts/1000000);
+    //nothing to show at next vblank, sleep until the vblank before next frame due
+    waitVblank(waitSeq);
+    return true;
+}
+
+bool DrmFramePost::threadLoop()
+{
+    int rc = -1;
+    unsigned int curSeq;
+    unsigned int waitSeq;
+    int64_t vBlankTime;
+    FrameEntity *expiredFrameEntity = NULL;
+    struct drm_display *drmHandle = mDrmDisplay->getDrmHandle();
+    DrmMesonLib *drmMesonLib = mDrmDisplay->getDrmMesonLib();
+
+    //stop thread
+    if (mStop) {
+        return false;
     }
 
-tag_post:
-    //no frame will be posted to drm display
-    if (!expiredFrameEntity) {
-        TRACE(mLogCategory,"no frame expire");
-        goto tag_next;
+    if (!drmHandle) {
+        ERROR(mLogCategory,"drm handle is NULL");
+        return false;
     }
 
-    //double check window size before post drm buffer
-    if (mWinRect.w > 0 && mWinRect.h > 0) {
-        struct drm_buf * drmBuf = expiredFrameEntity->drmBuf;
-        drmBuf->crtc_x = mWinRect.x;
-        drmBuf->crtc_y = mWinRect.y;
-        drmBuf->crtc_w = mWinRect.w;
-        drmBuf->crtc_h = mWinRect.h;
-        TRACE(mLogCategory,"postBuf crtc(%d,%d,%d,%d),src(%d,%d,%d,%d)",drmBuf->crtc_x,drmBuf->crtc_y,drmBuf->crtc_w,drmBuf->crtc_h,
-        drmBuf->src_x,drmBuf->src_y,drmBuf->src_w,drmBuf->src_h);
+    if (mAtomicPresenter) {
+        return atomicPostLoop();
     }
 
-    if (drmHandle && drmMesonLib) {
-        rc = drmMesonLib->libDrmPostBuf(drmHandle, expiredFrameEntity->drmBuf);
+    if (!queryVblank(&curSeq, &vBlankTime)) {
+        usleep(4000);
+        return true;
     }
+    updateVsyncClock(curSeq, vBlankTime);
 
-    if (rc) {
-        ERROR(mLogCategory, "drm_post_buf error %d", rc);
-        mDrmDisplay->handleDropedFrameEntity(expiredFrameEntity);
-        mDrmDisplay->handleReleaseFrameEntity(expiredFrameEntity);
-        goto tag_next;
+    {
+        Tls::Mutex::Autolock _l(mMutex);
+        expiredFrameEntity = scheduleFrame(&waitSeq);
+        if (expiredFrameEntity) {
+            applyWindowSize(expiredFrameEntity);
+
+            if (drmHandle && drmMesonLib) {
+                rc = drmMesonLib->libDrmPostBuf(drmHandle, expiredFrameEntity->drmBuf);
+            }
+
+            if (rc) {
+                ERROR(mLogCategory, "drm_post_buf error %d", rc);
+                mPostSeqValid = false;
+                mDrmDisplay->handleDropedFrameEntity(expiredFrameEntity, PLUGIN_DROP_REASON_ERROR);
+                mDrmDisplay->handleReleaseFrameEntity(expiredFrameEntity);
+                return true;
+            }
+
+            TRACE(mLogCategory,"drm_post_buf,frame time:%lld(pts:%lld ms)",expiredFrameEntity->displayTime,expiredFrameEntity->renderBuf->pts/1000000);
+            mDrmDisplay->traceFrameEntity(expiredFrameEntity, PLUGIN_FRAME_STAGE_POSTED);
+            mDrmDisplay->handlePostedFrameEntity(expiredFrameEntity);
+            //the frame shows at the vblank it was scheduled to
+            mDrmDisplay->handleDisplayedFrameEntity(expiredFrameEntity, mVsyncClock->getVsyncTime(mLastPostSeq));
+            return true;
+        }
     }
 
-    TRACE(mLogCategory,"drm_post_buf,frame time:%lld(pts:%lld ms)",expiredFrameEntity->displayTime,expiredFrameEntity->renderBuf->pts/1000000);
-    mDrmDisplay->handlePostedFrameEntity(expiredFrameEntity);
-    mDrmDisplay->handleDisplayedFrameEntity(expiredFrameEntity);
-tag_next:
+    //no frame expire at next vblank, sleep until the vblank before next frame due
+    waitVblank(waitSeq);
     return true;
 }
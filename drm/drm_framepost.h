@@ -17,9 +17,13 @@
 #define __DRM_FRAME_POST_H__
 #include "Mutex.h"
 #include "Thread.h"
-#include "Queue.h"
+#include "SpscQueue.h"
+#include "FrameScheduler.h"
+#include "VsyncClock.h"
+#include "LateFrameFilter.h"
 
 class DrmDisplay;
+class DrmAtomicPresenter;
 struct FrameEntity;
 
 class DrmFramePost : public Tls::Thread
@@ -30,6 +34,12 @@ class DrmFramePost : public Tls::Thread
     bool start();
     bool stop();
     bool readyPostFrame(FrameEntity * frameEntity);
+    /*queue frames in order at once,return the count queued,
+     they are the leading ones*/
+    int readyPostFrames(FrameEntity **frameEntities, int count);
+    /*check before a frame is imported,true if post thread would drop it
+     anyway,only called by the thread queueing frames*/
+    bool isFrameLate(int64_t displayTime);
     void flush();
     void pause();
     void resume();
@@ -45,17 +55,57 @@ class DrmFramePost : public Tls::Thread
       int w;
       int h;
     } WinRect;
+    //move frames from mQueue to mScheduler, mMutex must be held
+    void fetchQueuedFrames();
+    //pick the frame to show at vBlankTime,drop the older expired ones
+    FrameEntity *popExpiredFrame(int64_t vBlankTime);
+    //set window size to frame before it is posted
+    void applyWindowSize(FrameEntity *frameEntity);
+    //post loop of atomic commit mode
+    bool atomicPostLoop();
+    //hand frames held by atomic presenter to recycle
+    void releasePresentedFrames();
+    //get last vblank sequence and time without waiting
+    bool queryVblank(unsigned int *sequence, int64_t *timeUs);
+    //wait until vblank sequence
+    void waitVblank(unsigned int sequence);
+    //feed measured vblank to vsync clock
+    void updateVsyncClock(unsigned int sequence, int64_t timeUs);
+    /*pick the frame to post for vblank after the last measured one, if none,
+     waitSeq is set to the vblank to sleep until, mMutex must be held*/
+    FrameEntity *scheduleFrame(unsigned int *waitSeq);
     DrmDisplay *mDrmDisplay;
     int mLogCategory;
 
     bool mPaused;
     bool mStop;
+    /*serialize the consumer side of mQueue, post thread and flush,
+     the producer readyPostFrame never takes it*/
     mutable Tls::Mutex mMutex;
-    Tls::Queue *mQueue;
+    Tls::SpscQueue *mQueue;
+    //frames ordered by display time, only used with mMutex held
+    Tls::FrameScheduler *mScheduler;
 
     /*immediately output video frame to display*/
     bool mImmediatelyOutput;
     WinRect mWinRect;
+
+    //not NULL if frames are posted by atomic commit
+    DrmAtomicPresenter *mAtomicPresenter;
+    FrameEntity *mPendingFrame; //committed,wait flip
+    FrameEntity *mOnScreenFrame; //flipped, on screen now
+    int64_t mLastFlipTimeUs;
+
+    //vsync timeline fed by vblank, sequences are extended vblank sequences
+    Tls::VsyncClock *mVsyncClock;
+    bool mVblankSeqValid;
+    int64_t mVblankSeq; //last measured vblank
+    unsigned int mLastVblankSeq; //32 bits sequence of last measured vblank
+    //drops hopelessly late frames before they are queued
+    Tls::LateFrameFilter *mLateFrameFilter;
+    //vblank sequence that last posted frame shows from
+    bool mPostSeqValid;
+    int64_t mLastPostSeq;
 };
 
 #endif /*__DRM_FRAME_POST_H__*/
\ No newline at end of file
@@ -18,18 +18,22 @@
 #include "Logger.h"
 #include "drm_display.h"
 #include "drm_framerecycle.h"
+#include "Times.h"
 
 using namespace Tls;
 
 #define TAG "rlib:drm_framerecycle"
 
+/*release the frame anyway if its fence not signaled in this time*/
+#define FENCE_WAIT_TIMEOUT_MS 3000
+
 DrmFrameRecycle::DrmFrameRecycle(DrmDisplay *drmDisplay, int logCategory)
 {
     mDrmDisplay = drmDisplay;
     mLogCategory = logCategory;
     mStop = false;
-    mWaitVideoFence = false;
     mQueue = new Tls::Queue();
+    mPoll = new Tls::Poll(true);
 }
 
 DrmFrameRecycle::~DrmFrameRecycle()
@@ -37,20 +41,26 @@ DrmFrameRecycle::~DrmFrameRecycle()
     if (isRunning()) {
         mStop = true;
         DEBUG(mLogCategory,"stop frame recycle thread");
+        mPoll->setFlushing(true);
         requestExitAndWait();
     }
 
+    releaseAllFrames();
     if (mQueue) {
-        mQueue->flushAndCallback(this, DrmFrameRecycle::queueFlushCallback);
         delete mQueue;
         mQueue = NULL;
     }
+    if (mPoll) {
+        delete mPoll;
+        mPoll = NULL;
+    }
 }
 
 bool DrmFrameRecycle::start()
 {
     DEBUG(mLogCategory,"start frame recycle thread");
     mStop = false;
+    mPoll->setFlushing(false);
     run("frame recycle thread");
     return true;
 }
@@ -60,11 +70,10 @@ bool DrmFrameRecycle::stop()
     if (isRunning()) {
         mStop = true;
         DEBUG(mLogCategory,"stop frame recycle thread");
+        mPoll->setFlushing(true);
         requestExitAndWait();
     }
-    mWaitVideoFence = false;
-    Tls::Mutex::Autolock _l(mMutex);
-    mQueue->flushAndCallback(this, DrmFrameRecycle::queueFlushCallback);
+    releaseAllFrames();
     return true;
 }
 
@@ -77,12 +86,8 @@ bool DrmFrameRecycle::recycleFrame(FrameEntity * frameEntity)
     }
     mQueue->push(frameEntity);
     TRACE(mLogCategory,"queue cnt:%d",mQueue->getCnt());
-    /* when two frame are posted, fence can be retrieved.
-     * So waiting video fence starts
-     */
-    if (!mWaitVideoFence && mQueue->getCnt() > 2) {
-        mWaitVideoFence = true;
-    }
+    //let recycle thread poll the new frame
+    mPoll->wakeup();
     return true;
 }
 
@@ -92,39 +97,124 @@ void DrmFrameRecycle::queueFlushCallback(void *userdata,void *data)
     self->mDrmDisplay->handleReleaseFrameEntity((FrameEntity *)data);
 }
 
+void DrmFrameRecycle::releaseFenceFrame(FenceFrame &frame, bool signaled)
+{
+    int rc = 1;
+    DrmMesonLib *drmMesonLib = mDrmDisplay->getDrmMesonLib();
+
+    mPoll->removeFd(frame.fd);
+    //poll only tells which frame is ready first, let driver confirm its video fence,
+    //it returns at once if fence had signaled. a signaled release fence needs no confirm
+    if (frame.explicitFence) {
+        rc = signaled ? 1 : 0;
+    } else if (signaled && drmMesonLib) {
+        rc = drmMesonLib->libDrmWaitVideoFence(frame.fd);
+    }
+    if (rc <= 0) {
+        WARNING(mLogCategory, "wait fence error %d", rc);
+    }
+    TRACE(mLogCategory,"release frame:%lld(pts:%lld)",frame.entity->displayTime,frame.entity->renderBuf->pts);
+    mDrmDisplay->handleReleaseFrameEntity(frame.entity);
+}
+
+void DrmFrameRecycle::releaseAllFrames()
+{
+    for (auto it = mFenceFrames.begin(); it != mFenceFrames.end(); ) {
+        if (it->waitStartMs > 0) {
+            mPoll->removeFd(it->fd);
+        }
+        mDrmDisplay->handleReleaseFrameEntity(it->entity);
+        it = mFenceFrames.erase(it);
+    }
+    Tls::Mutex::Autolock _l(mMutex);
+    mQueue->flushAndCallback(this, DrmFrameRecycle::queueFlushCallback);
+}
+
 void DrmFrameRecycle::readyToRun()
 {
 
 }
+
 bool DrmFrameRecycle::threadLoop()
 {
     int rc;
-    struct drm_buf* gem_buf;
+    int64_t nowMs;
+    int64_t timeoutMs = -1; //wait for ever
     FrameEntity *frameEntity;
-    DrmMesonLib *drmMesonLib = mDrmDisplay->getDrmMesonLib();
 
     if (mStop) {
         return false;
     }
-    if (!mWaitVideoFence || mQueue->getCnt() < 2) {
-        usleep(8000);
-        return true;
-    }
 
-    rc = mQueue->popAndWait((void**)&frameEntity);
-    if (rc != Q_OK) {
-        return true;
+    //take over new posted frames
+    while (mQueue->pop((void**)&frameEntity) == Q_OK) {
+        FenceFrame frame;
+        frame.entity = frameEntity;
+        frame.explicitFence = frameEntity->releaseFenceFd >= 0;
+        frame.fd = frame.explicitFence ? frameEntity->releaseFenceFd : frameEntity->drmBuf->fd[0];
+        frame.waitStartMs = 0;
+        mFenceFrames.push_back(frame);
     }
 
-    TRACE(mLogCategory,"wait video fence for frame:%lld(pts:%lld)",frameEntity->displayTime,frameEntity->renderBuf->pts);
-    if (drmMesonLib) {
-        rc = drmMesonLib->libDrmWaitVideoFence(frameEntity->drmBuf->fd[0]);
+    /* the last posted frame is still on screen,its dma buffer fence can't signal,
+     * so poll the fences of all frames posted before it. a frame with release
+     * fence had left screen when the fence signals, it is polled at once
+     */
+    nowMs = Tls::Times::getSystemTimeMs();
+    if (!mFenceFrames.empty()) {
+        auto last = std::prev(mFenceFrames.end());
+        for (auto it = mFenceFrames.begin(); it != mFenceFrames.end(); ++it) {
+            if (it == last && !it->explicitFence) {
+                break;
+            }
+            if (it->waitStartMs == 0) {
+                it->waitStartMs = nowMs;
+                mPoll->addFd(it->fd);
+                if (it->explicitFence) {
+                    //sync file is readable when signaled
+                    mPoll->setFdReadable(it->fd, true);
+                } else {
+                    mPoll->setFdWritable(it->fd, true);
+                }
+            }
+            int64_t leftMs = it->waitStartMs + FENCE_WAIT_TIMEOUT_MS - nowMs;
+            if (leftMs < 0) {
+                leftMs = 0;
+            }
+            if (timeoutMs < 0 || leftMs < timeoutMs) {
+                timeoutMs = leftMs;
+            }
+        }
     }
 
-    if (rc <= 0) {
-        WARNING(mLogCategory, "wait fence error %d", rc);
+    rc = mPoll->wait(timeoutMs);
+    if (rc < 0) {
+        if (errno == EBUSY) { //flushing, thread will stop
+            return true;
+        }
+        if (errno != EINTR && errno != EAGAIN) {
+            WARNING(mLogCategory, "poll fence error %d", errno);
+        }
+        return true;
     }
 
-    mDrmDisplay->handleReleaseFrameEntity(frameEntity);
+    //release every frame whose fence had signaled or waited too long
+    nowMs = Tls::Times::getSystemTimeMs();
+    for (auto it = mFenceFrames.begin(); it != mFenceFrames.end(); ) {
+        if (it->waitStartMs == 0) {
+            ++it;
+            continue;
+        }
+        bool signaled = mPoll->isWritable(it->fd) || mPoll->isReadable(it->fd) || mPoll->isError(it->fd);
+        if (!signaled && nowMs - it->waitStartMs < FENCE_WAIT_TIMEOUT_MS) {
+            ++it;
+            continue;
+        }
+        if (!signaled) {
+            WARNING(mLogCategory, "wait fence timeout,frame:%lld(pts:%lld)",it->entity->displayTime,it->entity->renderBuf->pts);
+        }
+        releaseFenceFrame(*it, signaled);
+        it = mFenceFrames.erase(it);
+    }
     return true;
 }
@@ -15,9 +15,11 @@
  */
 #ifndef __DRM_FRAME_RECYCLE_H__
 #define __DRM_FRAME_RECYCLE_H__
+#include <list>
 #include "Mutex.h"
 #include "Thread.h"
 #include "Queue.h"
+#include "Poll.h"
 
 class DrmDisplay;
 struct FrameEntity;
@@ -35,13 +37,26 @@ class DrmFrameRecycle : public Tls::Thread
     virtual bool threadLoop();
     static void queueFlushCallback(void *userdata,void *data);
   private:
+    typedef struct {
+        FrameEntity *entity;
+        int fd; //dma buffer fd or explicit release fence polled for fence signaled
+        bool explicitFence; //fd is a release fence of atomic commit
+        int64_t waitStartMs; //0 if fence not waited yet
+    } FenceFrame;
+    //release a waited frame and stop polling its fd
+    void releaseFenceFrame(FenceFrame &frame, bool signaled);
+    //release all frames, thread must be stopped
+    void releaseAllFrames();
     DrmDisplay *mDrmDisplay;
     int mLogCategory;
 
     bool mStop;
-    bool mWaitVideoFence;
     mutable Tls::Mutex mMutex;
+    //frames posted to display, handed over to recycle thread
     Tls::Queue *mQueue;
+    //frames waiting fence signaled, in post order, only used by recycle thread
+    std::list<FenceFrame> mFenceFrames;
+    Tls::Poll *mPoll;
 };
 
 #endif /*__DRM_FRAME_RECYCLE_H__*/
\ No newline at end of file
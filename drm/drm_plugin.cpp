@@ -17,6 +17,7 @@
 #include "Logger.h"
 #include "drm_display.h"
 #include "ErrorCode.h"
+#include <unistd.h>
 
 #define TAG "rlib:drm_plugin"
 
@@ -25,6 +26,7 @@ DrmPlugin::DrmPlugin(int logCategory)
 {
     mVideoFormat = VIDEO_FORMAT_UNKNOWN;
     mIsPip = false;
+    mFrameMonitor = new Tls::FrameMonitor(mLogCategory);
     mDrmDisplay = new DrmDisplay(this,logCategory);
 }
 
@@ -34,6 +36,10 @@ DrmPlugin::~DrmPlugin()
         delete mDrmDisplay;
         mDrmDisplay = NULL;
     }
+    if (mFrameMonitor) {
+        delete mFrameMonitor;
+        mFrameMonitor = NULL;
+    }
 }
 
 void DrmPlugin::init()
@@ -108,10 +114,20 @@ int DrmPlugin::prepareFrame(RenderBuffer *buffer)
 
 int DrmPlugin::displayFrame(RenderBuffer *buffer, int64_t displayTime)
 {
+    mFrameMonitor->frameEntered(buffer, displayTime);
     mDrmDisplay->displayFrame(buffer, displayTime);
     return NO_ERROR;
 }
 
+int DrmPlugin::displayFrames(RenderBuffer **buffers, int64_t *displayTimes, int count)
+{
+    for (int i = 0; i < count; i++) {
+        mFrameMonitor->frameEntered(buffers[i], displayTimes[i]);
+    }
+    mDrmDisplay->displayFrames(buffers, displayTimes, count);
+    return NO_ERROR;
+}
+
 int DrmPlugin::flush()
 {
     mDrmDisplay->flush();
@@ -144,6 +160,9 @@ int DrmPlugin::closeWindow()
 
 int DrmPlugin::getValue(PluginKey key, void *value)
 {
+    if (mFrameMonitor->getValue(key, value)) {
+        return NO_ERROR;
+    }
     switch (key) {
         case PLUGIN_KEY_VIDEO_FORMAT: {
             *(int *)value = mVideoFormat;
@@ -160,6 +179,14 @@ int DrmPlugin::getValue(PluginKey key, void *value)
             *(int *)value = isHide == true? 1: 0;
             TRACE(mLogCategory,"get hide video:%d",*(int *)value);
         } break;
+        case PLUGIN_KEY_DRM_ATOMIC_PRESENT: {
+            bool atomic = false;
+            if (mDrmDisplay) {
+                atomic = mDrmDisplay->isAtomicPresent();
+            }
+            *(int *)value = atomic == true? 1: 0;
+            TRACE(mLogCategory,"get atomic present:%d",*(int *)value);
+        } break;
     }
 
     return NO_ERROR;
@@ -167,6 +194,9 @@ int DrmPlugin::getValue(PluginKey key, void *value)
 
 int DrmPlugin::setValue(PluginKey key, void *value)
 {
+    if (mFrameMonitor->setValue(key, value)) {
+        return NO_ERROR;
+    }
     switch (key) {
         case PLUGIN_KEY_WINDOW_SIZE: {
             RenderRect* rect = static_cast<RenderRect*>(value);
@@ -213,26 +243,36 @@ int DrmPlugin::setValue(PluginKey key, void *value)
                 mDrmDisplay->setKeepLastFrame(keepLastFrame);
             }
         } break;
+        case PLUGIN_KEY_DRM_ATOMIC_PRESENT: {
+            int atomic = *(int *)(value);
+            DEBUG(mLogCategory, "Set atomic present :%d",atomic);
+            if (mDrmDisplay) {
+                mDrmDisplay->setAtomicPresent(atomic > 0? true:false);
+            }
+        } break;
     }
     return NO_ERROR;
 }
 
 void DrmPlugin::handleBufferRelease(RenderBuffer *buffer)
 {
+    mFrameMonitor->frameReleased(buffer);
     if (mCallback) {
         mCallback->doBufferReleaseCallback(mUserData, (void *)buffer);
     }
 }
 
-void DrmPlugin::handleFrameDisplayed(RenderBuffer *buffer)
+void DrmPlugin::handleFrameDisplayed(RenderBuffer *buffer, int64_t presentTime)
 {
+    mFrameMonitor->frameDisplayed(buffer, presentTime);
     if (mCallback) {
         mCallback->doBufferDisplayedCallback(mUserData, (void *)buffer);
     }
 }
 
-void DrmPlugin::handleFrameDropped(RenderBuffer *buffer)
+void DrmPlugin::handleFrameDropped(RenderBuffer *buffer, PluginDropReason reason)
 {
+    mFrameMonitor->frameDropped(buffer, reason);
     if (mCallback) {
         mCallback->doBufferDropedCallback(mUserData, (void *)buffer);
     }
@@ -16,6 +16,7 @@
 #ifndef __DRM_PLUGIN_H__
 #define __DRM_PLUGIN_H__
 #include "render_plugin.h"
+#include "FrameMonitor.h"
 
 class DrmDisplay;
 
@@ -31,6 +32,7 @@ class DrmPlugin : public RenderPlugin
     virtual int openWindow();
     virtual int prepareFrame(RenderBuffer *buffer);
     virtual int displayFrame(RenderBuffer *buffer, int64_t displayTime);
+    virtual int displayFrames(RenderBuffer **buffers, int64_t *displayTimes, int count);
     virtual int flush();
     virtual int pause();
     virtual int resume();
@@ -40,12 +42,16 @@ class DrmPlugin : public RenderPlugin
     virtual int setValue(PluginKey key, void *value);
     //buffer release callback
     virtual void handleBufferRelease(RenderBuffer *buffer);
-    //buffer had displayed ,but not release
-    virtual void handleFrameDisplayed(RenderBuffer *buffer);
+    //buffer had displayed ,but not release,presentTime is monotonic time it showed,us
+    virtual void handleFrameDisplayed(RenderBuffer *buffer, int64_t presentTime);
     //buffer droped callback
-    virtual void handleFrameDropped(RenderBuffer *buffer);
+    virtual void handleFrameDropped(RenderBuffer *buffer, PluginDropReason reason);
     //handle msg to render core
     void handleMsgNotify(int type, void *detail);
+    //per frame trace,statistics and record
+    Tls::FrameMonitor *getFrameMonitor() {
+        return mFrameMonitor;
+    };
     int getLogCategory() {
         return mLogCategory;
     };
@@ -60,6 +66,7 @@ class DrmPlugin : public RenderPlugin
     RenderVideoFormat mVideoFormat;
 
     void *mUserData;
+    Tls::FrameMonitor *mFrameMonitor;
 };
 
 
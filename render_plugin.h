@@ -50,8 +50,131 @@ typedef enum _PluginKey {
     PLUGIN_KEY_CURRENT_OUTPUT, //set/get signal output,value type is int
     PLUGIN_KEY_VIDEO_FRAME_RATE, //set/get video frame rate,value type is RenderFraction
     PLUGIN_KEY_KEEP_LAST_FRAME_ON_FLUSH, //set/get keep last frame when seeking,value type is int, 0 not keep, 1 keep
+    PLUGIN_KEY_PRESENT_AHEAD_MARGIN, //set/get how early a frame is posted before its display time,value type is int, unit us, 0 is default
+    PLUGIN_KEY_DRM_ATOMIC_PRESENT, //set/get posting frames by drm atomic commit,set it before window opened,value type is int, 0 is default drm_post_buf, 1 is atomic commit
+    PLUGIN_KEY_FRAME_TRACE, //get latest frame stage events,value type is PluginFrameTrace point
+    PLUGIN_KEY_FRAME_TRACE_DUMP, //set a file path to dump frame stage events as chrome trace json,value type is char string
+    PLUGIN_KEY_STATISTICS, //get frame statistics,value type is PluginStatistics point,set it with NULL value to reset statistics
+    PLUGIN_KEY_FRAME_RECORD, //set a file path to record frame stage events in binary,NULL value stops recording,value type is char string
+    PLUGIN_KEY_DMABUF_MODIFIER, //set/get drm format modifier of dma buffers passed to displayFrame,value type is uint64_t,default is DRM_FORMAT_MOD_LINEAR
+    PLUGIN_KEY_SCANOUT_FORMAT, //get scanout state and the format compositor can scanout,value type is PluginScanoutFormat point
 } PluginKey;
 
+/**
+ * @brief stages a frame passes in plugin
+ * not every plugin sees every stage
+ */
+typedef enum _PluginFrameStage {
+    PLUGIN_FRAME_STAGE_DISPLAY, //frame entered displayFrame
+    PLUGIN_FRAME_STAGE_READY, //drm buffer imported or wl_buffer created
+    PLUGIN_FRAME_STAGE_QUEUED, //queued to post thread or video server
+    PLUGIN_FRAME_STAGE_POSTED, //posted to drm or committed to compositor
+    PLUGIN_FRAME_STAGE_DISPLAYED, //displayed callback
+    PLUGIN_FRAME_STAGE_DROPPED, //dropped callback
+    PLUGIN_FRAME_STAGE_RELEASED, //release callback, frame leaves plugin
+    PLUGIN_FRAME_STAGE_CNT,
+} PluginFrameStage;
+
+static inline const char *pluginFrameStageName(int stage)
+{
+    switch (stage) {
+        case PLUGIN_FRAME_STAGE_DISPLAY: return "display";
+        case PLUGIN_FRAME_STAGE_READY: return "ready";
+        case PLUGIN_FRAME_STAGE_QUEUED: return "queued";
+        case PLUGIN_FRAME_STAGE_POSTED: return "posted";
+        case PLUGIN_FRAME_STAGE_DISPLAYED: return "displayed";
+        case PLUGIN_FRAME_STAGE_DROPPED: return "dropped";
+        case PLUGIN_FRAME_STAGE_RELEASED: return "released";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief a stage event of a frame
+ */
+typedef struct _PluginFrameEvent {
+    int64_t pts; //frame pts, nano second
+    int bufferId; //RenderBuffer id
+    int stage; //refer to PluginFrameStage
+    int64_t time; //monotonic time the frame reached stage, us
+} PluginFrameEvent;
+
+/**
+ * @brief frame stage events got by PLUGIN_KEY_FRAME_TRACE
+ */
+typedef struct _PluginFrameTrace {
+    PluginFrameEvent *events; //array allocated by caller, filled oldest first
+    int capacity; //element count of events, set by caller
+    int count; //element count filled, set by plugin
+} PluginFrameTrace;
+
+/**
+ * @brief why a frame was dropped
+ */
+typedef enum _PluginDropReason {
+    PLUGIN_DROP_REASON_LATE, //too late to be shown when it entered plugin
+    PLUGIN_DROP_REASON_EXPIRED, //a later frame is due at the same vblank
+    PLUGIN_DROP_REASON_QUEUE_FULL, //post queue or scheduler is full
+    PLUGIN_DROP_REASON_ERROR, //import,post,commit or send failed
+    PLUGIN_DROP_REASON_FLUSH, //flushed or window closed before shown
+    PLUGIN_DROP_REASON_COMPOSITOR, //dropped by compositor or video server
+    PLUGIN_DROP_REASON_CNT,
+} PluginDropReason;
+
+/**
+ * @brief presentation error histogram bucket count,
+ * error is actual present time minus target display time,
+ * bucket edges are -16,-8,-4,-2,0,2,4,8,16 ms, bucket 0 is
+ * below -16ms and the last bucket is 16ms or above
+ */
+#define PLUGIN_PRESENT_ERROR_BUCKET_CNT 10
+
+/**
+ * @brief how compositor shows the video frames,
+ * only plugins that get compositor feedback know it
+ */
+typedef enum _PluginScanoutState {
+    PLUGIN_SCANOUT_STATE_UNKNOWN, //no feedback from compositor
+    PLUGIN_SCANOUT_STATE_DIRECT, //frames are put on a display plane directly, zero copy
+    PLUGIN_SCANOUT_STATE_COMPOSITED, //frames are composited by gpu
+} PluginScanoutState;
+
+/**
+ * @brief scanout advice got by PLUGIN_KEY_SCANOUT_FORMAT, only weston
+ * plugin fills it. to get back to direct scanout app reallocates its
+ * buffers in videoFormat and modifier, then sets them by
+ * PLUGIN_KEY_VIDEO_FORMAT and PLUGIN_KEY_DMABUF_MODIFIER
+ */
+typedef struct _PluginScanoutFormat {
+    int scanoutState; //current PluginScanoutState
+    int fallback; //1 if compositor fell back from direct scanout and still composites the video
+    int videoFormat; //RenderVideoFormat compositor can scanout,committed format is preferred,VIDEO_FORMAT_UNKNOWN if none
+    uint64_t modifier; //drm format modifier of videoFormat for scanout,DRM_FORMAT_MOD_INVALID if none
+} PluginScanoutFormat;
+
+/**
+ * @brief frame statistics got by PLUGIN_KEY_STATISTICS,
+ * counted since plugin created or statistics reset
+ */
+typedef struct _PluginStatistics {
+    int64_t displayCnt; //frames passed to displayFrame
+    int64_t presentedCnt; //frames shown
+    int64_t droppedCnt; //frames dropped
+    int64_t dropCnt[PLUGIN_DROP_REASON_CNT]; //dropped frames of every PluginDropReason
+    int64_t presentErrorHist[PLUGIN_PRESENT_ERROR_BUCKET_CNT]; //shown frames of every error bucket
+    int64_t presentErrorAvgUs; //average presentation error, us
+    int queueDepthHighWater; //max frames waiting in post queue or compositor
+    int inFlightHighWater; //max frames held by plugin
+    int64_t releaseLatencyP50Us; //latency from displayFrame to release of latest frames, us
+    int64_t releaseLatencyP90Us;
+    int64_t releaseLatencyP99Us;
+    int64_t releaseLatencyMaxUs; //max latency since reset, us
+    int scanoutState; //current PluginScanoutState, it is not cleared by reset
+    int64_t scanoutCnt; //frames committed while in direct scanout
+    int64_t composedCnt; //frames committed while composited by gpu
+    int64_t scanoutFallbackCnt; //times compositor fell back from direct scanout to gpu composition
+} PluginStatistics;
+
 /**
  * render plugin interface
  * api sequence:
@@ -61,7 +184,7 @@ typedef enum _PluginKey {
  * 4.plugin->openDisplay
  * 5.plugin->openWindow
  * 6.plugin->set
- * 7.plugin->displayFrame
+ * 7.plugin->displayFrame or plugin->displayFrames
  * ......
  * after running ,stop plugin
  * 8.plugin->closeWindow
@@ -167,6 +290,30 @@ class RenderPlugin {
      * @return 0 success,other value if failure
      */
     virtual int setValue(PluginKey key, void *value) = 0;
+    /**
+     * @brief sending video frames to compositor in one call,
+     * it is for bursty producers, e.g. preroll and refilling after seek.
+     * frames are handled in array order, each one is displayed,dropped
+     * or failed like it is passed to displayFrame.
+     * plugins override it to take locks and talk to compositor once,
+     * the default one calls displayFrame for every frame
+     *
+     * @param buffers video frame buffers
+     * @param displayTimes the render realtime of every frame
+     * @param count frame count
+     * @return 0 success,other value if any frame failed
+     * appended last to keep the vtable slots of older plugins
+     */
+    virtual int displayFrames(RenderBuffer **buffers, int64_t *displayTimes, int count) {
+        int ret = 0;
+        for (int i = 0; i < count; i++) {
+            int rc = displayFrame(buffers[i], displayTimes[i]);
+            if (rc != 0) {
+                ret = rc;
+            }
+        }
+        return ret;
+    };
 };
 #ifdef  __cplusplus
 extern "C" {
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FrameMonitor.h"
+#include "Logger.h"
+
+#define TAG "rlib:frame_monitor"
+
+namespace Tls {
+
+FrameMonitor::FrameMonitor(int logCategory)
+    : mLogCategory(logCategory)
+{
+    mFrameTracer = new Tls::FrameTracer(FRAME_TRACER_DEFAULT_CAPACITY, pluginFrameStageName, PLUGIN_FRAME_STAGE_CNT);
+    mFrameStatistics = new Tls::FrameStatistics();
+    mFrameRecorder = new Tls::FrameRecorder(pluginFrameStageName, PLUGIN_FRAME_STAGE_CNT);
+    mFrameRecorder->openFromEnv(Logger_get_id(mLogCategory));
+}
+
+FrameMonitor::~FrameMonitor()
+{
+    if (mFrameTracer) {
+        delete mFrameTracer;
+        mFrameTracer = NULL;
+    }
+    if (mFrameStatistics) {
+        delete mFrameStatistics;
+        mFrameStatistics = NULL;
+    }
+    if (mFrameRecorder) {
+        delete mFrameRecorder;
+        mFrameRecorder = NULL;
+    }
+}
+
+void FrameMonitor::frameEntered(RenderBuffer *buffer, int64_t displayTime)
+{
+    traceFrame(buffer, PLUGIN_FRAME_STAGE_DISPLAY, displayTime, -1);
+    mFrameStatistics->frameEntered(buffer, buffer->id, displayTime);
+}
+
+void FrameMonitor::frameDisplayed(RenderBuffer *buffer, int64_t presentTime)
+{
+    traceFrame(buffer, PLUGIN_FRAME_STAGE_DISPLAYED, -1, presentTime > 0 ? presentTime : -1);
+    mFrameStatistics->framePresented(buffer, buffer->id, presentTime);
+}
+
+void FrameMonitor::frameDropped(RenderBuffer *buffer, PluginDropReason reason)
+{
+    traceFrame(buffer, PLUGIN_FRAME_STAGE_DROPPED);
+    mFrameStatistics->frameDropped(reason);
+}
+
+void FrameMonitor::frameReleased(RenderBuffer *buffer)
+{
+    traceFrame(buffer, PLUGIN_FRAME_STAGE_RELEASED);
+    mFrameStatistics->frameReleased(buffer, buffer->id);
+}
+
+bool FrameMonitor::getValue(PluginKey key, void *value)
+{
+    switch (key) {
+        case PLUGIN_KEY_FRAME_TRACE: {
+            PluginFrameTrace *trace = static_cast<PluginFrameTrace *>(value);
+            trace->count = mFrameTracer->getEvents(trace->events, trace->capacity);
+        } break;
+        case PLUGIN_KEY_STATISTICS: {
+            mFrameStatistics->getStatistics(static_cast<PluginStatistics *>(value));
+        } break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+bool FrameMonitor::setValue(PluginKey key, void *value)
+{
+    switch (key) {
+        case PLUGIN_KEY_FRAME_TRACE_DUMP: {
+            const char *path = static_cast<const char *>(value);
+            if (!mFrameTracer->dump(path, Logger_get_id(mLogCategory))) {
+                ERROR(mLogCategory,"dump frame trace to %s fail",path);
+            }
+        } break;
+        case PLUGIN_KEY_STATISTICS: {
+            DEBUG(mLogCategory,"reset statistics");
+            mFrameStatistics->reset();
+        } break;
+        case PLUGIN_KEY_FRAME_RECORD: {
+            const char *path = static_cast<const char *>(value);
+            if (!path) {
+                INFO(mLogCategory,"stop frame record");
+                mFrameRecorder->close();
+            } else if (!mFrameRecorder->open(path, FRAME_RECORDER_DEFAULT_CAPACITY, Logger_get_id(mLogCategory))) {
+                ERROR(mLogCategory,"open frame record file %s fail",path);
+            } else {
+                INFO(mLogCategory,"record frames to %s",path);
+            }
+        } break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+}
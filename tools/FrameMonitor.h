@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_FRAME_MONITOR_H_
+#define _TOOLS_FRAME_MONITOR_H_
+#include <stdint.h>
+#include "render_plugin.h"
+#include "FrameTracer.h"
+#include "FrameStatistics.h"
+#include "FrameRecorder.h"
+
+namespace Tls {
+
+/**
+ * per frame instrumentation owned by every plugin, it keeps the
+ * stage trace, the statistics and the binary record of frames,
+ * and serves the PLUGIN_KEY_FRAME_TRACE, PLUGIN_KEY_FRAME_TRACE_DUMP,
+ * PLUGIN_KEY_STATISTICS and PLUGIN_KEY_FRAME_RECORD keys.
+ * all methods are thread safe
+ */
+class FrameMonitor {
+  public:
+    FrameMonitor(int logCategory);
+    virtual ~FrameMonitor();
+    /**
+     * record frame reached stage, refer to PluginFrameStage
+     */
+    void traceFrame(RenderBuffer *buffer, int stage) {
+        traceFrame(buffer, stage, -1, -1);
+    };
+    /**
+     * displayTime and vblankTime are monotonic us, -1 if unknown
+     */
+    void traceFrame(RenderBuffer *buffer, int stage, int64_t displayTime, int64_t vblankTime) {
+        mFrameTracer->record(buffer->pts, buffer->id, stage);
+        mFrameRecorder->record(stage, buffer->pts, buffer->id, displayTime, vblankTime);
+    };
+    /**
+     * frame was passed to plugin by displayFrame(s)
+     */
+    void frameEntered(RenderBuffer *buffer, int64_t displayTime);
+    /**
+     * frame was shown, presentTime is monotonic us, <= 0 if unknown
+     */
+    void frameDisplayed(RenderBuffer *buffer, int64_t presentTime);
+    /**
+     * frame was dropped, it is still released later
+     */
+    void frameDropped(RenderBuffer *buffer, PluginDropReason reason);
+    /**
+     * frame was released to its owner
+     */
+    void frameReleased(RenderBuffer *buffer);
+    /**
+     * report frame count waiting to be posted, counted on plugin
+     * post queue, or on compositor queue when plugin posts at once.
+     * a plugin reports it from one counter only
+     */
+    void queueDepth(int depth) {
+        mFrameStatistics->queueDepth(depth);
+    };
+    /**
+     * report compositor scanout state change, refer to PluginScanoutState
+     */
+    void scanoutState(int state, bool fallback) {
+        mFrameStatistics->scanoutState(state, fallback);
+    };
+    /**
+     * report a frame committed in direct scanout or gpu composition
+     */
+    void frameScanout(bool direct) {
+        mFrameStatistics->frameScanout(direct);
+    };
+    /**
+     * get value of a frame monitor key
+     * @return true if key is served by frame monitor
+     */
+    bool getValue(PluginKey key, void *value);
+    /**
+     * set value of a frame monitor key
+     * @return true if key is served by frame monitor
+     */
+    bool setValue(PluginKey key, void *value);
+  private:
+    int mLogCategory;
+    Tls::FrameTracer *mFrameTracer;
+    Tls::FrameStatistics *mFrameStatistics;
+    Tls::FrameRecorder *mFrameRecorder;
+};
+
+}
+
+#endif /*_TOOLS_FRAME_MONITOR_H_*/
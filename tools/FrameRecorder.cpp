@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "FrameRecorder.h"
+#include "Times.h"
+
+namespace Tls {
+
+static uint32_t getThreadId()
+{
+    //gettid is a syscall, do it once per thread
+    static thread_local uint32_t tid = 0;
+    if (tid == 0) {
+        tid = (uint32_t)syscall(SYS_gettid);
+    }
+    return tid;
+}
+
+FrameRecorder::FrameRecorder(const char *(*eventName)(int event), int eventCnt)
+{
+    mHeader.store(NULL, std::memory_order_relaxed);
+    mRecords = NULL;
+    mMask = 0;
+    mMapSize = 0;
+    mUsers.store(0, std::memory_order_relaxed);
+    mEventName = eventName;
+    mEventCnt = eventCnt;
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    close();
+}
+
+bool FrameRecorder::open(const char *path, uint32_t capacity, int instanceId)
+{
+    FrameRecordHeader *header;
+    struct timespec ts;
+    uint32_t size = 2;
+    size_t mapSize;
+    void *map;
+    int fd;
+
+    close();
+    if (!path) {
+        return false;
+    }
+    while (size < capacity && size < (1u << 24)) {
+        size <<= 1;
+    }
+    mapSize = sizeof(FrameRecordHeader) + (size_t)size * sizeof(FrameRecord);
+
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, mapSize) != 0) {
+        ::close(fd);
+        return false;
+    }
+    //zero filled by ftruncate, every record seq is 0
+    map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    header = (FrameRecordHeader *)map;
+    memcpy(header->magic, FRAME_RECORD_MAGIC, sizeof(header->magic));
+    header->version = FRAME_RECORD_VERSION;
+    header->headerSize = sizeof(FrameRecordHeader);
+    header->recordSize = sizeof(FrameRecord);
+    header->capacity = size;
+    header->pid = getpid();
+    header->instanceId = instanceId;
+    header->startMonotonicUs = Tls::Times::getSystemTimeUs();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header->startRealtimeUs = (int64_t)ts.tv_sec*1000000LL + ts.tv_nsec/1000;
+    header->eventCnt = mEventCnt < FRAME_RECORD_MAX_EVENTS ? mEventCnt : FRAME_RECORD_MAX_EVENTS;
+    for (uint32_t i = 0; mEventName && i < header->eventCnt; i++) {
+        strncpy(header->eventNames[i], mEventName(i), FRAME_RECORD_EVENT_NAME_LEN - 1);
+    }
+    header->writeIndex = 0;
+
+    mRecords = (FrameRecord *)((char *)map + sizeof(FrameRecordHeader));
+    mMask = size - 1;
+    mMapSize = mapSize;
+    mHeader.store(header, std::memory_order_release);
+    return true;
+}
+
+bool FrameRecorder::openFromEnv(int instanceId)
+{
+    char path[256];
+    const char *dir = getenv(FRAME_RECORD_DIR_ENV);
+    if (!dir || strlen(dir) == 0) {
+        return false;
+    }
+    snprintf(path, sizeof(path), "%s/rlib-%d-%d.frec", dir, getpid(), instanceId);
+    return open(path, FRAME_RECORDER_DEFAULT_CAPACITY, instanceId);
+}
+
+void FrameRecorder::close()
+{
+    //seq_cst pairs with record, either it sees NULL or close sees its user
+    FrameRecordHeader *header = mHeader.exchange(NULL, std::memory_order_seq_cst);
+    if (!header) {
+        return;
+    }
+    //wait for threads still writing to the mapping
+    while (mUsers.load(std::memory_order_seq_cst) > 0) {
+        usleep(100);
+    }
+    munmap(header, mMapSize);
+    mRecords = NULL;
+    mMapSize = 0;
+}
+
+void FrameRecorder::record(int event, int64_t pts, int bufferId, int64_t displayTime, int64_t vblankTime)
+{
+    if (!isOpened()) {
+        return;
+    }
+    mUsers.fetch_add(1, std::memory_order_seq_cst);
+    FrameRecordHeader *header = mHeader.load(std::memory_order_seq_cst);
+    if (!header) {
+        mUsers.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+
+    uint64_t index = __atomic_fetch_add(&header->writeIndex, 1, __ATOMIC_RELAXED);
+    FrameRecord *record = &mRecords[index & mMask];
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    //readers must see seq cleared before any field changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record->time = Tls::Times::getSystemTimeUs();
+    record->pts = pts;
+    record->displayTime = displayTime;
+    record->vblankTime = vblankTime;
+    record->bufferId = bufferId;
+    record->tid = getThreadId();
+    record->event = (uint16_t)event;
+    __atomic_store_n(&record->seq, index + 1, __ATOMIC_RELEASE);
+
+    mUsers.fetch_sub(1, std::memory_order_release);
+}
+
+}
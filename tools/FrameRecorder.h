@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_FRAME_RECORDER_H_
+#define _TOOLS_FRAME_RECORDER_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace Tls {
+
+#define FRAME_RECORD_MAGIC "RLIBFREC"
+#define FRAME_RECORD_VERSION 1
+#define FRAME_RECORD_MAX_EVENTS 16
+#define FRAME_RECORD_EVENT_NAME_LEN 16
+/**
+ * default record count kept in file, rounded up to power of 2,
+ * it is about 90 seconds of 60fps video
+ */
+#define FRAME_RECORDER_DEFAULT_CAPACITY 32768
+/**
+ * env of the directory frame record files are written to,
+ * a file named rlib-<pid>-<instance id>.frec is opened
+ * for every plugin instance when it is set
+ */
+#define FRAME_RECORD_DIR_ENV "VIDEO_RENDER_PLUGIN_FRAME_RECORD_DIR"
+
+/**
+ * frame record file header, records follow it.
+ * the file is read by tools/host/frame_record_decode
+ */
+typedef struct {
+    char magic[8]; //FRAME_RECORD_MAGIC without the ending zero
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordSize;
+    uint32_t capacity; //record slots, power of 2
+    int32_t pid;
+    int32_t instanceId; //plugin instance id
+    int64_t startMonotonicUs; //monotonic and real time when file opened,
+    int64_t startRealtimeUs; //to map record time to wall clock
+    uint32_t eventCnt;
+    uint32_t reserved;
+    char eventNames[FRAME_RECORD_MAX_EVENTS][FRAME_RECORD_EVENT_NAME_LEN];
+    uint64_t writeIndex; //records ever written, the latest capacity ones are kept
+} FrameRecordHeader;
+
+/**
+ * a frame event record, times are monotonic us
+ */
+typedef struct {
+    uint64_t seq; //record index + 1 once written, 0 while being written
+    int64_t time; //when the event happened
+    int64_t pts; //frame pts, ns
+    int64_t displayTime; //time frame should show, -1 if unknown
+    int64_t vblankTime; //time frame showed, -1 if unknown
+    int32_t bufferId;
+    uint32_t tid; //thread recorded the event
+    uint16_t event;
+    uint16_t reserved[3];
+} FrameRecord;
+
+/**
+ * records frame events to a mmap'd file in binary, so it is cheap
+ * enough to be left on in the field and the latest records survive
+ * a crash. any thread may record, records are written lock free and
+ * the oldest ones are overwritten. a closed recorder costs an atomic
+ * load per event
+ */
+class FrameRecorder {
+  public:
+    /**
+     * eventName - get name of an event, names are stored in file
+     * eventCnt - count of events
+     */
+    FrameRecorder(const char *(*eventName)(int event), int eventCnt);
+    virtual ~FrameRecorder();
+    /**
+     * create file and start recording, a opened file is closed first
+     *
+     * capacity - max records kept
+     * instanceId - plugin instance id stored in file
+     * returns true if opened
+     */
+    bool open(const char *path, uint32_t capacity, int instanceId);
+    /**
+     * open file in directory set by FRAME_RECORD_DIR_ENV
+     * returns true if env is set and file opened
+     */
+    bool openFromEnv(int instanceId);
+    /**
+     * stop recording and close file
+     */
+    void close();
+    bool isOpened() {
+        return mHeader.load(std::memory_order_relaxed) != NULL;
+    };
+    /**
+     * record an event of frame at current time,
+     * displayTime and vblankTime are -1 if unknown
+     */
+    void record(int event, int64_t pts, int bufferId, int64_t displayTime, int64_t vblankTime);
+  private:
+    std::atomic<FrameRecordHeader *> mHeader;
+    FrameRecord *mRecords;
+    uint32_t mMask;
+    size_t mMapSize;
+    //recording threads using the mapping, close waits for them
+    std::atomic<int> mUsers;
+    const char *(*mEventName)(int event);
+    int mEventCnt;
+};
+
+}
+
+#endif /*_TOOLS_FRAME_RECORDER_H_*/
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "FrameScheduler.h"
+
+namespace Tls {
+
+#define FRAME_SCHEDULER_DEFAULT_CAPACITY 32
+
+FrameScheduler::FrameScheduler(uint32_t capacityHint)
+{
+    mSize = capacityHint > 0 ? capacityHint : FRAME_SCHEDULER_DEFAULT_CAPACITY;
+    mHeap = (Node *)calloc(mSize, sizeof(Node));
+    if (!mHeap) {
+        mSize = 0;
+    }
+    mCnt = 0;
+    mSeq = 0;
+}
+
+FrameScheduler::~FrameScheduler()
+{
+    if (mHeap) {
+        free(mHeap);
+        mHeap = NULL;
+    }
+}
+
+int32_t FrameScheduler::push(void *frame, int64_t time)
+{
+    if (mCnt == mSize && _grow() != Q_OK) {
+        return Q_ERR_MEM;
+    }
+    mHeap[mCnt].time = time;
+    mHeap[mCnt].seq = mSeq++;
+    mHeap[mCnt].frame = frame;
+    _siftUp(mCnt);
+    mCnt++;
+    return Q_OK;
+}
+
+int32_t FrameScheduler::peekEarliest(void **frame, int64_t *time)
+{
+    if (mCnt == 0) {
+        return Q_ERR_NUM_ELEMENTS;
+    }
+    *frame = mHeap[0].frame;
+    if (time) {
+        *time = mHeap[0].time;
+    }
+    return Q_OK;
+}
+
+int32_t FrameScheduler::popEarliest(void **frame, int64_t *time)
+{
+    if (mCnt == 0) {
+        *frame = NULL;
+        return Q_ERR_NUM_ELEMENTS;
+    }
+    *frame = mHeap[0].frame;
+    if (time) {
+        *time = mHeap[0].time;
+    }
+    mCnt--;
+    if (mCnt > 0) {
+        mHeap[0] = mHeap[mCnt];
+        _siftDown(0);
+    }
+    return Q_OK;
+}
+
+int32_t FrameScheduler::popExpired(int64_t beforeTime, void **frame, int64_t *time)
+{
+    if (mCnt == 0 || mHeap[0].time > beforeTime) {
+        *frame = NULL;
+        return Q_ERR_NUM_ELEMENTS;
+    }
+    return popEarliest(frame, time);
+}
+
+int32_t FrameScheduler::flushAndCallback(void *userdata, void (*fcb)(void *userdata, void *ele))
+{
+    void *frame;
+    while (popEarliest(&frame, NULL) == Q_OK) {
+        if (fcb != NULL) {
+            fcb(userdata, frame);
+        }
+    }
+    mSeq = 0;
+    return Q_OK;
+}
+
+void FrameScheduler::_siftUp(uint32_t pos)
+{
+    Node node = mHeap[pos];
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+        if (!_before(node, mHeap[parent])) {
+            break;
+        }
+        mHeap[pos] = mHeap[parent];
+        pos = parent;
+    }
+    mHeap[pos] = node;
+}
+
+void FrameScheduler::_siftDown(uint32_t pos)
+{
+    Node node = mHeap[pos];
+    for ( ; ; ) {
+        uint32_t child = 2 * pos + 1;
+        if (child >= mCnt) {
+            break;
+        }
+        if (child + 1 < mCnt && _before(mHeap[child + 1], mHeap[child])) {
+            child++;
+        }
+        if (!_before(mHeap[child], node)) {
+            break;
+        }
+        mHeap[pos] = mHeap[child];
+        pos = child;
+    }
+    mHeap[pos] = node;
+}
+
+int32_t FrameScheduler::_grow()
+{
+    uint32_t size = mSize > 0 ? mSize * 2 : FRAME_SCHEDULER_DEFAULT_CAPACITY;
+    Node *heap = (Node *)realloc(mHeap, size * sizeof(Node));
+    if (!heap) {
+        return Q_ERR_MEM;
+    }
+    mHeap = heap;
+    mSize = size;
+    return Q_OK;
+}
+
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_FRAME_SCHEDULER_H_
+#define _TOOLS_FRAME_SCHEDULER_H_
+#include <stdint.h>
+#include "Queue.h"
+
+namespace Tls {
+
+/**
+ * time ordered frame scheduler, a binary min heap keyed by display time.
+ * frames with the same display time come out in push order.
+ * push/pop are O(log n), peek is O(1), the heap storage is preallocated
+ * and only grows if the capacity hint is exceeded.
+ * it is not thread safe, the caller serializes access.
+ * error codes are the same with Tls::Queue
+ */
+class FrameScheduler {
+  public:
+    /**
+     * capacityHint - slot count to preallocate, == 0 for the default
+     */
+    FrameScheduler(uint32_t capacityHint);
+    virtual ~FrameScheduler();
+    /**
+     * add a frame which should be displayed at time
+     *
+     * returns Q_OK if everything worked, < 0 if error occurred
+     */
+    int32_t push(void *frame, int64_t time);
+    /**
+     * get the earliest frame without removing it
+     *
+     * time - if not NULL, set to the frame display time
+     *
+     * returns Q_OK if everything worked, Q_ERR_NUM_ELEMENTS if empty
+     */
+    int32_t peekEarliest(void **frame, int64_t *time);
+    /**
+     * remove and get the earliest frame
+     *
+     * returns Q_OK if everything worked, Q_ERR_NUM_ELEMENTS if empty
+     */
+    int32_t popEarliest(void **frame, int64_t *time);
+    /**
+     * remove and get the earliest frame if its display time
+     * is not later than beforeTime, call it in a loop to pop all
+     * expired frames in display time order
+     *
+     * returns Q_OK if a frame expired, Q_ERR_NUM_ELEMENTS if none
+     */
+    int32_t popExpired(int64_t beforeTime, void **frame, int64_t *time);
+    /**
+     * remove all frames and call fcb for every one in display time order
+     */
+    int32_t flushAndCallback(void *userdata, void (*fcb)(void *userdata, void *ele));
+    int32_t getCnt() {
+        return (int32_t)mCnt;
+    };
+    bool isEmpty() {
+        return mCnt == 0;
+    };
+  private:
+    typedef struct {
+        int64_t time;
+        uint64_t seq; //push order, keeps equal times fifo
+        void *frame;
+    } Node;
+    inline bool _before(const Node &a, const Node &b) {
+        return a.time < b.time || (a.time == b.time && a.seq < b.seq);
+    };
+    void _siftUp(uint32_t pos);
+    void _siftDown(uint32_t pos);
+    int32_t _grow();
+
+    Node *mHeap;
+    uint32_t mSize; //slot count of mHeap
+    uint32_t mCnt; //the cnt of frames in heap
+    uint64_t mSeq;
+};
+
+}
+
+#endif /*_TOOLS_FRAME_SCHEDULER_H_*/
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+#include <algorithm>
+#include "FrameStatistics.h"
+#include "Times.h"
+
+namespace Tls {
+
+//upper edges of presentation error buckets, us
+static const int64_t sPresentErrorEdges[FRAME_STATS_PRESENT_ERROR_BUCKET_CNT - 1] = {
+    -16000, -8000, -4000, -2000, 0, 2000, 4000, 8000, 16000
+};
+
+FrameStatistics::FrameStatistics()
+{
+    memset(mFrames, 0, sizeof(mFrames));
+    mInFlightCnt = 0;
+    mScanoutState = 0;
+    reset();
+}
+
+FrameStatistics::~FrameStatistics()
+{
+}
+
+FrameStatistics::FrameEntry *FrameStatistics::findFrame(void *frame, int id, bool create)
+{
+    FrameEntry *freeEntry = NULL;
+    uint32_t slot = (uint32_t)id;
+
+    //linear probe from the id slot, ids of a stream are mostly dense
+    for (int i = 0; i < FRAME_STATS_MAX_IN_FLIGHT; i++) {
+        FrameEntry *entry = &mFrames[(slot + i) & (FRAME_STATS_MAX_IN_FLIGHT - 1)];
+        if (entry->frame == frame) {
+            return entry;
+        }
+        if (!entry->frame && !freeEntry) {
+            freeEntry = entry;
+        }
+    }
+    return create ? freeEntry : NULL;
+}
+
+void FrameStatistics::frameEntered(void *frame, int id, int64_t targetTimeUs)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    ++mDisplayCnt;
+    //a buffer address reused by a new frame replaces the old entry
+    FrameEntry *entry = findFrame(frame, id, true);
+    if (!entry) {
+        //more frames in flight than tracked, it only misses latency
+        return;
+    }
+    if (!entry->frame) {
+        entry->frame = frame;
+        ++mInFlightCnt;
+    }
+    entry->enterTimeUs = Tls::Times::getSystemTimeUs();
+    entry->targetTimeUs = targetTimeUs;
+    if (mInFlightCnt > mInFlightHighWater) {
+        mInFlightHighWater = mInFlightCnt;
+    }
+}
+
+void FrameStatistics::framePresented(void *frame, int id, int64_t presentTimeUs)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    ++mPresentedCnt;
+    if (presentTimeUs <= 0) {
+        return;
+    }
+    FrameEntry *entry = findFrame(frame, id, false);
+    if (!entry || entry->targetTimeUs <= 0) {
+        return;
+    }
+    int64_t errorUs = presentTimeUs - entry->targetTimeUs;
+    ++mPresentErrorHist[presentErrorBucket(errorUs)];
+    mPresentErrorSumUs += errorUs;
+    ++mPresentErrorCnt;
+}
+
+void FrameStatistics::frameDropped(int reason)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    ++mDroppedCnt;
+    if (reason >= 0 && reason < FRAME_STATS_MAX_DROP_REASON) {
+        ++mDropCnt[reason];
+    }
+}
+
+void FrameStatistics::frameReleased(void *frame, int id)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    FrameEntry *entry = findFrame(frame, id, false);
+    if (!entry) {
+        return;
+    }
+    int64_t latencyUs = Tls::Times::getSystemTimeUs() - entry->enterTimeUs;
+    entry->frame = NULL;
+    --mInFlightCnt;
+    mLatencies[mLatencyCnt % FRAME_STATS_LATENCY_WINDOW] = latencyUs;
+    ++mLatencyCnt;
+    if (latencyUs > mLatencyMaxUs) {
+        mLatencyMaxUs = latencyUs;
+    }
+}
+
+void FrameStatistics::queueDepth(int depth)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    if (depth > mQueueDepthHighWater) {
+        mQueueDepthHighWater = depth;
+    }
+}
+
+void FrameStatistics::scanoutState(int state, bool fallback)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    mScanoutState = state;
+    if (fallback) {
+        ++mScanoutFallbackCnt;
+    }
+}
+
+void FrameStatistics::frameScanout(bool direct)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    if (direct) {
+        ++mScanoutCnt;
+    } else {
+        ++mComposedCnt;
+    }
+}
+
+void FrameStatistics::reset()
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    mDisplayCnt = 0;
+    mPresentedCnt = 0;
+    mDroppedCnt = 0;
+    memset(mDropCnt, 0, sizeof(mDropCnt));
+    memset(mPresentErrorHist, 0, sizeof(mPresentErrorHist));
+    mPresentErrorSumUs = 0;
+    mPresentErrorCnt = 0;
+    mQueueDepthHighWater = 0;
+    mInFlightHighWater = mInFlightCnt;
+    mLatencyCnt = 0;
+    mLatencyMaxUs = 0;
+    mScanoutCnt = 0;
+    mComposedCnt = 0;
+    mScanoutFallbackCnt = 0;
+}
+
+int FrameStatistics::presentErrorBucket(int64_t errorUs)
+{
+    int i = 0;
+    while (i < FRAME_STATS_PRESENT_ERROR_BUCKET_CNT - 1 && errorUs >= sPresentErrorEdges[i]) {
+        ++i;
+    }
+    return i;
+}
+
+void FrameStatistics::snapshot(Snapshot *s)
+{
+    int64_t latencies[FRAME_STATS_LATENCY_WINDOW];
+    int cnt;
+    {
+        Tls::Mutex::Autolock _l(mMutex);
+        s->displayCnt = mDisplayCnt;
+        s->presentedCnt = mPresentedCnt;
+        s->droppedCnt = mDroppedCnt;
+        memcpy(s->dropCnt, mDropCnt, sizeof(mDropCnt));
+        memcpy(s->presentErrorHist, mPresentErrorHist, sizeof(mPresentErrorHist));
+        s->presentErrorAvgUs = mPresentErrorCnt > 0 ? mPresentErrorSumUs/mPresentErrorCnt : 0;
+        s->queueDepthHighWater = mQueueDepthHighWater;
+        s->inFlightHighWater = mInFlightHighWater;
+        s->releaseLatencyMaxUs = mLatencyMaxUs;
+        s->scanoutState = mScanoutState;
+        s->scanoutCnt = mScanoutCnt;
+        s->composedCnt = mComposedCnt;
+        s->scanoutFallbackCnt = mScanoutFallbackCnt;
+        cnt = mLatencyCnt < FRAME_STATS_LATENCY_WINDOW ? (int)mLatencyCnt : FRAME_STATS_LATENCY_WINDOW;
+        memcpy(latencies, mLatencies, cnt*sizeof(int64_t));
+    }
+
+    //sort out of lock, stats are read rarely
+    if (cnt == 0) {
+        s->releaseLatencyP50Us = 0;
+        s->releaseLatencyP90Us = 0;
+        s->releaseLatencyP99Us = 0;
+        return;
+    }
+    std::sort(latencies, latencies + cnt);
+    s->releaseLatencyP50Us = latencies[(cnt - 1)*50/100];
+    s->releaseLatencyP90Us = latencies[(cnt - 1)*90/100];
+    s->releaseLatencyP99Us = latencies[(cnt - 1)*99/100];
+}
+
+}
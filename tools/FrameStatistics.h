@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_FRAME_STATISTICS_H_
+#define _TOOLS_FRAME_STATISTICS_H_
+#include <stdint.h>
+#include "Mutex.h"
+
+namespace Tls {
+
+/**
+ * max drop reasons counted separately
+ */
+#define FRAME_STATS_MAX_DROP_REASON 16
+/**
+ * buckets of presentation error histogram, the bucket edges are
+ * -16,-8,-4,-2,0,2,4,8,16 ms, the first and last ones are open
+ */
+#define FRAME_STATS_PRESENT_ERROR_BUCKET_CNT 10
+/**
+ * latest release latencies kept to compute percentiles
+ */
+#define FRAME_STATS_LATENCY_WINDOW 512
+/**
+ * max frames tracked in flight, must be power of 2
+ */
+#define FRAME_STATS_MAX_IN_FLIGHT 64
+
+/**
+ * aggregated frame statistics of a plugin.
+ * a frame enters when it is passed to plugin, and leaves when it
+ * is released, between them it is presented or dropped.
+ * frames are keyed by their address, and are stored in a fixed
+ * table slot picked by the buffer id, so no heap is touched per frame.
+ * all methods are thread safe
+ */
+class FrameStatistics {
+  public:
+    FrameStatistics();
+    virtual ~FrameStatistics();
+    /**
+     * frame entered plugin, id is the buffer id of frame
+     * targetTimeUs - monotonic time the frame should be shown, <= 0 if unknown
+     */
+    void frameEntered(void *frame, int id, int64_t targetTimeUs);
+    /**
+     * frame was shown
+     * presentTimeUs - monotonic time the frame was shown, <= 0 if unknown
+     */
+    void framePresented(void *frame, int id, int64_t presentTimeUs);
+    /**
+     * a frame was dropped, reason is a caller defined index
+     * less than FRAME_STATS_MAX_DROP_REASON
+     */
+    void frameDropped(int reason);
+    /**
+     * frame was released and left plugin
+     */
+    void frameReleased(void *frame, int id);
+    /**
+     * report the frame count waiting to be posted
+     */
+    void queueDepth(int depth);
+    /**
+     * report how compositor shows frames, state is a caller defined
+     * value, 0 means unknown. fallback is true if compositor left
+     * the zero copy path for composition
+     */
+    void scanoutState(int state, bool fallback);
+    /**
+     * a frame was committed to compositor,
+     * direct is true if it is in direct scanout
+     */
+    void frameScanout(bool direct);
+    /**
+     * copy statistics to stats, T must have displayCnt,presentedCnt,
+     * droppedCnt,dropCnt[],presentErrorHist[],presentErrorAvgUs,
+     * queueDepthHighWater,inFlightHighWater,releaseLatencyP50Us,
+     * releaseLatencyP90Us,releaseLatencyP99Us,releaseLatencyMaxUs,
+     * scanoutState,scanoutCnt,composedCnt and scanoutFallbackCnt fields
+     */
+    template <typename T>
+    void getStatistics(T *stats) {
+        Snapshot s;
+        int cnt;
+        snapshot(&s);
+        stats->displayCnt = s.displayCnt;
+        stats->presentedCnt = s.presentedCnt;
+        stats->droppedCnt = s.droppedCnt;
+        cnt = sizeof(stats->dropCnt)/sizeof(stats->dropCnt[0]);
+        for (int i = 0; i < cnt; i++) {
+            stats->dropCnt[i] = i < FRAME_STATS_MAX_DROP_REASON ? s.dropCnt[i] : 0;
+        }
+        cnt = sizeof(stats->presentErrorHist)/sizeof(stats->presentErrorHist[0]);
+        for (int i = 0; i < cnt; i++) {
+            stats->presentErrorHist[i] = i < FRAME_STATS_PRESENT_ERROR_BUCKET_CNT ? s.presentErrorHist[i] : 0;
+        }
+        stats->presentErrorAvgUs = s.presentErrorAvgUs;
+        stats->queueDepthHighWater = s.queueDepthHighWater;
+        stats->inFlightHighWater = s.inFlightHighWater;
+        stats->releaseLatencyP50Us = s.releaseLatencyP50Us;
+        stats->releaseLatencyP90Us = s.releaseLatencyP90Us;
+        stats->releaseLatencyP99Us = s.releaseLatencyP99Us;
+        stats->releaseLatencyMaxUs = s.releaseLatencyMaxUs;
+        stats->scanoutState = s.scanoutState;
+        stats->scanoutCnt = s.scanoutCnt;
+        stats->composedCnt = s.composedCnt;
+        stats->scanoutFallbackCnt = s.scanoutFallbackCnt;
+    };
+    /**
+     * clear counters, frames in flight are kept
+     */
+    void reset();
+  private:
+    typedef struct {
+        void *frame; //NULL if slot is free
+        int64_t enterTimeUs;
+        int64_t targetTimeUs;
+    } FrameEntry;
+    typedef struct {
+        int64_t displayCnt;
+        int64_t presentedCnt;
+        int64_t droppedCnt;
+        int64_t dropCnt[FRAME_STATS_MAX_DROP_REASON];
+        int64_t presentErrorHist[FRAME_STATS_PRESENT_ERROR_BUCKET_CNT];
+        int64_t presentErrorAvgUs;
+        int queueDepthHighWater;
+        int inFlightHighWater;
+        int64_t releaseLatencyP50Us;
+        int64_t releaseLatencyP90Us;
+        int64_t releaseLatencyP99Us;
+        int64_t releaseLatencyMaxUs;
+        int scanoutState;
+        int64_t scanoutCnt;
+        int64_t composedCnt;
+        int64_t scanoutFallbackCnt;
+    } Snapshot;
+    void snapshot(Snapshot *s);
+    int presentErrorBucket(int64_t errorUs);
+    //slot of frame, or a free slot if frame is not in table and create is true
+    FrameEntry *findFrame(void *frame, int id, bool create);
+
+    Tls::Mutex mMutex;
+    FrameEntry mFrames[FRAME_STATS_MAX_IN_FLIGHT];
+    int mInFlightCnt;
+    int64_t mDisplayCnt;
+    int64_t mPresentedCnt;
+    int64_t mDroppedCnt;
+    int64_t mDropCnt[FRAME_STATS_MAX_DROP_REASON];
+    int64_t mPresentErrorHist[FRAME_STATS_PRESENT_ERROR_BUCKET_CNT];
+    int64_t mPresentErrorSumUs;
+    int64_t mPresentErrorCnt;
+    int mQueueDepthHighWater;
+    int mInFlightHighWater;
+    //ring of latest release latencies
+    int64_t mLatencies[FRAME_STATS_LATENCY_WINDOW];
+    uint64_t mLatencyCnt;
+    int64_t mLatencyMaxUs;
+    int mScanoutState;
+    int64_t mScanoutCnt;
+    int64_t mComposedCnt;
+    int64_t mScanoutFallbackCnt;
+};
+
+}
+
+#endif /*_TOOLS_FRAME_STATISTICS_H_*/
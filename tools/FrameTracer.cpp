@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include "FrameTracer.h"
+#include "Times.h"
+
+namespace Tls {
+
+FrameTracer::FrameTracer(uint32_t capacity, const char *(*stageName)(int stage), int stageCnt)
+{
+    uint32_t size = 2;
+    while (size < capacity && size < (1u << 20)) {
+        size <<= 1;
+    }
+    mSlots = new (std::nothrow) Slot[size];
+    mMask = mSlots ? size - 1 : 0;
+    for (uint32_t i = 0; mSlots && i < size; i++) {
+        mSlots[i].seq.store(0, std::memory_order_relaxed);
+    }
+    mWriteIndex.store(0, std::memory_order_relaxed);
+    mResetIndex.store(0, std::memory_order_relaxed);
+    mStageName = stageName;
+    mStageCnt = stageCnt;
+}
+
+FrameTracer::~FrameTracer()
+{
+    if (mSlots) {
+        delete [] mSlots;
+        mSlots = NULL;
+    }
+}
+
+void FrameTracer::record(int64_t pts, int bufferId, int stage, int64_t timeUs)
+{
+    if (!mSlots) {
+        return;
+    }
+    uint64_t index = mWriteIndex.fetch_add(1, std::memory_order_relaxed);
+    Slot *slot = &mSlots[index & mMask];
+
+    slot->seq.store(2*index + 1, std::memory_order_relaxed);
+    //readers must see the odd seq before any field changes
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->pts.store(pts, std::memory_order_relaxed);
+    slot->time.store(timeUs, std::memory_order_relaxed);
+    slot->bufferId.store(bufferId, std::memory_order_relaxed);
+    slot->stage.store(stage, std::memory_order_relaxed);
+    slot->seq.store(2*index + 2, std::memory_order_release);
+}
+
+void FrameTracer::record(int64_t pts, int bufferId, int stage)
+{
+    record(pts, bufferId, stage, Tls::Times::getSystemTimeUs());
+}
+
+bool FrameTracer::readSlot(uint64_t index, int64_t *pts, int *bufferId, int *stage, int64_t *time)
+{
+    Slot *slot = &mSlots[index & mMask];
+    uint64_t seq = slot->seq.load(std::memory_order_acquire);
+
+    //being written, or overwritten by a newer event
+    if (seq != 2*index + 2) {
+        return false;
+    }
+    *pts = slot->pts.load(std::memory_order_relaxed);
+    *time = slot->time.load(std::memory_order_relaxed);
+    *bufferId = slot->bufferId.load(std::memory_order_relaxed);
+    *stage = slot->stage.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->seq.load(std::memory_order_relaxed) == seq;
+}
+
+bool FrameTracer::dump(const char *path, int instanceId)
+{
+    int cnt;
+    bool first = true;
+    FILE *file;
+    FrameTraceEvent *events;
+
+    if (!mSlots || !path) {
+        return false;
+    }
+    events = (FrameTraceEvent *)malloc((mMask + 1) * sizeof(FrameTraceEvent));
+    if (!events) {
+        return false;
+    }
+    cnt = getEvents(events, mMask + 1);
+
+    file = fopen(path, "w");
+    if (!file) {
+        free(events);
+        return false;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    //every stage is a track
+    for (int i = 0; i < mStageCnt; i++) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", instanceId, i, mStageName(i));
+        first = false;
+    }
+    for (int i = 0; i < cnt; i++) {
+        const char *name = mStageName(events[i].stage);
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"pts\":%lld,\"id\":%d}}",
+            first ? "" : ",\n", name, (long long)events[i].time, instanceId, events[i].stage,
+            (long long)events[i].pts, events[i].bufferId);
+        first = false;
+        //frame life span, from the first stage to the last one
+        if (events[i].stage == 0 || events[i].stage == mStageCnt - 1) {
+            fprintf(file, ",\n{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"%s\",\"id\":\"%lld\",\"ts\":%lld,\"pid\":%d,\"tid\":0}",
+                events[i].stage == 0 ? "b" : "e", (long long)events[i].pts, (long long)events[i].time, instanceId);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    free(events);
+    return true;
+}
+
+void FrameTracer::reset()
+{
+    mResetIndex.store(mWriteIndex.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+}
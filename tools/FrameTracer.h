@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_FRAME_TRACER_H_
+#define _TOOLS_FRAME_TRACER_H_
+#include <stdint.h>
+#include <atomic>
+
+namespace Tls {
+
+/**
+ * default event count kept by a frame tracer, rounded up to power of 2
+ */
+#define FRAME_TRACER_DEFAULT_CAPACITY 1024
+
+/**
+ * a stage event of a frame
+ */
+typedef struct {
+    int64_t pts; //frame pts
+    int bufferId;
+    int stage;
+    int64_t time; //monotonic time, us
+} FrameTraceEvent;
+
+/**
+ * lock free ring of frame stage events.
+ * any thread may record an event, the oldest ones are overwritten.
+ * every slot is a seqlock, readers skip slots being written,
+ * so recording never waits for a reader.
+ * stage 0 starts a frame and the last stage ends it in the dumped trace
+ */
+class FrameTracer {
+  public:
+    /**
+     * capacity - max events kept
+     * stageName - get name of a stage, used by dump
+     * stageCnt - count of stages
+     */
+    FrameTracer(uint32_t capacity, const char *(*stageName)(int stage), int stageCnt);
+    virtual ~FrameTracer();
+    /**
+     * record a stage of frame, timeUs is monotonic time in us
+     */
+    void record(int64_t pts, int bufferId, int stage, int64_t timeUs);
+    /**
+     * record a stage of frame at current time
+     */
+    void record(int64_t pts, int bufferId, int stage);
+    /**
+     * copy latest events, oldest first, T must have pts,
+     * bufferId,stage and time fields
+     *
+     * returns the count of events copied
+     */
+    template <typename T>
+    int getEvents(T *events, int capacity) {
+        int cnt = 0;
+        uint64_t end = mWriteIndex.load(std::memory_order_acquire);
+        uint64_t start = end > mMask + 1 ? end - (mMask + 1) : 0;
+        if (start < mResetIndex.load(std::memory_order_acquire)) {
+            start = mResetIndex.load(std::memory_order_acquire);
+        }
+        if (end - start > (uint64_t)capacity) {
+            start = end - capacity;
+        }
+        for (uint64_t i = start; i < end; i++) {
+            int64_t pts, time;
+            int bufferId, stage;
+            if (readSlot(i, &pts, &bufferId, &stage, &time)) {
+                events[cnt].pts = pts;
+                events[cnt].bufferId = bufferId;
+                events[cnt].stage = stage;
+                events[cnt].time = time;
+                ++cnt;
+            }
+        }
+        return cnt;
+    };
+    /**
+     * dump kept events to file in chrome trace json format,
+     * it can be opened by chrome://tracing or perfetto ui
+     *
+     * instanceId - plugin instance id shown as trace pid, plugins of
+     * one process share the process id, so it tells them apart
+     * returns true if written
+     */
+    bool dump(const char *path, int instanceId);
+    /**
+     * forget all events
+     */
+    void reset();
+  private:
+    typedef struct {
+        //2*index+1 when slot is being written,2*index+2 when written
+        std::atomic<uint64_t> seq;
+        std::atomic<int64_t> pts;
+        std::atomic<int64_t> time;
+        std::atomic<int> bufferId;
+        std::atomic<int> stage;
+    } Slot;
+    bool readSlot(uint64_t index, int64_t *pts, int *bufferId, int *stage, int64_t *time);
+
+    Slot *mSlots;
+    uint32_t mMask;
+    std::atomic<uint64_t> mWriteIndex;
+    //events before it were reset
+    std::atomic<uint64_t> mResetIndex;
+    const char *(*mStageName)(int stage);
+    int mStageCnt;
+};
+
+}
+
+#endif /*_TOOLS_FRAME_TRACER_H_*/
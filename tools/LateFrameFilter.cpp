@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "LateFrameFilter.h"
+
+namespace Tls {
+
+/*frame durations longer than it are stream gaps, e.g. after seek*/
+#define LATE_FRAME_MAX_DURATION_US 1000000
+
+LateFrameFilter::LateFrameFilter(VsyncClock *vsyncClock)
+{
+    mVsyncClock = vsyncClock;
+    mLastFrameTimeUs = 0;
+    mFrameDurationUs = 0;
+    mContinuousDropCnt = 0;
+    mResetPending = false;
+    mDropCnt = 0;
+}
+
+LateFrameFilter::~LateFrameFilter()
+{
+}
+
+bool LateFrameFilter::isHopeless(int64_t frameTimeUs, int64_t presentTimeUs)
+{
+    int64_t lateCnt;
+    int64_t frameDurationUs;
+
+    //history is only touched by this thread
+    if (mResetPending.exchange(false)) {
+        mLastFrameTimeUs = 0;
+        mFrameDurationUs = 0;
+        mContinuousDropCnt = 0;
+    }
+    frameDurationUs = mFrameDurationUs;
+
+    //no display time, frame is shown asap
+    if (!mVsyncClock || frameTimeUs <= 0) {
+        return false;
+    }
+
+    if (mLastFrameTimeUs > 0 && frameTimeUs > mLastFrameTimeUs &&
+        frameTimeUs - mLastFrameTimeUs < LATE_FRAME_MAX_DURATION_US) {
+        mFrameDurationUs = frameTimeUs - mLastFrameTimeUs;
+        frameDurationUs = mFrameDurationUs;
+    }
+    mLastFrameTimeUs = frameTimeUs;
+
+    lateCnt = mVsyncClock->getLateVsyncCnt(frameTimeUs, presentTimeUs);
+    if (lateCnt < LATE_FRAME_DROP_VSYNC_CNT) {
+        mContinuousDropCnt = 0;
+        return false;
+    }
+    //the next frame would not be due yet, this one is the best to show
+    if (frameDurationUs <= 0 || lateCnt * mVsyncClock->getPeriodUs() < frameDurationUs) {
+        mContinuousDropCnt = 0;
+        return false;
+    }
+    if (mContinuousDropCnt >= LATE_FRAME_MAX_CONTINUOUS_DROP) {
+        mContinuousDropCnt = 0;
+        return false;
+    }
+    ++mContinuousDropCnt;
+    ++mDropCnt;
+    return true;
+}
+
+void LateFrameFilter::reset()
+{
+    mResetPending = true;
+}
+
+int64_t LateFrameFilter::getDropCnt()
+{
+    return mDropCnt;
+}
+
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_LATE_FRAME_FILTER_H_
+#define _TOOLS_LATE_FRAME_FILTER_H_
+#include <stdint.h>
+#include <atomic>
+#include "VsyncClock.h"
+
+namespace Tls {
+
+/**
+ * a frame is hopeless if it is late by this many vsyncs
+ * at the earliest vsync it can be shown
+ */
+#define LATE_FRAME_DROP_VSYNC_CNT 2
+/**
+ * max frames dropped in a row, a stream that is always late
+ * still shows some frames instead of freezing
+ */
+#define LATE_FRAME_MAX_CONTINUOUS_DROP 8
+
+/**
+ * decides at queue time if a frame is so late that the post
+ * thread would drop it anyway, so the caller can drop it before
+ * importing and queueing it.
+ * a frame is hopeless only if the frame after it is due at the
+ * same vsync too, a lone late frame is still shown.
+ * isHopeless is called by the thread calling displayFrame only,
+ * reset and getDropCnt can be called from any thread
+ */
+class LateFrameFilter {
+  public:
+    LateFrameFilter(VsyncClock *vsyncClock);
+    virtual ~LateFrameFilter();
+    /**
+     * check frame with display time frameTimeUs, if it is posted
+     * now, the earliest vsync it shows at is the first one after presentTimeUs
+     *
+     * returns true if the frame should be dropped
+     */
+    bool isHopeless(int64_t frameTimeUs, int64_t presentTimeUs);
+    /**
+     * forget the frame history, e.g. after flush,
+     * it is done by the next isHopeless call
+     */
+    void reset();
+    /**
+     * count of frames reported hopeless
+     */
+    int64_t getDropCnt();
+  private:
+    VsyncClock *mVsyncClock;
+    int64_t mLastFrameTimeUs;
+    int64_t mFrameDurationUs;
+    int mContinuousDropCnt;
+    std::atomic<bool> mResetPending;
+    std::atomic<int64_t> mDropCnt;
+};
+
+}
+
+#endif /*_TOOLS_LATE_FRAME_FILTER_H_*/
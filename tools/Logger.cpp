@@ -25,8 +25,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <new>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
 #include <cutils/log.h>
 #include "Logger.h"
 
@@ -35,12 +39,54 @@
 #define MAX_FILENAME_LENGTH 128
 #define MAX_LOG_BUFFER 1024
 
+//log records kept per thread for async print
+#define ASYNC_LOG_RING_SLOTS 128
+#define ASYNC_LOG_RECORD_SIZE MAX_LOG_BUFFER
+#define ASYNC_LOG_DRAIN_INTERVAL_MS 10
+
 static long long getCurrentTimeMillis(void);
 typedef struct {
     char tag[MAX_TAG_LENGTH]; //user print tag
+    int id; //plugin instance id
     bool active;
 } UserTag;
 
+/*single producer single consumer ring of formatted logs,
+ the owner thread writes and the drain thread reads*/
+typedef struct _LogRing {
+    char records[ASYNC_LOG_RING_SLOTS][ASYNC_LOG_RECORD_SIZE];
+    long long times[ASYNC_LOG_RING_SLOTS]; //monotonic us of records,orders threads
+    std::atomic<uint32_t> head; //next record to drain
+    std::atomic<uint32_t> tail; //next record to write
+    std::atomic<uint32_t> lostCnt; //records lost when ring is full
+    std::atomic<bool> exited; //owner thread exited
+    //snapshot of readable records,only used by drain with g_asyncMutex held
+    uint32_t drainHead;
+    uint32_t drainTail;
+    bool drainExited;
+    struct _LogRing *next;
+} LogRing;
+
+//marks the ring of a thread exited when the thread exits
+class LogRingHolder {
+  public:
+    LogRingHolder() : ring(NULL), destroyed(false) {};
+    ~LogRingHolder() {
+        if (ring) {
+            ring->exited.store(true, std::memory_order_release);
+            ring = NULL;
+        }
+        //logs from later thread local destructors are printed sync
+        destroyed = true;
+    };
+    LogRing *ring;
+    bool destroyed;
+};
+
+static void startAsyncLog();
+static void stopAsyncLog();
+static bool asyncLogPrint(int category, int level, const char *fmt, va_list args);
+
 static int g_activeLevel= 2;
 static FILE * g_fd = stderr;
 static char g_fileName[MAX_FILENAME_LENGTH];
@@ -49,6 +95,23 @@ static int g_activeUserTag = 0;
 static std::mutex g_mutext;
 static int g_init = 0;
 
+static std::atomic<bool> g_async(false);
+static thread_local LogRingHolder t_logRing;
+//guards ring list and log file when async
+static std::mutex g_asyncMutex;
+static LogRing *g_logRings = NULL;
+static std::mutex g_drainMutex;
+static std::condition_variable g_drainCond;
+static std::thread g_drainThread;
+static bool g_drainStop = false;
+
+//stop drain thread before globals are destroyed at exit
+static struct AsyncLogGuard {
+    ~AsyncLogGuard() {
+        stopAsyncLog();
+    };
+} g_asyncLogGuard;
+
 int Logger_init(int id)
 {
     int category = NO_CAT;
@@ -60,6 +123,10 @@ int Logger_init(int id)
         for (int i = 0; i < MAX_USER_TAG; i++) {
             g_userTag[i].active = false;
         }
+        char *env = getenv("VIDEO_RENDER_PLUGIN_LOG_ASYNC");
+        if (env && atoi(env) > 0) {
+            startAsyncLog();
+        }
     }
     for (int i = 0; i < MAX_USER_TAG; i++) {
         if (g_userTag[i].active == false) {
@@ -67,6 +134,7 @@ int Logger_init(int id)
             category = i;
             memset(g_userTag[i].tag, 0, MAX_TAG_LENGTH);
             sprintf(g_userTag[i].tag,"%s-%d","rlib",id);
+            g_userTag[i].id = id;
             ++g_activeUserTag;
             break;
         }
@@ -85,6 +153,17 @@ void Logger_exit(int category)
     g_mutext.unlock();
 }
 
+int Logger_get_id(int category)
+{
+    int id = -1;
+    g_mutext.lock();
+    if (category >= 0 && category < MAX_USER_TAG && g_userTag[category].active) {
+        id = g_userTag[category].id;
+    }
+    g_mutext.unlock();
+    return id;
+}
+
 void Logger_set_level(int setLevel)
 {
     if (setLevel <=0) {
@@ -104,6 +183,7 @@ int Logger_get_level()
 void Logger_set_file(char *filepath)
 {
     FILE * logFd;
+    std::lock_guard<std::mutex> lck(g_asyncMutex);
     if (!filepath) {
         if (g_fd != stderr) {
             fclose(g_fd);
@@ -151,10 +231,28 @@ char *logLevelToString(int level) {
     return (char *) " U ";
 }
 
+void Logger_set_async(int async)
+{
+    if (async > 0) {
+        startAsyncLog();
+    } else {
+        stopAsyncLog();
+    }
+}
+
 void logPrint(int category ,int level, const char *fmt, ... )
 {
     if ( level <= g_activeLevel )
     {
+        if (g_async.load(std::memory_order_relaxed)) {
+            va_list argptr;
+            va_start( argptr, fmt );
+            bool queued = asyncLogPrint(category, level, fmt, argptr);
+            va_end( argptr );
+            if (queued) {
+                return;
+            }
+        }
         if (g_fd == stderr) { //default output log to logcat
             va_list argptr;
             char buf[MAX_LOG_BUFFER];
@@ -208,4 +306,158 @@ static long long getCurrentTimeMillis(void)
     clock_gettime(clocks[1], &t);
     int64_t mono_ns = int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
     return mono_ns/1000LL;
-}
\ No newline at end of file
+}
+static LogRing *getThreadLogRing()
+{
+    if (t_logRing.ring || t_logRing.destroyed) {
+        return t_logRing.ring;
+    }
+    LogRing *ring = new (std::nothrow) LogRing;
+    if (!ring) {
+        return NULL;
+    }
+    ring->head.store(0);
+    ring->tail.store(0);
+    ring->lostCnt.store(0);
+    ring->exited.store(false);
+    //once per thread, the only lock on log path
+    std::lock_guard<std::mutex> lck(g_asyncMutex);
+    ring->next = g_logRings;
+    g_logRings = ring;
+    t_logRing.ring = ring;
+    return ring;
+}
+
+static bool asyncLogPrint(int category, int level, const char *fmt, va_list args)
+{
+    LogRing *ring = getThreadLogRing();
+    if (!ring) {
+        return false;
+    }
+
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    if (tail - ring->head.load(std::memory_order_acquire) >= ASYNC_LOG_RING_SLOTS) {
+        //never wait for drain thread
+        ring->lostCnt.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    char *buf = ring->records[tail % ASYNC_LOG_RING_SLOTS];
+    long long now = getCurrentTimeMillis();
+    ring->times[tail % ASYNC_LOG_RING_SLOTS] = now;
+    int len = snprintf(buf, ASYNC_LOG_RECORD_SIZE, "%lld ", now);
+    if (g_activeUserTag && category >= 0 && category < MAX_USER_TAG && g_userTag[category].active) {
+        len += snprintf(buf+len, ASYNC_LOG_RECORD_SIZE-len, "%s ", g_userTag[category].tag);
+    } else if (g_fd != stderr) {
+        len += snprintf(buf+len, ASYNC_LOG_RECORD_SIZE-len, "%d:%lu ", getpid(),pthread_self());
+    }
+    if (g_fd != stderr) {
+        len += snprintf(buf+len, ASYNC_LOG_RECORD_SIZE-len, "%s ",logLevelToString(level));
+    }
+    if (len < ASYNC_LOG_RECORD_SIZE) {
+        vsnprintf(buf+len, ASYNC_LOG_RECORD_SIZE-len, fmt, args);
+    }
+    ring->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+static void writeLogRecord(const char *record)
+{
+    if (g_fd == stderr) {
+        ALOGI("%s", record);
+    } else {
+        fputs(record, g_fd);
+    }
+}
+
+/*write out all queued records in time order across threads,
+ return true if any was written*/
+static bool drainLogRings()
+{
+    bool written = false;
+    char lost[64];
+    std::lock_guard<std::mutex> lck(g_asyncMutex);
+    for (LogRing *ring = g_logRings; ring; ring = ring->next) {
+        //read exited before records, so the last records are not missed
+        ring->drainExited = ring->exited.load(std::memory_order_acquire);
+        ring->drainHead = ring->head.load(std::memory_order_relaxed);
+        ring->drainTail = ring->tail.load(std::memory_order_acquire);
+    }
+    //merge rings, every ring is already in time order
+    while (true) {
+        LogRing *oldest = NULL;
+        for (LogRing *ring = g_logRings; ring; ring = ring->next) {
+            if (ring->drainHead != ring->drainTail && (!oldest ||
+                ring->times[ring->drainHead % ASYNC_LOG_RING_SLOTS] <
+                oldest->times[oldest->drainHead % ASYNC_LOG_RING_SLOTS])) {
+                oldest = ring;
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+        writeLogRecord(oldest->records[oldest->drainHead % ASYNC_LOG_RING_SLOTS]);
+        oldest->drainHead++;
+        written = true;
+    }
+    LogRing **link = &g_logRings;
+    while (*link) {
+        LogRing *ring = *link;
+        bool exited = ring->drainExited;
+        ring->head.store(ring->drainHead, std::memory_order_release);
+        uint32_t lostCnt = ring->lostCnt.exchange(0, std::memory_order_relaxed);
+        if (lostCnt > 0) {
+            snprintf(lost, sizeof(lost), "%lld async log lost %u records\n", getCurrentTimeMillis(), lostCnt);
+            writeLogRecord(lost);
+            written = true;
+        }
+        if (exited) {
+            *link = ring->next;
+            delete ring;
+        } else {
+            link = &ring->next;
+        }
+    }
+    if (written && g_fd != stderr) {
+        fflush(g_fd);
+    }
+    return written;
+}
+
+static void drainLoop()
+{
+    std::unique_lock<std::mutex> lck(g_drainMutex);
+    while (!g_drainStop) {
+        lck.unlock();
+        drainLogRings();
+        lck.lock();
+        g_drainCond.wait_for(lck, std::chrono::milliseconds(ASYNC_LOG_DRAIN_INTERVAL_MS));
+    }
+}
+
+static void startAsyncLog()
+{
+    std::lock_guard<std::mutex> lck(g_drainMutex);
+    if (g_drainThread.joinable()) {
+        return;
+    }
+    g_drainStop = false;
+    g_drainThread = std::thread(drainLoop);
+    g_async.store(true, std::memory_order_release);
+}
+
+static void stopAsyncLog()
+{
+    {
+        std::lock_guard<std::mutex> lck(g_drainMutex);
+        if (!g_drainThread.joinable()) {
+            return;
+        }
+        g_async.store(false, std::memory_order_release);
+        g_drainStop = true;
+        g_drainCond.notify_one();
+    }
+    g_drainThread.join();
+    //write out logs queued before async stopped
+    drainLogRings();
+}
@@ -25,6 +25,15 @@
 
 #define NO_CAT -1
 
+/**
+ * the least severe level compiled in, logs above it are removed
+ * at build time and their arguments are never evaluated,
+ * e.g. -DLOG_MIN_LEVEL=2 keeps ERROR,WARNING and INFO only
+ */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#endif
+
 /**
  * @brief init logger print
  * @param id plugin instance id
@@ -41,6 +50,14 @@ int Logger_init(int id);
  */
 void Logger_exit(int category);
 
+/**
+ * @brief get plugin instance id of category
+ * @param category category id
+ *
+ * @return the id passed to Logger_init, -1 if category is invalid
+ */
+int Logger_get_id(int category);
+
 void logPrint(int category, int level, const char *fmt, ... );
 
 /**
@@ -70,11 +87,33 @@ int Logger_get_level();
  */
 void Logger_set_file(char *filepath);
 
-#define INT_ERROR(CAT,FORMAT, ...)      logPrint(CAT,LOG_LEVEL_ERROR,  "%s,%s:%d " FORMAT "\n",TAG,__func__, __LINE__, __VA_ARGS__)
-#define INT_WARNING(CAT,FORMAT, ...)    logPrint(CAT,LOG_LEVEL_WARNING,"%s,%s:%d " FORMAT "\n",TAG,__func__, __LINE__, __VA_ARGS__)
-#define INT_INFO(CAT,FORMAT, ...)       logPrint(CAT,LOG_LEVEL_INFO,   "%s,%s:%d " FORMAT "\n",TAG,__func__, __LINE__, __VA_ARGS__)
-#define INT_DEBUG(CAT,FORMAT, ...)      logPrint(CAT,LOG_LEVEL_DEBUG,  "%s,%s:%d " FORMAT "\n",TAG,__func__, __LINE__, __VA_ARGS__)
-#define INT_TRACE(CAT,FORMAT, ...)      logPrint(CAT,LOG_LEVEL_TRACE, "%s,%s:%d " FORMAT "\n",TAG,__func__, __LINE__, __VA_ARGS__)
+/**
+ * @brief print logs asynchronously or not
+ * async logs are formatted into a lock free ring owned by the
+ * calling thread and written out by a background thread,so
+ * logging never blocks on logcat or file io.a log is lost when
+ * the ring of its thread is full,lost logs are counted and reported.
+ * a log is truncated at 1 KB as sync logs are.logs queued by all
+ * threads before a drain are written in time order,a log queued
+ * just after a drain may come out behind a later one of another
+ * thread that made it into the drain.
+ * it is also turned on by env VIDEO_RENDER_PLUGIN_LOG_ASYNC=1
+ * @param async 1 async, 0 sync that is the default
+ */
+void Logger_set_async(int async);
+
+#define LOG_PRINT(CAT,LEVEL,FORMAT, ...) \
+    do { \
+        if ((LEVEL) <= LOG_MIN_LEVEL && (LEVEL) <= Logger_get_level()) { \
+            logPrint(CAT,LEVEL,"%s,%s:%d " FORMAT "\n",TAG,__func__, __LINE__, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define INT_ERROR(CAT,FORMAT, ...)      LOG_PRINT(CAT,LOG_LEVEL_ERROR,  FORMAT, __VA_ARGS__)
+#define INT_WARNING(CAT,FORMAT, ...)    LOG_PRINT(CAT,LOG_LEVEL_WARNING,FORMAT, __VA_ARGS__)
+#define INT_INFO(CAT,FORMAT, ...)       LOG_PRINT(CAT,LOG_LEVEL_INFO,   FORMAT, __VA_ARGS__)
+#define INT_DEBUG(CAT,FORMAT, ...)      LOG_PRINT(CAT,LOG_LEVEL_DEBUG,  FORMAT, __VA_ARGS__)
+#define INT_TRACE(CAT,FORMAT, ...)      LOG_PRINT(CAT,LOG_LEVEL_TRACE,  FORMAT, __VA_ARGS__)
 
 #define ERROR(CAT,...)                  INT_ERROR(CAT,__VA_ARGS__, "")
 #define WARNING(CAT,...)                INT_WARNING(CAT,__VA_ARGS__, "")
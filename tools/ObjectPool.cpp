@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "ObjectPool.h"
+
+namespace Tls {
+
+ObjectPool::ObjectPool(uint32_t objectSize, uint32_t objectCnt)
+{
+    //free list link is stored in the object, keep objects pointer aligned
+    if (objectSize < sizeof(void *)) {
+        objectSize = sizeof(void *);
+    }
+    mObjectSize = (objectSize + sizeof(void *) - 1) & ~(uint32_t)(sizeof(void *) - 1);
+    mObjectCnt = objectCnt;
+    mFreeList = NULL;
+    mInUseCnt = 0;
+    mHighWaterMark = 0;
+    mExhaustedCnt = 0;
+
+    mSlab = (char *)malloc((size_t)mObjectSize * mObjectCnt);
+    if (!mSlab) {
+        //every alloc falls back to heap
+        mObjectCnt = 0;
+        return;
+    }
+    //link objects in address order
+    for (uint32_t i = mObjectCnt; i > 0; i--) {
+        void *obj = mSlab + (size_t)mObjectSize * (i - 1);
+        *(void **)obj = mFreeList;
+        mFreeList = obj;
+    }
+}
+
+ObjectPool::~ObjectPool()
+{
+    if (mSlab) {
+        free(mSlab);
+        mSlab = NULL;
+    }
+    mFreeList = NULL;
+}
+
+void *ObjectPool::alloc()
+{
+    void *obj = NULL;
+
+    {
+        Tls::Mutex::Autolock _l(mMutex);
+        mInUseCnt++;
+        if (mInUseCnt > mHighWaterMark) {
+            mHighWaterMark = mInUseCnt;
+        }
+        if (mFreeList) {
+            obj = mFreeList;
+            mFreeList = *(void **)obj;
+        } else {
+            mExhaustedCnt++;
+        }
+    }
+
+    if (obj) {
+        memset(obj, 0, mObjectSize);
+        return obj;
+    }
+
+    obj = calloc(1, mObjectSize);
+    if (!obj) {
+        Tls::Mutex::Autolock _l(mMutex);
+        mInUseCnt--;
+    }
+    return obj;
+}
+
+void ObjectPool::release(void *obj)
+{
+    if (!obj) {
+        return;
+    }
+
+    Tls::Mutex::Autolock _l(mMutex);
+    mInUseCnt--;
+    if (isPoolObject(obj)) {
+        *(void **)obj = mFreeList;
+        mFreeList = obj;
+    } else {
+        free(obj);
+    }
+}
+
+uint32_t ObjectPool::getInUseCnt()
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    return mInUseCnt;
+}
+
+uint32_t ObjectPool::getHighWaterMark()
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    return mHighWaterMark;
+}
+
+uint32_t ObjectPool::getExhaustedCnt()
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    return mExhaustedCnt;
+}
+
+void ObjectPool::resetStats()
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    mHighWaterMark = mInUseCnt;
+    mExhaustedCnt = 0;
+}
+
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_OBJECT_POOL_H_
+#define _TOOLS_OBJECT_POOL_H_
+#include <stdint.h>
+#include "Mutex.h"
+
+namespace Tls {
+
+/**
+ * thread safe pool of fixed size objects, all objects are
+ * preallocated in one slab and kept in a free list, so that
+ * per frame bookkeeping does not touch the heap. objects can be
+ * allocated and released from different threads.
+ * when the pool is exhausted, alloc falls back to heap and
+ * the exhaustion is counted, release handles both cases
+ */
+class ObjectPool {
+  public:
+    /**
+     * objectSize - size of one object in bytes
+     * objectCnt - object count preallocated, should be the
+     *             max count of objects in flight
+     */
+    ObjectPool(uint32_t objectSize, uint32_t objectCnt);
+    virtual ~ObjectPool();
+    /**
+     * get a zeroed object from the pool
+     *
+     * returns the object, NULL if out of memory
+     */
+    void *alloc();
+    /**
+     * give the object back to the pool, obj must be allocated
+     * from this pool
+     */
+    void release(void *obj);
+    /**
+     * object count in use now
+     */
+    uint32_t getInUseCnt();
+    /**
+     * max object count in use at the same time
+     */
+    uint32_t getHighWaterMark();
+    /**
+     * times that pool is exhausted and alloc falls back to heap
+     */
+    uint32_t getExhaustedCnt();
+    uint32_t getCapacity() {
+        return mObjectCnt;
+    };
+    /**
+     * reset high water mark and exhausted count
+     */
+    void resetStats();
+  private:
+    bool isPoolObject(void *obj) {
+        return (char *)obj >= mSlab && (char *)obj < mSlab + (uint64_t)mObjectSize * mObjectCnt;
+    };
+
+    mutable Tls::Mutex mMutex;
+    char *mSlab;
+    uint32_t mObjectSize;
+    uint32_t mObjectCnt;
+    void *mFreeList; //first word of a free object links to next free object
+    uint32_t mInUseCnt;
+    uint32_t mHighWaterMark;
+    uint32_t mExhaustedCnt;
+};
+
+}
+
+#endif /*_TOOLS_OBJECT_POOL_H_*/
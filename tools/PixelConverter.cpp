@@ -0,0 +1,470 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+#include "PixelConverter.h"
+#include "ErrorCode.h"
+#include "Utils.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXEL_SIMD_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXEL_SIMD_SSE2 1
+#endif
+
+namespace Tls {
+
+//pixels converted per pass of the packed to planar split,
+//keeps the temporary rows on stack
+#define PIXEL_CHUNK_WIDTH 256
+
+/*yuv to rgb coefficients in 6 bit fixed point,every intermediate
+ value fits int16 so simd kernels work on 8 lanes, sums saturate
+ only when the result is clamped to 0 or 255 anyway*/
+typedef struct {
+    int16_t yg;
+    int16_t vr;
+    int16_t ug;
+    int16_t vg;
+    int16_t ub;
+} YuvCoeff;
+
+static const YuvCoeff kBt601Coeff = {75, 102, 25, 52, 129};
+static const YuvCoeff kBt709Coeff = {75, 115, 14, 34, 135};
+
+static bool gSimdEnabled = true;
+
+static inline uint8_t clampU8(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static void yuvRowToBgrxC(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                          uint8_t *dst, int x, int width, const YuvCoeff *c)
+{
+    for (; x < width; x++) {
+        int yy = (y[x] - 16) * c->yg + 32;
+        int d = u[x >> 1] - 128;
+        int e = v[x >> 1] - 128;
+        dst[4 * x] = clampU8((yy + d * c->ub) >> 6);
+        dst[4 * x + 1] = clampU8((yy - (d * c->ug + e * c->vg)) >> 6);
+        dst[4 * x + 2] = clampU8((yy + e * c->vr) >> 6);
+        dst[4 * x + 3] = 0xff;
+    }
+}
+
+static void splitUVRowC(const uint8_t *uv, uint8_t *u, uint8_t *v, int i, int cnt)
+{
+    for (; i < cnt; i++) {
+        u[i] = uv[2 * i];
+        v[i] = uv[2 * i + 1];
+    }
+}
+
+/*a packed 422 pixel pair is 4 bytes, luma at yPos and yPos + 2*/
+static void splitPackedRowC(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v,
+                            int i, int pairCnt, int yPos, int uPos, int vPos)
+{
+    for (; i < pairCnt; i++) {
+        y[2 * i] = src[4 * i + yPos];
+        y[2 * i + 1] = src[4 * i + yPos + 2];
+        u[i] = src[4 * i + uPos];
+        v[i] = src[4 * i + vPos];
+    }
+}
+
+#if PIXEL_SIMD_NEON
+static void yuvRowToBgrx(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                         uint8_t *dst, int width, const YuvCoeff *c)
+{
+    int x = 0;
+    if (gSimdEnabled) {
+        const int16x8_t k16 = vdupq_n_s16(16);
+        const int16x8_t k32 = vdupq_n_s16(32);
+        const int16x8_t k128 = vdupq_n_s16(128);
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t y8 = vld1q_u8(y + x);
+            int16x8_t ylo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y8)));
+            int16x8_t yhi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y8)));
+            ylo = vaddq_s16(vmulq_n_s16(vsubq_s16(ylo, k16), c->yg), k32);
+            yhi = vaddq_s16(vmulq_n_s16(vsubq_s16(yhi, k16), c->yg), k32);
+            int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + (x >> 1)))), k128);
+            int16x8_t e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + (x >> 1)))), k128);
+            //every chroma sample covers two pixels
+            int16x8x2_t bu = vzipq_s16(vmulq_n_s16(d, c->ub), vmulq_n_s16(d, c->ub));
+            int16x8_t g = vaddq_s16(vmulq_n_s16(d, c->ug), vmulq_n_s16(e, c->vg));
+            int16x8x2_t gu = vzipq_s16(g, g);
+            int16x8x2_t rv = vzipq_s16(vmulq_n_s16(e, c->vr), vmulq_n_s16(e, c->vr));
+            uint8x16x4_t out;
+            out.val[0] = vcombine_u8(vqmovun_s16(vshrq_n_s16(vqaddq_s16(ylo, bu.val[0]), 6)),
+                                     vqmovun_s16(vshrq_n_s16(vqaddq_s16(yhi, bu.val[1]), 6)));
+            out.val[1] = vcombine_u8(vqmovun_s16(vshrq_n_s16(vqsubq_s16(ylo, gu.val[0]), 6)),
+                                     vqmovun_s16(vshrq_n_s16(vqsubq_s16(yhi, gu.val[1]), 6)));
+            out.val[2] = vcombine_u8(vqmovun_s16(vshrq_n_s16(vqaddq_s16(ylo, rv.val[0]), 6)),
+                                     vqmovun_s16(vshrq_n_s16(vqaddq_s16(yhi, rv.val[1]), 6)));
+            out.val[3] = vdupq_n_u8(0xff);
+            vst4q_u8(dst + 4 * x, out);
+        }
+    }
+    yuvRowToBgrxC(y, u, v, dst, x, width, c);
+}
+
+static void splitUVRow(const uint8_t *uv, uint8_t *u, uint8_t *v, int cnt)
+{
+    int i = 0;
+    if (gSimdEnabled) {
+        for (; i + 16 <= cnt; i += 16) {
+            uint8x16x2_t p = vld2q_u8(uv + 2 * i);
+            vst1q_u8(u + i, p.val[0]);
+            vst1q_u8(v + i, p.val[1]);
+        }
+    }
+    splitUVRowC(uv, u, v, i, cnt);
+}
+
+static void splitPackedRow(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v,
+                           int pairCnt, int yPos, int uPos, int vPos)
+{
+    int i = 0;
+    if (gSimdEnabled) {
+        for (; i + 16 <= pairCnt; i += 16) {
+            uint8x16x4_t p = vld4q_u8(src + 4 * i);
+            uint8x16x2_t yy;
+            yy.val[0] = p.val[yPos];
+            yy.val[1] = p.val[yPos + 2];
+            vst2q_u8(y + 2 * i, yy);
+            vst1q_u8(u + i, p.val[uPos]);
+            vst1q_u8(v + i, p.val[vPos]);
+        }
+    }
+    splitPackedRowC(src, y, u, v, i, pairCnt, yPos, uPos, vPos);
+}
+#elif PIXEL_SIMD_SSE2
+static void yuvRowToBgrx(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                         uint8_t *dst, int width, const YuvCoeff *c)
+{
+    int x = 0;
+    if (gSimdEnabled) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i k16 = _mm_set1_epi16(16);
+        const __m128i k32 = _mm_set1_epi16(32);
+        const __m128i k128 = _mm_set1_epi16(128);
+        const __m128i kYg = _mm_set1_epi16(c->yg);
+        const __m128i kVr = _mm_set1_epi16(c->vr);
+        const __m128i kUg = _mm_set1_epi16(c->ug);
+        const __m128i kVg = _mm_set1_epi16(c->vg);
+        const __m128i kUb = _mm_set1_epi16(c->ub);
+        const __m128i alpha = _mm_set1_epi8((char)0xff);
+        for (; x + 16 <= width; x += 16) {
+            __m128i y8 = _mm_loadu_si128((const __m128i *)(y + x));
+            __m128i ylo = _mm_unpacklo_epi8(y8, zero);
+            __m128i yhi = _mm_unpackhi_epi8(y8, zero);
+            ylo = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(ylo, k16), kYg), k32);
+            yhi = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(yhi, k16), kYg), k32);
+            __m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + (x >> 1))), zero), k128);
+            __m128i e = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + (x >> 1))), zero), k128);
+            __m128i bu = _mm_mullo_epi16(d, kUb);
+            __m128i gu = _mm_add_epi16(_mm_mullo_epi16(d, kUg), _mm_mullo_epi16(e, kVg));
+            __m128i rv = _mm_mullo_epi16(e, kVr);
+            //every chroma sample covers two pixels
+            __m128i b = _mm_packus_epi16(_mm_srai_epi16(_mm_adds_epi16(ylo, _mm_unpacklo_epi16(bu, bu)), 6),
+                                         _mm_srai_epi16(_mm_adds_epi16(yhi, _mm_unpackhi_epi16(bu, bu)), 6));
+            __m128i g = _mm_packus_epi16(_mm_srai_epi16(_mm_subs_epi16(ylo, _mm_unpacklo_epi16(gu, gu)), 6),
+                                         _mm_srai_epi16(_mm_subs_epi16(yhi, _mm_unpackhi_epi16(gu, gu)), 6));
+            __m128i r = _mm_packus_epi16(_mm_srai_epi16(_mm_adds_epi16(ylo, _mm_unpacklo_epi16(rv, rv)), 6),
+                                         _mm_srai_epi16(_mm_adds_epi16(yhi, _mm_unpackhi_epi16(rv, rv)), 6));
+            __m128i bg0 = _mm_unpacklo_epi8(b, g);
+            __m128i bg1 = _mm_unpackhi_epi8(b, g);
+            __m128i ra0 = _mm_unpacklo_epi8(r, alpha);
+            __m128i ra1 = _mm_unpackhi_epi8(r, alpha);
+            _mm_storeu_si128((__m128i *)(dst + 4 * x), _mm_unpacklo_epi16(bg0, ra0));
+            _mm_storeu_si128((__m128i *)(dst + 4 * x + 16), _mm_unpackhi_epi16(bg0, ra0));
+            _mm_storeu_si128((__m128i *)(dst + 4 * x + 32), _mm_unpacklo_epi16(bg1, ra1));
+            _mm_storeu_si128((__m128i *)(dst + 4 * x + 48), _mm_unpackhi_epi16(bg1, ra1));
+        }
+    }
+    yuvRowToBgrxC(y, u, v, dst, x, width, c);
+}
+
+static void splitUVRow(const uint8_t *uv, uint8_t *u, uint8_t *v, int cnt)
+{
+    int i = 0;
+    if (gSimdEnabled) {
+        const __m128i mask = _mm_set1_epi16(0x00ff);
+        for (; i + 16 <= cnt; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(uv + 2 * i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(uv + 2 * i + 16));
+            _mm_storeu_si128((__m128i *)(u + i), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+            _mm_storeu_si128((__m128i *)(v + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+        }
+    }
+    splitUVRowC(uv, u, v, i, cnt);
+}
+
+static void splitPackedRow(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v,
+                           int pairCnt, int yPos, int uPos, int vPos)
+{
+    int i = 0;
+    if (gSimdEnabled) {
+        const __m128i mask = _mm_set1_epi16(0x00ff);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= pairCnt; i += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + 4 * i + 16));
+            __m128i even = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+            __m128i odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+            //luma is either every even or every odd byte,chroma is the other
+            __m128i chroma = yPos == 0 ? odd : even;
+            _mm_storeu_si128((__m128i *)(y + 2 * i), yPos == 0 ? even : odd);
+            __m128i first = _mm_packus_epi16(_mm_and_si128(chroma, mask), zero);
+            __m128i second = _mm_packus_epi16(_mm_srli_epi16(chroma, 8), zero);
+            _mm_storel_epi64((__m128i *)(u + i), uPos < vPos ? first : second);
+            _mm_storel_epi64((__m128i *)(v + i), uPos < vPos ? second : first);
+        }
+    }
+    splitPackedRowC(src, y, u, v, i, pairCnt, yPos, uPos, vPos);
+}
+#else
+static void yuvRowToBgrx(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                         uint8_t *dst, int width, const YuvCoeff *c)
+{
+    yuvRowToBgrxC(y, u, v, dst, 0, width, c);
+}
+
+static void splitUVRow(const uint8_t *uv, uint8_t *u, uint8_t *v, int cnt)
+{
+    splitUVRowC(uv, u, v, 0, cnt);
+}
+
+static void splitPackedRow(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v,
+                           int pairCnt, int yPos, int uPos, int vPos)
+{
+    splitPackedRowC(src, y, u, v, 0, pairCnt, yPos, uPos, vPos);
+}
+#endif
+
+/*byte positions of y,u,v in a packed 422 pixel pair,false if not packed 422*/
+static bool getPackedPositions(RenderVideoFormat format, int *yPos, int *uPos, int *vPos)
+{
+    switch (format) {
+        case VIDEO_FORMAT_YUY2:
+            *yPos = 0; *uPos = 1; *vPos = 3;
+            return true;
+        case VIDEO_FORMAT_YVYU:
+            *yPos = 0; *uPos = 3; *vPos = 1;
+            return true;
+        case VIDEO_FORMAT_UYVY:
+            *yPos = 1; *uPos = 0; *vPos = 2;
+            return true;
+        case VIDEO_FORMAT_VYUY:
+            *yPos = 1; *uPos = 2; *vPos = 0;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static int copyFrame(const uint8_t *src, const PixelLayout *srcLayout,
+                     uint8_t *dst, const PixelLayout *dstLayout)
+{
+    if (srcLayout->planeCnt != dstLayout->planeCnt) {
+        return ERROR_BAD_VALUE;
+    }
+    for (int i = 0; i < srcLayout->planeCnt; i++) {
+        const uint8_t *s = src + srcLayout->offset[i];
+        uint8_t *d = dst + dstLayout->offset[i];
+        int rows = srcLayout->height[i] < dstLayout->height[i] ? srcLayout->height[i] : dstLayout->height[i];
+        if (srcLayout->stride[i] == dstLayout->stride[i]) {
+            memcpy(d, s, (size_t)srcLayout->stride[i] * rows);
+            continue;
+        }
+        int rowBytes = srcLayout->stride[i] < dstLayout->stride[i] ? srcLayout->stride[i] : dstLayout->stride[i];
+        for (int r = 0; r < rows; r++) {
+            memcpy(d + (size_t)r * dstLayout->stride[i], s + (size_t)r * srcLayout->stride[i], rowBytes);
+        }
+    }
+    return NO_ERROR;
+}
+
+int PixelConverter::getLayout(RenderVideoFormat format, int width, int height, int align, PixelLayout *layout)
+{
+    int bpp = 0;
+
+    memset(layout, 0, sizeof(PixelLayout));
+    if (width <= 0 || height <= 0 || align <= 0 || (align & (align - 1))) {
+        return ERROR_BAD_VALUE;
+    }
+
+    switch (format) {
+        case VIDEO_FORMAT_I420:
+        case VIDEO_FORMAT_YV12: {
+            layout->planeCnt = 3;
+            layout->stride[0] = ROUND_UP_N(ROUND_UP_2(width), 2 * align);
+            layout->stride[1] = layout->stride[2] = layout->stride[0] / 2;
+            layout->height[0] = height;
+            layout->height[1] = layout->height[2] = (height + 1) / 2;
+        } break;
+        case VIDEO_FORMAT_NV12:
+        case VIDEO_FORMAT_NV21: {
+            layout->planeCnt = 2;
+            layout->stride[0] = layout->stride[1] = ROUND_UP_N(ROUND_UP_2(width), align);
+            layout->height[0] = height;
+            layout->height[1] = (height + 1) / 2;
+        } break;
+        case VIDEO_FORMAT_YUY2:
+        case VIDEO_FORMAT_YVYU:
+        case VIDEO_FORMAT_UYVY:
+        case VIDEO_FORMAT_VYUY: {
+            layout->planeCnt = 1;
+            layout->stride[0] = ROUND_UP_N(ROUND_UP_2(width) * 2, align);
+            layout->height[0] = height;
+        } break;
+        case VIDEO_FORMAT_RGB16:
+        case VIDEO_FORMAT_BGR16:
+            bpp = 2;
+            break;
+        case VIDEO_FORMAT_RGB:
+        case VIDEO_FORMAT_BGR:
+        case VIDEO_FORMAT_v308:
+            bpp = 3;
+            break;
+        case VIDEO_FORMAT_AYUV:
+        case VIDEO_FORMAT_RGBx:
+        case VIDEO_FORMAT_RGBA:
+        case VIDEO_FORMAT_BGRA:
+        case VIDEO_FORMAT_xRGB:
+        case VIDEO_FORMAT_ARGB:
+        case VIDEO_FORMAT_xBGR:
+        case VIDEO_FORMAT_ABGR:
+        case VIDEO_FORMAT_r210:
+        case VIDEO_FORMAT_Y410:
+        case VIDEO_FORMAT_VUYA:
+        case VIDEO_FORMAT_BGR10A2_LE:
+        case VIDEO_FORMAT_BGRx:
+            bpp = 4;
+            break;
+        default:
+            return ERROR_BAD_VALUE;
+    }
+
+    if (bpp > 0) {
+        layout->planeCnt = 1;
+        layout->stride[0] = ROUND_UP_N(width * bpp, align);
+        layout->height[0] = height;
+    }
+    for (int i = 0; i < layout->planeCnt; i++) {
+        layout->offset[i] = layout->size;
+        layout->size += layout->stride[i] * layout->height[i];
+    }
+    return NO_ERROR;
+}
+
+bool PixelConverter::canConvert(RenderVideoFormat srcFormat, RenderVideoFormat dstFormat)
+{
+    int yPos, uPos, vPos;
+
+    if (srcFormat == dstFormat) {
+        PixelLayout layout;
+        return getLayout(srcFormat, 2, 2, 1, &layout) == NO_ERROR;
+    }
+    if (dstFormat != VIDEO_FORMAT_BGRx && dstFormat != VIDEO_FORMAT_BGRA) {
+        return false;
+    }
+    switch (srcFormat) {
+        case VIDEO_FORMAT_I420:
+        case VIDEO_FORMAT_YV12:
+        case VIDEO_FORMAT_NV12:
+        case VIDEO_FORMAT_NV21:
+            return true;
+        default:
+            return getPackedPositions(srcFormat, &yPos, &uPos, &vPos);
+    }
+}
+
+int PixelConverter::convert(RenderVideoFormat srcFormat, const uint8_t *src, const PixelLayout *srcLayout,
+                            RenderVideoFormat dstFormat, uint8_t *dst, const PixelLayout *dstLayout,
+                            int width, int height)
+{
+    uint8_t yRow[PIXEL_CHUNK_WIDTH];
+    uint8_t uRow[PIXEL_CHUNK_WIDTH / 2];
+    uint8_t vRow[PIXEL_CHUNK_WIDTH / 2];
+    int yPos, uPos, vPos;
+
+    if (!src || !dst || width <= 0 || height <= 0 || !canConvert(srcFormat, dstFormat)) {
+        return ERROR_BAD_VALUE;
+    }
+    if (srcFormat == dstFormat) {
+        return copyFrame(src, srcLayout, dst, dstLayout);
+    }
+
+    const YuvCoeff *c = height >= 720 ? &kBt709Coeff : &kBt601Coeff;
+    bool packed = getPackedPositions(srcFormat, &yPos, &uPos, &vPos);
+    for (int r = 0; r < height; r++) {
+        uint8_t *d = dst + dstLayout->offset[0] + (size_t)r * dstLayout->stride[0];
+        const uint8_t *s = src + srcLayout->offset[0] + (size_t)r * srcLayout->stride[0];
+        if (packed) {
+            for (int x = 0; x < width; x += PIXEL_CHUNK_WIDTH) {
+                int w = width - x < PIXEL_CHUNK_WIDTH ? width - x : PIXEL_CHUNK_WIDTH;
+                splitPackedRow(s + 2 * x, yRow, uRow, vRow, (w + 1) / 2, yPos, uPos, vPos);
+                yuvRowToBgrx(yRow, uRow, vRow, d + 4 * x, w, c);
+            }
+            continue;
+        }
+
+        int cr = r >> 1;
+        if (srcFormat == VIDEO_FORMAT_I420 || srcFormat == VIDEO_FORMAT_YV12) {
+            const uint8_t *u = src + srcLayout->offset[1] + (size_t)cr * srcLayout->stride[1];
+            const uint8_t *v = src + srcLayout->offset[2] + (size_t)cr * srcLayout->stride[2];
+            if (srcFormat == VIDEO_FORMAT_YV12) {
+                const uint8_t *t = u;
+                u = v;
+                v = t;
+            }
+            yuvRowToBgrx(s, u, v, d, width, c);
+        } else {
+            const uint8_t *uv = src + srcLayout->offset[1] + (size_t)cr * srcLayout->stride[1];
+            for (int x = 0; x < width; x += PIXEL_CHUNK_WIDTH) {
+                int w = width - x < PIXEL_CHUNK_WIDTH ? width - x : PIXEL_CHUNK_WIDTH;
+                if (srcFormat == VIDEO_FORMAT_NV12) {
+                    splitUVRow(uv + x, uRow, vRow, (w + 1) / 2);
+                } else {
+                    splitUVRow(uv + x, vRow, uRow, (w + 1) / 2);
+                }
+                yuvRowToBgrx(s + x, uRow, vRow, d + 4 * x, w, c);
+            }
+        }
+    }
+    return NO_ERROR;
+}
+
+const char *PixelConverter::getSimdName()
+{
+#if PIXEL_SIMD_NEON
+    return "neon";
+#elif PIXEL_SIMD_SSE2
+    return "sse2";
+#else
+    return "c";
+#endif
+}
+
+void PixelConverter::setSimdEnabled(bool enabled)
+{
+    gSimdEnabled = enabled;
+}
+
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_PIXEL_CONVERTER_H_
+#define _TOOLS_PIXEL_CONVERTER_H_
+#include <stdint.h>
+#include "render_common.h"
+
+namespace Tls {
+
+#define PIXEL_MAX_PLANES 3
+
+/**
+ * memory layout of a video frame, offsets are counted
+ * from the start of the frame
+ */
+typedef struct {
+    int planeCnt;
+    int stride[PIXEL_MAX_PLANES];
+    int offset[PIXEL_MAX_PLANES];
+    int height[PIXEL_MAX_PLANES]; //row count of the plane
+    int size; //total bytes of the frame
+} PixelLayout;
+
+/**
+ * copies or converts raw video frames between formats for
+ * the shm buffer path. yuv to 32bit rgb uses neon or sse2
+ * kernels when the target supports them, a c kernel with the
+ * same fixed point math otherwise, so every path gives the
+ * same pixels
+ */
+class PixelConverter {
+  public:
+    /**
+     * get the layout of a frame, plane strides are rounded up to align,
+     * planar formats keep the chroma stride half of the luma stride
+     * like wl_shm expects
+     *
+     * format - the video format
+     * width,height - frame size in pixels
+     * align - stride alignment in bytes, must be a power of 2,
+     *         1 for tightly packed raw frames
+     * layout - filled with the frame layout
+     *
+     * returns NO_ERROR, ERROR_BAD_VALUE if the format is not supported
+     */
+    static int getLayout(RenderVideoFormat format, int width, int height, int align, PixelLayout *layout);
+    /**
+     * check a frame of srcFormat can be converted to dstFormat,
+     * any format with a layout can be copied to the same format
+     */
+    static bool canConvert(RenderVideoFormat srcFormat, RenderVideoFormat dstFormat);
+    /**
+     * copy or convert a frame, yuv is taken as bt601 limited range
+     * under 720 lines and bt709 limited range otherwise
+     *
+     * returns NO_ERROR, ERROR_BAD_VALUE if the conversion is not supported
+     */
+    static int convert(RenderVideoFormat srcFormat, const uint8_t *src, const PixelLayout *srcLayout,
+                       RenderVideoFormat dstFormat, uint8_t *dst, const PixelLayout *dstLayout,
+                       int width, int height);
+    /**
+     * the simd kernel set compiled in, "neon", "sse2" or "c"
+     */
+    static const char *getSimdName();
+    /**
+     * use the simd kernels if compiled in, they are on by default,
+     * turning them off is for benchmark and verification only
+     */
+    static void setSimdEnabled(bool enabled);
+};
+
+}
+
+#endif /*_TOOLS_PIXEL_CONVERTER_H_*/
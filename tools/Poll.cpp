@@ -107,7 +107,7 @@ int Poll::removeFd(int fd)
     for (int i = 0; i < mFdsCnt; i++) {
         struct pollfd *pfd = &mFds[i];
         if (pfd->fd == fd) {
-            memmove(mFds+i*sizeof(struct pollfd),mFds+(i+1)*sizeof(struct pollfd), 1);
+            memmove(&mFds[i], &mFds[i+1], (mFdsCnt - i - 1)*sizeof(struct pollfd));
             mFdsCnt--;
             return 0;
         }
@@ -175,6 +175,11 @@ int Poll::wait(int64_t timeoutMs /*millisecond*/)
         if (mFlushing.load()) {
             goto tag_flushing;
         }
+        //consume the wakeup raised by wakeup()
+        if (activecnt > 0 && mControllable && isReadable(mControlReadFd)) {
+            releaseAllWakeup();
+            activecnt--;
+        }
     } while(0);
 
 tag_success:
@@ -207,6 +212,13 @@ void Poll::setFlushing(bool flushing)
     }
 }
 
+void Poll::wakeup()
+{
+    if (mControllable) {
+        raiseWakeup();
+    }
+}
+
 bool Poll::isReadable(int fd)
 {
     for (int i = 0; i < mFdsCnt; i++) {
@@ -227,6 +239,16 @@ bool Poll::isWritable(int fd)
     return false;
 }
 
+bool Poll::isError(int fd)
+{
+    for (int i = 0; i < mFdsCnt; i++) {
+        if (mFds[i].fd == fd && ((mFds[i].revents & (POLLERR|POLLHUP|POLLNVAL)) != 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 struct pollfd * Poll::findFd(int fd)
 {
     for (int i = 0; i < mFdsCnt; i++) {
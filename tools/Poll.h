@@ -93,6 +93,12 @@ class Poll {
      * @param flushing
      */
     void setFlushing(bool flushing);
+    /**
+     * @brief wakeup poll wait without flushing, used to
+     * let the waiting thread pick up changed fds,
+     * wait will not count the wakeup as an active fd
+     */
+    void wakeup();
     /**
      * @brief check this fd if had data to read
      *
@@ -109,6 +115,14 @@ class Poll {
      * @return false
      */
     bool isWritable(int fd);
+    /**
+     * @brief check this fd if had error or hung up
+     *
+     * @param fd file fd
+     * @return true
+     * @return false
+     */
+    bool isError(int fd);
   private:
     struct pollfd * findFd(int fd);
     bool wakeEvent();
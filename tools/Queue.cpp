@@ -20,20 +20,17 @@ namespace Tls {
 
 Queue::Queue()
 {
-    _init();
+    _init(0, 0);
 }
 
 Queue::Queue(uint32_t maxElement)
 {
-    _init();
-    if (maxElement > 0) {
-        mCapability = maxElement;
-    }
+    _init(maxElement, 0);
 }
 
 Queue::Queue(bool ascendingOrder, int (*cmp)(void *, void *))
 {
-    _init();
+    _init(0, 0);
     if (cmp) {
         mSort = true;
         mAscendingOrder = ascendingOrder;
@@ -43,10 +40,7 @@ Queue::Queue(bool ascendingOrder, int (*cmp)(void *, void *))
 
 Queue::Queue(uint32_t maxElement, bool ascendingOrder, int (*cmp)(void *, void *))
 {
-    _init();
-    if (maxElement > 0) {
-        mCapability = maxElement;
-    }
+    _init(maxElement, 0);
     if (cmp) {
         mSort = true;
         mAscendingOrder = ascendingOrder;
@@ -54,6 +48,11 @@ Queue::Queue(uint32_t maxElement, bool ascendingOrder, int (*cmp)(void *, void *
     }
 }
 
+Queue::Queue(uint32_t maxElement, uint32_t capacityHint)
+{
+    _init(maxElement, capacityHint);
+}
+
 Queue::~Queue()
 {
     _release();
@@ -156,33 +155,13 @@ int32_t Queue::flushAndCallback(void *userdata, void (*fcb)(void *userdata, void
 
 int32_t Queue::getCnt()
 {
-    int32_t cnt = 0;
-    if (Q_OK != _lock())
-        return Q_ERR_LOCK;
-
-    cnt = mUsedElementCnts;
-
-    if (Q_OK != _unlock())
-        return Q_ERR_LOCK;
-
-    return cnt;
+    return mUsedElementCnts.load(std::memory_order_acquire);
 }
 
 
 bool Queue::isEmpty()
 {
-    bool isEmpty;
-
-    _lock();
-
-    if (mUsedFirstElement == NULL || mUsedLastElement == NULL)
-        isEmpty = true;
-    else
-        isEmpty = false;
-
-    _unlock();
-
-    return isEmpty;
+    return mUsedElementCnts.load(std::memory_order_acquire) == 0;
 }
 
 
@@ -219,7 +198,7 @@ bool Queue::isAllowedNewData()
 }
 
 
-int32_t Queue::_init()
+int32_t Queue::_init(uint32_t maxElement, uint32_t capacityHint)
 {
     pthread_mutex_init(&mMutex, NULL);
 
@@ -227,14 +206,28 @@ int32_t Queue::_init()
 
     pthread_cond_init(&mCondPut, NULL);
 
-    mUsedFirstElement = NULL;
-    mUsedLastElement = NULL;
-    mUsedElementCnts = 0;
+    mRing = NULL;
+    mRingSize = 0;
+    mRingHead = 0;
+    mUsedElementCnts.store(0);
     mCapability = INT32_MAX - 1;//max capability
     mAllowedNewData = true;
     mSort = false;
     mAscendingOrder = 1;
     cmpEleFun = NULL;
+
+    if (maxElement > 0) {
+        mCapability = maxElement;
+    }
+    //a bounded queue preallocates all of its slots unless told otherwise
+    if (capacityHint == 0) {
+        capacityHint = maxElement > 0 ? maxElement : QUEUE_DEFAULT_CAPACITY_HINT;
+    }
+    if (capacityHint > mCapability) {
+        capacityHint = mCapability;
+    }
+    //if this fails, push will retry and report Q_ERR_MEM
+    _growRing(capacityHint);
     return Q_OK;
 }
 
@@ -249,8 +242,11 @@ int32_t Queue::_release()
 
     error = _flushElements(NULL, NULL);
 
-    mUsedFirstElement = NULL;
-    mUsedLastElement = NULL;
+    if (mRing) {
+        free(mRing);
+        mRing = NULL;
+    }
+    mRingSize = 0;
 
     // destroy lock and queue etc
     error = pthread_cond_destroy(&mCondGet);
@@ -278,38 +274,65 @@ int32_t Queue::_unlock()
     return Q_OK;
 }
 
+int32_t Queue::_growRing(uint32_t minSlots)
+{
+    uint32_t size = mRingSize > 0 ? mRingSize : 1;
+    uint32_t cnt = mUsedElementCnts.load(std::memory_order_relaxed);
+
+    while (size < minSlots && size < (1u << 31)) {
+        size <<= 1;
+    }
+    if (size <= mRingSize) {
+        return Q_OK;
+    }
+
+    void **ring = (void **)malloc(size * sizeof(void *));
+    if (ring == NULL) {
+        return Q_ERR_MEM;
+    }
+    //unwrap the elements to the start of the new ring
+    for (uint32_t i = 0; i < cnt; i++) {
+        ring[i] = mRing[_slot(i)];
+    }
+    if (mRing) {
+        free(mRing);
+    }
+    mRing = ring;
+    mRingSize = size;
+    mRingHead = 0;
+    return Q_OK;
+}
+
 int32_t Queue::_flushElements(void *userdata, void (*fcb)(void *userdata, void *ele))
 {
-    Element *ele  = NULL;
-    while (mUsedFirstElement != NULL) {
-        ele = mUsedFirstElement;
-        mUsedFirstElement = mUsedFirstElement->next;
+    uint32_t cnt = mUsedElementCnts.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < cnt; i++) {
         if (fcb != NULL) {
-            fcb(userdata,ele->data);
+            fcb(userdata, mRing[_slot(i)]);
         }
-        free(ele);
     }
-    mUsedFirstElement = NULL;
-    mUsedLastElement = NULL;
-    mUsedElementCnts = 0;
+    mRingHead = 0;
+    mUsedElementCnts.store(0, std::memory_order_release);
+
+    // the queue has room again, wake the blocked pushers
+    pthread_cond_broadcast(&mCondPut);
 
     return Q_OK;
 }
 
 int32_t Queue::_pushElement(void *ele, bool isWait)
 {
-    Element *newEle = NULL;
     if (mAllowedNewData == false) { // no new data allowed
         return Q_ERR_NONEWDATA;
     }
 
     // max_elements already reached?
     // if condition _needs_ to be in sync with while loop below!
-    if (mUsedElementCnts ==  mCapability) {
+    if ((uint32_t)mUsedElementCnts.load(std::memory_order_relaxed) == mCapability) {
         if (isWait == false) {
             return Q_ERR_NUM_ELEMENTS;
         } else {
-            while ((mUsedElementCnts == mCapability) && mAllowedNewData) {
+            while (((uint32_t)mUsedElementCnts.load(std::memory_order_relaxed) == mCapability) && mAllowedNewData) {
                 pthread_cond_wait(&mCondPut, &mMutex);
             }
             if (mAllowedNewData == false) {
@@ -318,52 +341,33 @@ int32_t Queue::_pushElement(void *ele, bool isWait)
         }
     }
 
-    newEle = (Element *)calloc(1,sizeof(Element));
-    if (newEle == NULL) { // could not allocate memory for new elements
-        return Q_ERR_MEM;
+    uint32_t cnt = mUsedElementCnts.load(std::memory_order_relaxed);
+    // all preallocated slots are used, only an "unlimited" queue or
+    // a queue created with a small capacity hint gets here
+    if (cnt == mRingSize) {
+        if (Q_OK != _growRing(cnt + 1)) { // could not allocate memory for new elements
+            return Q_ERR_MEM;
+        }
     }
-    newEle->data = ele;
-    newEle->next = NULL;
-//printf("_pushElement,%p,%p,data:%p\n",mUsedLastElement,newEle,ele);
-    if (mSort == false || mUsedFirstElement == NULL) {
-        // insert at the end when we don't want to sort or the queue is empty
-        if (mUsedLastElement == NULL)
-            mUsedFirstElement = newEle;
-        else
-            mUsedLastElement->next = newEle;
-        mUsedLastElement = newEle;
-    } else {
-        // search appropriate place to sort element in
-        Element *s = mUsedFirstElement; // s != NULL, because of if condition above
-        Element *t = NULL;
-        //check if insert new element to the first element
-        int asc_first_el = (mAscendingOrder == true && cmpEleFun(s->data, ele) >= 0);
-        int desc_first_el = (mAscendingOrder == false && cmpEleFun(s->data, ele) <= 0);
-
-        if (asc_first_el == 0 && desc_first_el == 0) {
-            // element will be inserted between s and t
-            for (s = mUsedFirstElement, t = s->next; s != NULL && t != NULL; s = t, t = t->next) {
-                if (mAscendingOrder == true && cmpEleFun(s->data, ele) <= 0 && cmpEleFun(ele, t->data) <= 0) {
-                    // asc: s <= e <= t
-                    break;
-                } else if(mAscendingOrder == false && cmpEleFun(s->data, ele) >= 0 && cmpEleFun(ele, t->data) >= 0) {
-                    // desc: s >= e >= t
-                    break;
-                }
+
+    uint32_t pos = cnt;
+    if (mSort == true) {
+        // search appropriate place to sort element in,
+        // elements equal to ele stay in front of it
+        for (pos = 0; pos < cnt; pos++) {
+            int ret = cmpEleFun(mRing[_slot(pos)], ele);
+            if ((mAscendingOrder == true && ret > 0) ||
+                (mAscendingOrder == false && ret < 0)) {
+                break;
             }
-            // actually insert
-            s->next = newEle;
-            newEle->next = t;
-            if (t == NULL)
-                mUsedLastElement = newEle;
-        } else if(asc_first_el != 0 || desc_first_el != 0) {
-            // add at front
-            newEle->next = mUsedFirstElement;
-            mUsedFirstElement = newEle;
+        }
+        // move the tail one slot back to make room
+        for (uint32_t i = cnt; i > pos; i--) {
+            mRing[_slot(i)] = mRing[_slot(i - 1)];
         }
     }
-    mUsedElementCnts++;
-    //printf("_pushElement,%p,data:%p,%d\n",mUsedLastElement,mUsedLastElement->data,mUsedElementCnts);
+    mRing[_slot(pos)] = ele;
+    mUsedElementCnts.store(cnt + 1, std::memory_order_release);
     // notify only one waiting thread, so that we don't have to check and fall to sleep because we were to slow
     pthread_cond_signal(&mCondGet);
 
@@ -373,48 +377,44 @@ int32_t Queue::_pushElement(void *ele, bool isWait)
 int32_t Queue::_popElement(void **e, bool isWait, int (*cmp)(void *, void *), void *cmpEle)
 {
     // are elements in the queue?
-    if (mUsedElementCnts == 0) {
+    if (mUsedElementCnts.load(std::memory_order_relaxed) == 0) {
         if (isWait == false) {
             *e = NULL;
             return Q_ERR_NUM_ELEMENTS;
         } else {
-            while (mUsedElementCnts == 0 && mAllowedNewData) {
+            while (mUsedElementCnts.load(std::memory_order_relaxed) == 0 && mAllowedNewData) {
                 pthread_cond_wait(&mCondGet, &mMutex);
             }
-            if (mUsedElementCnts == 0 && mAllowedNewData == false) {
+            if (mUsedElementCnts.load(std::memory_order_relaxed) == 0 && mAllowedNewData == false) {
                 return Q_ERR_NONEWDATA;
              }
         }
     }
 
     // get first element (which fulfills the requirements)
-    Element *elePrev = NULL, *ele = mUsedFirstElement;
-    while (cmp != NULL && ele != NULL && 0 != cmp(ele, cmpEle)) {
-        elePrev = ele;
-        ele = ele->next;
+    uint32_t cnt = mUsedElementCnts.load(std::memory_order_relaxed);
+    uint32_t pos = 0;
+    while (cmp != NULL && pos < cnt && 0 != cmp(mRing[_slot(pos)], cmpEle)) {
+        pos++;
     }
-    if (ele != NULL && elePrev == NULL) {
-        *e = mUsedFirstElement->data;
-        //element is at first, remove this node
-        mUsedFirstElement = mUsedFirstElement->next;
-        --mUsedElementCnts;
-        if (mUsedFirstElement == NULL) {
-            mUsedLastElement = NULL;
-        }
-        //printf("_popElement,%p,data:%p,%p\n",ele,*e,mUsedFirstElement);
-        free(ele);
-    } else if (ele != NULL && elePrev != NULL) {
-        // element is in the middle,remove this node
-        elePrev->next = ele->next;
-        --mUsedElementCnts;
-        *e = ele->data;
-        free(ele);
-    } else {
+    if (pos >= cnt) {
         // element is invalid
         *e = NULL;
         return Q_ERR_INVALID_ELEMENT;
     }
 
+    *e = mRing[_slot(pos)];
+    if (pos == 0) {
+        //element is at first, advance the head
+        mRingHead = _slot(1);
+    } else {
+        // element is in the middle, close the gap
+        for (uint32_t i = pos; i + 1 < cnt; i++) {
+            mRing[_slot(i)] = mRing[_slot(i + 1)];
+        }
+    }
+    mUsedElementCnts.store(cnt - 1, std::memory_order_release);
+
     // notify only one waiting thread
     pthread_cond_signal(&mCondPut);
 
@@ -423,20 +423,12 @@ int32_t Queue::_popElement(void **e, bool isWait, int (*cmp)(void *, void *), vo
 
 int32_t Queue::_peekElement(void **e, int32_t pos)
 {
-    Element *ele = mUsedFirstElement;
-    int32_t elePos = 0;
-    if (mUsedElementCnts == 0) {
+    int32_t cnt = mUsedElementCnts.load(std::memory_order_relaxed);
+    if (cnt == 0 || pos < 0 || pos >= cnt) {
         return Q_ERR_INVALID_ELEMENT;
     }
 
-    while (ele != NULL && elePos++ < pos) {
-        ele = ele->next;
-    }
-
-    if (ele == NULL) {
-        return Q_ERR_INVALID_ELEMENT;
-    }
-    *e = ele->data;
+    *e = mRing[_slot(pos)];
     return Q_OK;
 }
 
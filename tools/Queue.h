@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <errno.h> /* EBUSY */
 #include <pthread.h> /* pthread_mutex_t, pthread_cond_t */
+#include <atomic>
 
 /**
   * returned error codes, everything except Q_OK should be < 0
@@ -37,6 +38,16 @@ typedef enum QErros {
 
 namespace Tls {
 
+/**
+  * default slot count preallocated for an "unlimited" queue,
+  * the ring doubles only when this hint is exceeded
+  */
+#define QUEUE_DEFAULT_CAPACITY_HINT 16
+
+/**
+  * a fifo (or sorted) queue of void* elements backed by a preallocated
+  * ring of slots, push/pop do not touch the heap in steady state
+  */
 class Queue {
   public:
     /**
@@ -70,6 +81,16 @@ class Queue {
       *
       */
     Queue(uint32_t maxElement, bool ascendingOrder, int (*cmp)(void *, void *));
+    /**
+      * initializes a queue with max element count and preallocates
+      * capacityHint slots, an "unlimited" queue grows past the hint
+      * only when it is exceeded
+      *
+      * maxElement - maximum number of elements which are allowed in the queue, == 0 for "unlimited"
+      * capacityHint - the number of slots to preallocate, == 0 for the default
+      *
+      */
+    Queue(uint32_t maxElement, uint32_t capacityHint);
     virtual ~Queue();
 
     /**
@@ -128,11 +149,11 @@ class Queue {
      */
     int32_t flushAndCallback(void *userdata, void (*fcb)(void *userdata, void *ele));
     /**
-     * get element count in queue
+     * get element count in queue, lock free
      */
     int32_t getCnt();
     /**
-     * checking the queue is empty?
+     * checking the queue is empty? lock free
      */
     bool isEmpty();
     /**
@@ -144,11 +165,7 @@ class Queue {
      */
     bool isAllowedNewData();
   private:
-    typedef struct Element{
-      void *data;
-      struct Element *next;
-    } Element;
-    int32_t _init();
+    int32_t _init(uint32_t maxElement, uint32_t capacityHint);
     /**
      * destroys a queue.
      * queue will be locked.
@@ -207,10 +224,25 @@ class Queue {
     int32_t _popElement(void **e, bool isWait, int (*cmp)(void *, void *), void *cmpEle);
 
     int32_t _peekElement(void **e, int32_t pos);
+    /**
+     * grows the ring to hold at least minSlots elements,
+     * only called when an "unlimited" queue exceeds its preallocated slots
+     * queue _has_ to be locked.
+     *
+     * returns < 0 => error, 0 okay
+     */
+    int32_t _growRing(uint32_t minSlots);
+    /**
+     * the ring slot index of the pos element counted from the head
+     */
+    inline uint32_t _slot(uint32_t pos) {
+        return (mRingHead + pos) & (mRingSize - 1);
+    };
 
-    Element *mUsedFirstElement;
-    Element *mUsedLastElement;
-    uint32_t mUsedElementCnts; //the cnt of elements in queue
+    void **mRing; //preallocated element slots, size is power of 2
+    uint32_t mRingSize; //slot count of mRing
+    uint32_t mRingHead; //slot index of the first element
+    std::atomic<int32_t> mUsedElementCnts; //the cnt of elements in queue
     uint32_t mCapability; //the capability of the queue
 
     bool mAllowedNewData; // no new data allowed
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include "SpscQueue.h"
+
+namespace Tls {
+
+SpscQueue::SpscQueue(uint32_t capacity)
+{
+    uint32_t size = 2;
+    while (size < capacity && size < (1u << 31)) {
+        size <<= 1;
+    }
+    mRing = (void **)calloc(size, sizeof(void *));
+    mMask = mRing ? size - 1 : 0;
+    mHead.store(0, std::memory_order_relaxed);
+    mTail.store(0, std::memory_order_relaxed);
+}
+
+SpscQueue::~SpscQueue()
+{
+    if (mRing) {
+        free(mRing);
+        mRing = NULL;
+    }
+}
+
+int32_t SpscQueue::push(void *ele)
+{
+    uint32_t tail = mTail.load(std::memory_order_relaxed);
+    uint32_t head = mHead.load(std::memory_order_acquire);
+
+    if (!mRing) {
+        return Q_ERR_MEM;
+    }
+    if (tail - head > mMask) {
+        return Q_ERR_NUM_ELEMENTS;
+    }
+    mRing[tail & mMask] = ele;
+    //publish the slot before the new tail
+    mTail.store(tail + 1, std::memory_order_release);
+    return Q_OK;
+}
+
+uint32_t SpscQueue::pushBatch(void **eles, uint32_t cnt)
+{
+    uint32_t tail = mTail.load(std::memory_order_relaxed);
+    uint32_t head = mHead.load(std::memory_order_acquire);
+    uint32_t room;
+
+    if (!mRing) {
+        return 0;
+    }
+    room = mMask + 1 - (tail - head);
+    if (cnt > room) {
+        cnt = room;
+    }
+    for (uint32_t i = 0; i < cnt; i++) {
+        mRing[(tail + i) & mMask] = eles[i];
+    }
+    //publish all slots with one tail update
+    mTail.store(tail + cnt, std::memory_order_release);
+    return cnt;
+}
+
+int32_t SpscQueue::pop(void **e)
+{
+    uint32_t head = mHead.load(std::memory_order_relaxed);
+    uint32_t tail = mTail.load(std::memory_order_acquire);
+
+    if (head == tail) {
+        *e = NULL;
+        return Q_ERR_NUM_ELEMENTS;
+    }
+    *e = mRing[head & mMask];
+    //hand the slot back to producer after it was read
+    mHead.store(head + 1, std::memory_order_release);
+    return Q_OK;
+}
+
+int32_t SpscQueue::peek(void **e, int32_t pos)
+{
+    uint32_t head = mHead.load(std::memory_order_relaxed);
+    uint32_t tail = mTail.load(std::memory_order_acquire);
+
+    if (pos < 0 || (uint32_t)pos >= tail - head) {
+        return Q_ERR_INVALID_ELEMENT;
+    }
+    *e = mRing[(head + pos) & mMask];
+    return Q_OK;
+}
+
+int32_t SpscQueue::flushAndCallback(void *userdata, void (*fcb)(void *userdata, void *ele))
+{
+    void *ele;
+    while (pop(&ele) == Q_OK) {
+        if (fcb != NULL) {
+            fcb(userdata, ele);
+        }
+    }
+    return Q_OK;
+}
+
+int32_t SpscQueue::getCnt()
+{
+    uint32_t tail = mTail.load(std::memory_order_acquire);
+    uint32_t head = mHead.load(std::memory_order_acquire);
+    int32_t cnt = (int32_t)(tail - head);
+    //head may pass the tail snapshot when called from other thread
+    return cnt > 0 ? cnt : 0;
+}
+
+bool SpscQueue::isEmpty()
+{
+    return getCnt() <= 0;
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_SPSC_QUEUE_H_
+#define _TOOLS_SPSC_QUEUE_H_
+#include <stdint.h>
+#include <atomic>
+#include "Queue.h"
+
+namespace Tls {
+
+/**
+ * cache line size used to keep producer and consumer
+ * indexes on different cache lines
+ */
+#define SPSC_CACHE_LINE_SIZE 64
+
+/**
+ * wait free single producer/single consumer ring of void* elements.
+ * exactly one thread may call push, and at any time exactly one
+ * thread may call peek/pop/flush. if the consumer side is shared
+ * between threads (e.g. a post thread and flush), those threads must
+ * serialize among themselves, the producer never takes a lock.
+ * error codes are the same with Tls::Queue
+ */
+class SpscQueue {
+  public:
+    /**
+     * capacity - max element count, rounded up to power of 2
+     */
+    SpscQueue(uint32_t capacity);
+    virtual ~SpscQueue();
+    /**
+     * put a new element at the end of the queue, producer side only
+     *
+     * returns Q_OK if everything worked, Q_ERR_NUM_ELEMENTS if queue is full
+     */
+    int32_t push(void *ele);
+    /**
+     * put elements at the end of the queue in order and publish
+     * them at once, producer side only
+     *
+     * returns the count of elements put, the leading ones,
+     * less than cnt if queue is full
+     */
+    uint32_t pushBatch(void **eles, uint32_t cnt);
+    /**
+     * get the first element of the queue, consumer side only
+     *
+     * returns Q_OK if everything worked, Q_ERR_NUM_ELEMENTS if queue is empty
+     */
+    int32_t pop(void **e);
+    /**
+     * peek the pos element without removing it, consumer side only
+     */
+    int32_t peek(void **e, int32_t pos);
+    /**
+     * pop all elements and call fcb for every one, consumer side only
+     */
+    int32_t flushAndCallback(void *userdata, void (*fcb)(void *userdata, void *ele));
+    /**
+     * get element count in queue, it is a snapshot when
+     * called from a thread other than producer or consumer
+     */
+    int32_t getCnt();
+    bool isEmpty();
+    uint32_t getCapacity() {
+        return mMask + 1;
+    };
+  private:
+    void **mRing;
+    uint32_t mMask;
+    //consumer owned index, next slot to read
+    char mPadHead[SPSC_CACHE_LINE_SIZE];
+    std::atomic<uint32_t> mHead;
+    //producer owned index, next slot to write
+    char mPadTail[SPSC_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>)];
+    std::atomic<uint32_t> mTail;
+    char mPadEnd[SPSC_CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>)];
+};
+
+}
+
+#endif /*_TOOLS_SPSC_QUEUE_H_*/
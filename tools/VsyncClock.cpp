@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <math.h>
+#include "VsyncClock.h"
+
+namespace Tls {
+
+/*gains of phase and period filter, errors are divided by them*/
+#define VSYNC_PHASE_GAIN 8
+#define VSYNC_PERIOD_GAIN 32
+/*filtered period is kept within this percent of nominal period*/
+#define VSYNC_PERIOD_TOLERANCE_PERCENT 10
+
+VsyncClock::VsyncClock()
+{
+    mValid = false;
+    mNominalPeriodUs = VSYNC_DEFAULT_PERIOD_US;
+    mPeriodUs = VSYNC_DEFAULT_PERIOD_US;
+    mSequence = 0;
+    mTimeUs = 0;
+}
+
+VsyncClock::~VsyncClock()
+{
+}
+
+void VsyncClock::setNominalPeriod(int64_t periodUs)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    if (periodUs <= 0 || periodUs == mNominalPeriodUs) {
+        return;
+    }
+    mNominalPeriodUs = periodUs;
+    mPeriodUs = periodUs;
+    mValid = false;
+}
+
+void VsyncClock::addVsync(int64_t timeUs)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    _addVsync(timeUs, mValid ? _sequenceOf(timeUs) : 0);
+}
+
+void VsyncClock::addVsync(int64_t timeUs, int64_t sequence)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    _addVsync(timeUs, sequence);
+}
+
+void VsyncClock::_addVsync(int64_t timeUs, int64_t sequence)
+{
+    int64_t seqDiff = sequence - mSequence;
+    double maxPeriod = mNominalPeriodUs * (100 + VSYNC_PERIOD_TOLERANCE_PERCENT) / 100.0;
+    double minPeriod = mNominalPeriodUs * (100 - VSYNC_PERIOD_TOLERANCE_PERCENT) / 100.0;
+
+    if (mValid) {
+        if (seqDiff <= 0) {
+            return;
+        }
+        double predictUs = mTimeUs + seqDiff * mPeriodUs;
+        double errUs = timeUs - predictUs;
+        if (fabs(errUs) < mPeriodUs / 2) {
+            //measured times have irq and scheduling jitter, keep the timeline smooth
+            mTimeUs = predictUs + errUs / VSYNC_PHASE_GAIN;
+            mPeriodUs += errUs / (seqDiff * VSYNC_PERIOD_GAIN);
+            if (mPeriodUs > maxPeriod) {
+                mPeriodUs = maxPeriod;
+            } else if (mPeriodUs < minPeriod) {
+                mPeriodUs = minPeriod;
+            }
+            mSequence = sequence;
+            return;
+        }
+        //phase jump, e.g. vsync was off or sequence restarted, lock again
+    }
+    mSequence = sequence;
+    mTimeUs = timeUs;
+    mValid = true;
+}
+
+void VsyncClock::reset()
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    mValid = false;
+}
+
+bool VsyncClock::isValid()
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    return mValid;
+}
+
+int64_t VsyncClock::getPeriodUs()
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    return (int64_t)(mPeriodUs + 0.5);
+}
+
+int64_t VsyncClock::_sequenceOf(int64_t timeUs)
+{
+    return mSequence + (int64_t)floor((timeUs - mTimeUs) / mPeriodUs + 0.5);
+}
+
+int64_t VsyncClock::getSequence(int64_t timeUs)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    return _sequenceOf(timeUs);
+}
+
+int64_t VsyncClock::getVsyncTime(int64_t sequence)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    return (int64_t)(mTimeUs + (sequence - mSequence) * mPeriodUs);
+}
+
+int64_t VsyncClock::getNextVsyncTime(int64_t timeUs)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    if (!mValid) {
+        return timeUs;
+    }
+    int64_t sequence = mSequence + (int64_t)floor((timeUs - mTimeUs) / mPeriodUs) + 1;
+    return (int64_t)(mTimeUs + (sequence - mSequence) * mPeriodUs);
+}
+
+int64_t VsyncClock::getLateVsyncCnt(int64_t frameTimeUs, int64_t presentTimeUs)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    if (!mValid) {
+        return 0;
+    }
+    int64_t presentSeq = mSequence + (int64_t)floor((presentTimeUs - mTimeUs) / mPeriodUs) + 1;
+    int64_t lateCnt = presentSeq - _sequenceOf(frameTimeUs);
+    return lateCnt > 0 ? lateCnt : 0;
+}
+
+}
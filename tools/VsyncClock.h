@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TOOLS_VSYNC_CLOCK_H_
+#define _TOOLS_VSYNC_CLOCK_H_
+#include <stdint.h>
+#include "Mutex.h"
+
+namespace Tls {
+
+/**
+ * default vsync period when display refresh rate is unknown
+ */
+#define VSYNC_DEFAULT_PERIOD_US 16667
+
+/**
+ * phase locked model of display vsync timeline.
+ * vsync timestamps from any source (drm vblank, compositor
+ * frame callbacks, videotunnel) are filtered into a phase and
+ * a period, then future vsyncs are predicted from them.
+ * a sequence is the count of vsyncs from an arbitrary origin,
+ * sources without hardware sequence get one by rounding.
+ * all times are monotonic us, it is thread safe
+ */
+class VsyncClock {
+  public:
+    VsyncClock();
+    virtual ~VsyncClock();
+    /**
+     * set the nominal vsync period, e.g. from refresh rate,
+     * the estimation restarts if it changes
+     */
+    void setNominalPeriod(int64_t periodUs);
+    /**
+     * feed a measured vsync time, its sequence is the
+     * nearest one predicted by current model
+     */
+    void addVsync(int64_t timeUs);
+    /**
+     * feed a measured vsync time with its hardware sequence
+     */
+    void addVsync(int64_t timeUs, int64_t sequence);
+    /**
+     * drop the phase, period is kept
+     */
+    void reset();
+    /**
+     * true if a vsync had been fed, predictions are meaningful
+     */
+    bool isValid();
+    /**
+     * filtered vsync period
+     */
+    int64_t getPeriodUs();
+    /**
+     * sequence of the vsync nearest to timeUs
+     */
+    int64_t getSequence(int64_t timeUs);
+    /**
+     * predicted time of vsync sequence
+     */
+    int64_t getVsyncTime(int64_t sequence);
+    /**
+     * predicted time of the first vsync later than timeUs,
+     * timeUs if model is not valid
+     */
+    int64_t getNextVsyncTime(int64_t timeUs);
+    /**
+     * count of vsyncs a frame with display time frameTimeUs is late by,
+     * if the earliest vsync it can show at is the first one after presentTimeUs,
+     * 0 if it is not late or model is not valid
+     */
+    int64_t getLateVsyncCnt(int64_t frameTimeUs, int64_t presentTimeUs);
+  private:
+    int64_t _sequenceOf(int64_t timeUs);
+    void _addVsync(int64_t timeUs, int64_t sequence);
+
+    mutable Tls::Mutex mMutex;
+    bool mValid;
+    int64_t mNominalPeriodUs;
+    double mPeriodUs; //filtered period
+    //phase reference, vsync mSequence is at mTimeUs
+    int64_t mSequence;
+    double mTimeUs;
+};
+
+}
+
+#endif /*_TOOLS_VSYNC_CLOCK_H_*/
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * decode frame record files written by Tls::FrameRecorder to csv or json,
+ * it runs on host, the file is read as little endian like the device wrote
+ *
+ * usage: frame_record_decode [-j] file.frec [out]
+ *   -j  output json array instead of csv
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "FrameRecorder.h"
+
+using namespace Tls;
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-j] file.frec [out]\n", name);
+    fprintf(stderr, "  -j  output json instead of csv\n");
+}
+
+static const char *eventName(const FrameRecordHeader *header, uint32_t event, char *buf, size_t size)
+{
+    if (event < header->eventCnt && header->eventNames[event][0]) {
+        snprintf(buf, size, "%.*s", FRAME_RECORD_EVENT_NAME_LEN, header->eventNames[event]);
+    } else {
+        snprintf(buf, size, "%u", event);
+    }
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    const char *inPath = NULL;
+    const char *outPath = NULL;
+    FrameRecordHeader header;
+    std::vector<FrameRecord> records;
+    FILE *in;
+    FILE *out = stdout;
+    uint64_t start;
+    uint64_t end;
+    char name[FRAME_RECORD_EVENT_NAME_LEN + 1];
+    int cnt = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            json = true;
+        } else if (!inPath) {
+            inPath = argv[i];
+        } else if (!outPath) {
+            outPath = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!inPath) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    in = fopen(inPath, "rb");
+    if (!in) {
+        fprintf(stderr, "open %s fail\n", inPath);
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, FRAME_RECORD_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s is not a frame record file\n", inPath);
+        fclose(in);
+        return 1;
+    }
+    if (header.version != FRAME_RECORD_VERSION || header.headerSize != sizeof(FrameRecordHeader) ||
+        header.recordSize != sizeof(FrameRecord) || header.capacity == 0) {
+        fprintf(stderr, "unsupported frame record version %u,header %u,record %u\n",
+            header.version, header.headerSize, header.recordSize);
+        fclose(in);
+        return 1;
+    }
+    records.resize(header.capacity);
+    //a truncated file decodes the records it has
+    size_t readCnt = fread(records.data(), sizeof(FrameRecord), header.capacity, in);
+    fclose(in);
+    records.resize(readCnt);
+
+    if (outPath) {
+        out = fopen(outPath, "w");
+        if (!out) {
+            fprintf(stderr, "open %s fail\n", outPath);
+            return 1;
+        }
+    }
+
+    end = header.writeIndex;
+    start = end > header.capacity ? end - header.capacity : 0;
+    if (json) {
+        fprintf(out, "{\"pid\":%d,\"instance\":%d,\"startMonotonicUs\":%lld,\"startRealtimeUs\":%lld,\"records\":[\n",
+            header.pid, header.instanceId, (long long)header.startMonotonicUs, (long long)header.startRealtimeUs);
+    } else {
+        fprintf(out, "index,time_us,realtime_us,pid,instance,tid,event,pts_ns,buffer_id,display_time_us,vblank_time_us\n");
+    }
+    for (uint64_t i = start; i < end; i++) {
+        uint64_t slot = i % header.capacity;
+        if (slot >= records.size()) {
+            continue;
+        }
+        const FrameRecord *r = &records[slot];
+        //being written or overwritten when file was copied
+        if (r->seq != i + 1) {
+            continue;
+        }
+        long long realtime = (long long)(r->time - header.startMonotonicUs + header.startRealtimeUs);
+        eventName(&header, r->event, name, sizeof(name));
+        if (json) {
+            fprintf(out, "%s{\"index\":%llu,\"time\":%lld,\"realtime\":%lld,\"tid\":%u,\"event\":\"%s\",\"pts\":%lld,\"bufferId\":%d,\"displayTime\":%lld,\"vblankTime\":%lld}",
+                cnt > 0 ? ",\n" : "", (unsigned long long)i, (long long)r->time, realtime, r->tid, name,
+                (long long)r->pts, r->bufferId, (long long)r->displayTime, (long long)r->vblankTime);
+        } else {
+            fprintf(out, "%llu,%lld,%lld,%d,%d,%u,%s,%lld,%d,%lld,%lld\n",
+                (unsigned long long)i, (long long)r->time, realtime, header.pid, header.instanceId, r->tid, name,
+                (long long)r->pts, r->bufferId, (long long)r->displayTime, (long long)r->vblankTime);
+        }
+        ++cnt;
+    }
+    if (json) {
+        fprintf(out, "\n]}\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    fprintf(stderr, "%d records decoded, %llu written in total\n", cnt, (unsigned long long)header.writeIndex);
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * benchmark Tls::PixelConverter per format and resolution, it runs the
+ * c kernels and the simd kernels on the same random frames, checks both
+ * give the same pixels and prints ms per frame of each
+ *
+ * usage: pixel_convert_bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "PixelConverter.h"
+#include "ErrorCode.h"
+
+using namespace Tls;
+
+struct BenchFormat {
+    RenderVideoFormat format;
+    const char *name;
+};
+
+struct BenchSize {
+    int width;
+    int height;
+};
+
+static const BenchFormat kFormats[] = {
+    {VIDEO_FORMAT_I420, "I420"},
+    {VIDEO_FORMAT_YV12, "YV12"},
+    {VIDEO_FORMAT_NV12, "NV12"},
+    {VIDEO_FORMAT_NV21, "NV21"},
+    {VIDEO_FORMAT_YUY2, "YUY2"},
+    {VIDEO_FORMAT_UYVY, "UYVY"},
+};
+
+//odd sizes exercise the scalar tails of the simd kernels
+static const BenchSize kSizes[] = {
+    {640, 480},
+    {1280, 720},
+    {1920, 1080},
+    {3840, 2160},
+    {1917, 1079},
+};
+
+static double nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static double runConvert(const BenchFormat &f, const std::vector<uint8_t> &src, const PixelLayout &srcLayout,
+                         std::vector<uint8_t> &dst, const PixelLayout &dstLayout,
+                         int width, int height, int iterations)
+{
+    double start = nowMs();
+    for (int i = 0; i < iterations; i++) {
+        if (PixelConverter::convert(f.format, src.data(), &srcLayout,
+                VIDEO_FORMAT_BGRx, dst.data(), &dstLayout, width, height) != NO_ERROR) {
+            return -1;
+        }
+    }
+    return (nowMs() - start) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    int failed = 0;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    printf("simd:%s iterations:%d\n", PixelConverter::getSimdName(), iterations);
+    printf("%-6s %11s %10s %10s %8s %s\n", "format", "size", "c(ms)", "simd(ms)", "speedup", "check");
+    for (size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); s++) {
+        int width = kSizes[s].width;
+        int height = kSizes[s].height;
+        PixelLayout dstLayout;
+        PixelConverter::getLayout(VIDEO_FORMAT_BGRx, width, height, 4, &dstLayout);
+        std::vector<uint8_t> ref(dstLayout.size);
+        std::vector<uint8_t> out(dstLayout.size);
+
+        for (size_t i = 0; i < sizeof(kFormats) / sizeof(kFormats[0]); i++) {
+            const BenchFormat &f = kFormats[i];
+            PixelLayout srcLayout;
+            if (PixelConverter::getLayout(f.format, width, height, 1, &srcLayout) != NO_ERROR) {
+                printf("%-6s no layout\n", f.name);
+                failed++;
+                continue;
+            }
+            std::vector<uint8_t> src(srcLayout.size);
+            for (size_t n = 0; n < src.size(); n++) {
+                src[n] = rand() & 0xff;
+            }
+
+            PixelConverter::setSimdEnabled(false);
+            double cMs = runConvert(f, src, srcLayout, ref, dstLayout, width, height, iterations);
+            PixelConverter::setSimdEnabled(true);
+            double simdMs = runConvert(f, src, srcLayout, out, dstLayout, width, height, iterations);
+
+            bool same = cMs >= 0 && simdMs >= 0 && memcmp(ref.data(), out.data(), ref.size()) == 0;
+            if (!same) {
+                failed++;
+            }
+            printf("%-6s %5dx%-5d %10.3f %10.3f %7.2fx %s\n", f.name, width, height,
+                   cMs, simdMs, simdMs > 0 ? cMs / simdMs : 0.0, same ? "ok" : "MISMATCH");
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -43,6 +43,9 @@ VideoTunnelImpl::VideoTunnelImpl(VideoTunnelPlugin *plugin, int logcategory)
     mFrameWidth = 0;
     mFrameHeight = 0;
     mUnderFlowDetect = false;
+    mLastVsyncTimestamp = 0;
+    mVsyncClock = new Tls::VsyncClock();
+    mLateFrameFilter = new Tls::LateFrameFilter(mVsyncClock);
     mPoll = new Tls::Poll(true);
 }
 
@@ -52,6 +55,14 @@ VideoTunnelImpl::~VideoTunnelImpl()
         delete mPoll;
         mPoll = NULL;
     }
+    if (mLateFrameFilter) {
+        delete mLateFrameFilter;
+        mLateFrameFilter = NULL;
+    }
+    if (mVsyncClock) {
+        delete mVsyncClock;
+        mVsyncClock = NULL;
+    }
 }
 
 bool VideoTunnelImpl::init()
@@ -136,38 +147,91 @@ bool VideoTunnelImpl::disconnect()
     for (auto item = mQueueRenderBufferMap.begin(); item != mQueueRenderBufferMap.end(); ) {
         RenderBuffer *renderbuffer = (RenderBuffer*) item->second;
         mQueueRenderBufferMap.erase(item++);
-        mPlugin->handleFrameDropped(renderbuffer);
+        mPlugin->handleFrameDropped(renderbuffer, PLUGIN_DROP_REASON_FLUSH);
         mPlugin->handleBufferRelease(renderbuffer);
     }
     DEBUG(mLogCategory,"out");
     return true;
 }
 
-bool VideoTunnelImpl::displayFrame(RenderBuffer *buf, int64_t displayTime)
+void VideoTunnelImpl::startIfNeeded()
 {
-    int ret;
     if (mStarted == false) {
         DEBUG(mLogCategory,"to run VideoTunnelImpl");
         run("VideoTunnelImpl");
         mStarted = true;
         mSignalFirstFrameDiplayed = true;
     }
+}
+
+bool VideoTunnelImpl::isLateFrame(RenderBuffer *buf, int64_t displayTime)
+{
+    //drop a hopelessly late frame before it is queued to videotunnel
+    if (mLateFrameFilter->isHopeless(displayTime, Tls::Times::getSystemTimeUs())) {
+        DEBUG(mLogCategory,"drop late frame,displaytime:%lld(pts:%lld ms)",displayTime,buf->pts/1000000);
+        mPlugin->handleFrameDropped(buf, PLUGIN_DROP_REASON_LATE);
+        mPlugin->handleBufferRelease(buf);
+        return true;
+    }
+    return false;
+}
 
+void VideoTunnelImpl::queueFrame(RenderBuffer *buf, int64_t displayTime)
+{
+    int ret = -1;
     int fd0 = buf->dma.fd[0];
+
+    /*store frame before it is queued, the dequeue thread can get it
+     back from videotunnel as soon as it is queued*/
+    std::pair<int, RenderBuffer *> item(fd0, buf);
+    mQueueRenderBufferMap.insert(item);
     //leng.fang suggest fence id set -1
     if (mVideotunnelLib && mVideotunnelLib->vtQueueBuffer) {
         ret = mVideotunnelLib->vtQueueBuffer(mFd, mInstanceId, fd0, -1 /*fence_fd*/, displayTime);
-        if (mUnderFlowDetect) {
-            mUnderFlowDetect = false;
-        }
     }
-
-    Tls::Mutex::Autolock _l(mMutex);
-    std::pair<int, RenderBuffer *> item(fd0, buf);
-    mQueueRenderBufferMap.insert(item);
+    if (ret != 0) {
+        ERROR(mLogCategory,"queue buffer fail,fd:%d,ret:%d",fd0,ret);
+        mQueueRenderBufferMap.erase(fd0);
+        mPlugin->handleFrameDropped(buf, PLUGIN_DROP_REASON_ERROR);
+        mPlugin->handleBufferRelease(buf);
+        return;
+    }
+    if (mUnderFlowDetect) {
+        mUnderFlowDetect = false;
+    }
     ++mQueueFrameCnt;
+    mPlugin->getFrameMonitor()->traceFrame(buf, PLUGIN_FRAME_STAGE_QUEUED);
     TRACE(mLogCategory,"***fd:%d,w:%d,h:%d,displaytime:%lld,commitCnt:%d",buf->dma.fd[0],buf->dma.width,buf->dma.height,displayTime,mQueueFrameCnt);
-    mPlugin->handleFrameDisplayed(buf);
+    mPlugin->getFrameMonitor()->queueDepth(mQueueFrameCnt);
+}
+
+bool VideoTunnelImpl::displayFrame(RenderBuffer *buf, int64_t displayTime)
+{
+    startIfNeeded();
+
+    if (isLateFrame(buf, displayTime)) {
+        return true;
+    }
+
+    Tls::Mutex::Autolock _l(mMutex);
+    queueFrame(buf, displayTime);
+    mLastDisplayTime = Tls::Times::getSystemTimeMs();
+    return true;
+}
+
+bool VideoTunnelImpl::displayFrames(RenderBuffer **bufs, int64_t *displayTimes, int count)
+{
+    startIfNeeded();
+
+    //videotunnel has no batch queue ioctl, frames are queued one by one
+    //under one lock
+    Tls::Mutex::Autolock _l(mMutex);
+    for (int i = 0; i < count; i++) {
+        if (isLateFrame(bufs[i], displayTimes[i])) {
+            continue;
+        }
+        queueFrame(bufs[i], displayTimes[i]);
+    }
     mLastDisplayTime = Tls::Times::getSystemTimeMs();
     return true;
 }
@@ -182,10 +246,11 @@ void VideoTunnelImpl::flush()
     for (auto item = mQueueRenderBufferMap.begin(); item != mQueueRenderBufferMap.end(); ) {
         RenderBuffer *renderbuffer = (RenderBuffer*) item->second;
         mQueueRenderBufferMap.erase(item++);
-        mPlugin->handleFrameDropped(renderbuffer);
+        mPlugin->handleFrameDropped(renderbuffer, PLUGIN_DROP_REASON_FLUSH);
         mPlugin->handleBufferRelease(renderbuffer);
     }
     mQueueFrameCnt = 0;
+    mLateFrameFilter->reset();
     DEBUG(mLogCategory,"after flush,commitCnt:%d",mQueueFrameCnt);
 }
 
@@ -221,6 +286,28 @@ void VideoTunnelImpl::waitFence(int fence) {
     }
 }
 
+void VideoTunnelImpl::updateVsyncClock()
+{
+    int ret = -1;
+    uint64_t timestamp = 0;
+    uint32_t period = 0;
+
+    if (mVideotunnelLib && mVideotunnelLib->vtGetDisplayVsyncAndPeriod) {
+        ret = mVideotunnelLib->vtGetDisplayVsyncAndPeriod(mFd, mInstanceId, &timestamp, &period);
+    }
+    if (ret != 0 || timestamp == 0 || timestamp == mLastVsyncTimestamp) {
+        return;
+    }
+    mLastVsyncTimestamp = timestamp;
+
+    //videotunnel reports both in ns
+    int64_t timeUs = (int64_t)(timestamp / 1000);
+    int64_t periodUs = period / 1000;
+    TRACE(mLogCategory,"display vsync:%lld us,period:%lld us",timeUs,periodUs);
+    mVsyncClock->setNominalPeriod(periodUs);
+    mVsyncClock->addVsync(timeUs);
+}
+
 void VideoTunnelImpl::readyToRun()
 {
     struct vt_rect rect;
@@ -274,6 +361,7 @@ bool VideoTunnelImpl::threadLoop()
 
     //send uvm fd to driver after getted fence
     waitFence(fenceId);
+    updateVsyncClock();
 
     {
         Tls::Mutex::Autolock _l(mMutex);
@@ -294,6 +382,10 @@ bool VideoTunnelImpl::threadLoop()
         INFO(mLogCategory,"send first frame displayed msg");
         mPlugin->handleMsgNotify(MSG_FIRST_FRAME,(void*)&buffer->pts);
     }
+    /*videotunnel has no per frame present event, a frame is given back
+     after it was shown, so take the display vsync got at dequeue as
+     its present time*/
+    mPlugin->handleFrameDisplayed(buffer, (int64_t)(mLastVsyncTimestamp / 1000));
     mPlugin->handleBufferRelease(buffer);
     return true;
 }
\ No newline at end of file
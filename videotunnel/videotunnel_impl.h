@@ -19,6 +19,8 @@
 #include "Mutex.h"
 #include "Thread.h"
 #include "Poll.h"
+#include "VsyncClock.h"
+#include "LateFrameFilter.h"
 #include "videotunnel_lib_wrap.h"
 
 class VideoTunnelPlugin;
@@ -33,6 +35,7 @@ class VideoTunnelImpl : public Tls::Thread
     bool connect();
     bool disconnect();
     bool displayFrame(RenderBuffer *buf, int64_t displayTime);
+    bool displayFrames(RenderBuffer **bufs, int64_t *displayTimes, int count);
     void flush();
     void setFrameSize(int width, int height);
     void setVideotunnelId(int id);
@@ -46,6 +49,14 @@ class VideoTunnelImpl : public Tls::Thread
     virtual bool threadLoop();
   private:
     void waitFence(int fence);
+    //run dequeue thread when the first frame comes
+    void startIfNeeded();
+    //drop and release buffer if it is hopelessly late
+    bool isLateFrame(RenderBuffer *buf, int64_t displayTime);
+    //storage frame and queue it to videotunnel, mMutex must be held
+    void queueFrame(RenderBuffer *buf, int64_t displayTime);
+    //query display vsync from videotunnel consumer and feed vsync clock
+    void updateVsyncClock();
     VideoTunnelPlugin *mPlugin;
     mutable Tls::Mutex mMutex;
     VideotunnelLib *mVideotunnelLib;
@@ -68,6 +79,11 @@ class VideoTunnelImpl : public Tls::Thread
     int64_t mLastDisplayTime;
     bool mSignalFirstFrameDiplayed;
     bool mUnderFlowDetect;
+    //display vsync timeline reported by videotunnel consumer
+    Tls::VsyncClock *mVsyncClock;
+    //drops hopelessly late frames in displayFrame
+    Tls::LateFrameFilter *mLateFrameFilter;
+    uint64_t mLastVsyncTimestamp;
 };
 
 #endif /*__VIDEO_TUNNEL_IMPLEMENT_H__*/
\ No newline at end of file
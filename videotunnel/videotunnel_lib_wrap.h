@@ -29,6 +29,7 @@ typedef int (*vt_queue_buffer)(int fd, int tunnel_id, int buffer_fd, int fence_f
 typedef int (*vt_dequeue_buffer)(int fd, int tunnel_id, int *buffer_fd, int *fence_fd);
 typedef int (*vt_cancel_buffer)(int fd, int tunnel_id);
 typedef int (*vt_set_sourceCrop)(int fd, int tunnel_id, struct vt_rect rect);
+/*timestamp is the latest display vsync in CLOCK_MONOTONIC ns, period is in ns*/
 typedef int (*vt_getDisplayVsyncAndPeriod)(int fd, int tunnel_id, uint64_t *timestamp, uint32_t *period);
 
 /* for video cmd */
@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <unistd.h>
 #include "videotunnel_plugin.h"
 #include "Logger.h"
 #include "video_tunnel.h"
@@ -29,6 +30,7 @@ VideoTunnelPlugin::VideoTunnelPlugin(int logCategory)
     mWinRect.y = 0;
     mWinRect.w = 0;
     mWinRect.h = 0;
+    mFrameMonitor = new Tls::FrameMonitor(mLogCategory);
     mVideoTunnel = new VideoTunnelImpl(this,logCategory);
 }
 
@@ -38,6 +40,10 @@ VideoTunnelPlugin::~VideoTunnelPlugin()
         delete mVideoTunnel;
         mVideoTunnel = NULL;
     }
+    if (mFrameMonitor) {
+        delete mFrameMonitor;
+        mFrameMonitor = NULL;
+    }
 }
 
 void VideoTunnelPlugin::init()
@@ -101,10 +107,20 @@ int VideoTunnelPlugin::prepareFrame(RenderBuffer *buffer)
 
 int VideoTunnelPlugin::displayFrame(RenderBuffer *buffer, int64_t displayTime)
 {
+    mFrameMonitor->frameEntered(buffer, displayTime);
     mVideoTunnel->displayFrame(buffer, displayTime);
     return NO_ERROR;
 }
 
+int VideoTunnelPlugin::displayFrames(RenderBuffer **buffers, int64_t *displayTimes, int count)
+{
+    for (int i = 0; i < count; i++) {
+        mFrameMonitor->frameEntered(buffers[i], displayTimes[i]);
+    }
+    mVideoTunnel->displayFrames(buffers, displayTimes, count);
+    return NO_ERROR;
+}
+
 int VideoTunnelPlugin::flush()
 {
     mVideoTunnel->flush();
@@ -134,6 +150,9 @@ int VideoTunnelPlugin::closeWindow()
 
 int VideoTunnelPlugin::getValue(PluginKey key, void *value)
 {
+    if (mFrameMonitor->getValue(key, value)) {
+        return NO_ERROR;
+    }
     switch (key) {
         case PLUGIN_KEY_VIDEOTUNNEL_ID: {
             mVideoTunnel->getVideotunnelId((int *)value);
@@ -145,6 +164,9 @@ int VideoTunnelPlugin::getValue(PluginKey key, void *value)
 
 int VideoTunnelPlugin::setValue(PluginKey key, void *value)
 {
+    if (mFrameMonitor->setValue(key, value)) {
+        return NO_ERROR;
+    }
     switch (key) {
         case PLUGIN_KEY_WINDOW_SIZE: {
             RenderRect* rect = static_cast<RenderRect*>(value);
@@ -180,20 +202,23 @@ int VideoTunnelPlugin::setValue(PluginKey key, void *value)
 
 void VideoTunnelPlugin::handleBufferRelease(RenderBuffer *buffer)
 {
+    mFrameMonitor->frameReleased(buffer);
     if (mCallback) {
         mCallback->doBufferReleaseCallback(mUserData, (void *)buffer);
     }
 }
 
-void VideoTunnelPlugin::handleFrameDisplayed(RenderBuffer *buffer)
+void VideoTunnelPlugin::handleFrameDisplayed(RenderBuffer *buffer, int64_t presentTime)
 {
+    mFrameMonitor->frameDisplayed(buffer, presentTime);
     if (mCallback) {
         mCallback->doBufferDisplayedCallback(mUserData, (void *)buffer);
     }
 }
 
-void VideoTunnelPlugin::handleFrameDropped(RenderBuffer *buffer)
+void VideoTunnelPlugin::handleFrameDropped(RenderBuffer *buffer, PluginDropReason reason)
 {
+    mFrameMonitor->frameDropped(buffer, reason);
     if (mCallback) {
         mCallback->doBufferDropedCallback(mUserData, (void *)buffer);
     }
@@ -18,6 +18,7 @@
 #include "render_plugin.h"
 #include "videotunnel_impl.h"
 #include "Mutex.h"
+#include "FrameMonitor.h"
 
 class VideoTunnelPlugin : public RenderPlugin
 {
@@ -31,6 +32,7 @@ class VideoTunnelPlugin : public RenderPlugin
     virtual int openWindow();
     virtual int prepareFrame(RenderBuffer *buffer);
     virtual int displayFrame(RenderBuffer *buffer, int64_t displayTime);
+    virtual int displayFrames(RenderBuffer **buffers, int64_t *displayTimes, int count);
     virtual int flush();
     virtual int pause();
     virtual int resume();
@@ -40,12 +42,16 @@ class VideoTunnelPlugin : public RenderPlugin
     virtual int setValue(PluginKey key, void *value);
     //buffer release callback
     virtual void handleBufferRelease(RenderBuffer *buffer);
-    //buffer had displayed ,but not release
-    virtual void handleFrameDisplayed(RenderBuffer *buffer);
+    //buffer had displayed ,but not release,presentTime is monotonic time it showed,us
+    virtual void handleFrameDisplayed(RenderBuffer *buffer, int64_t presentTime);
     //buffer droped callback
-    virtual void handleFrameDropped(RenderBuffer *buffer);
+    virtual void handleFrameDropped(RenderBuffer *buffer, PluginDropReason reason);
     //plugin msg callback
     void handleMsgNotify(int type, void *detail);
+    //per frame trace,statistics and record
+    Tls::FrameMonitor *getFrameMonitor() {
+        return mFrameMonitor;
+    };
     int getLogCategory() {
         return mLogCategory;
     };
@@ -59,6 +65,7 @@ class VideoTunnelPlugin : public RenderPlugin
     mutable Tls::Mutex mDisplayLock;
     mutable Tls::Mutex mRenderLock;
     void *mUserData;
+    Tls::FrameMonitor *mFrameMonitor;
 };
 
 
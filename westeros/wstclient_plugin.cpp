@@ -13,11 +13,13 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <unistd.h>
 #include <linux/videodev2.h>
 #include "wstclient_wayland.h"
 #include "wstclient_plugin.h"
 #include "Logger.h"
 #include "ErrorCode.h"
+#include "Times.h"
 
 #define TAG  "rlib:wstClient_plugin"
 #define DEFAULT_VIDEO_SERVER "video"
@@ -45,6 +47,9 @@ WstClientPlugin::WstClientPlugin(int logCategory)
     mFrameRateFractionNum = 0;
     mFrameRateFractionDenom = 0;
     mFrameRateChanged = false;
+    mFrameMonitor = new Tls::FrameMonitor(mLogCategory);
+    mVsyncClock = new Tls::VsyncClock();
+    mLateFrameFilter = new Tls::LateFrameFilter(mVsyncClock);
     mWstEssRMgrOps = new WstEssRMgrOps(logCategory);
     mWstEssRMgrOps->setCallback(WstClientPlugin::essMgrCallback, this);
 }
@@ -59,6 +64,18 @@ WstClientPlugin::~WstClientPlugin()
         delete mWstEssRMgrOps;
         mWstEssRMgrOps = NULL;
     }
+    if (mLateFrameFilter) {
+        delete mLateFrameFilter;
+        mLateFrameFilter = NULL;
+    }
+    if (mVsyncClock) {
+        delete mVsyncClock;
+        mVsyncClock = NULL;
+    }
+    if (mFrameMonitor) {
+        delete mFrameMonitor;
+        mFrameMonitor = NULL;
+    }
 
     TRACE(mLogCategory,"deconstruct");
 }
@@ -186,81 +203,162 @@ int WstClientPlugin::prepareFrame(RenderBuffer *buffer)
     return NO_ERROR;
 }
 
-int WstClientPlugin::displayFrame(RenderBuffer *buffer, int64_t displayTime)
+void WstClientPlugin::fillBufferInfo(RenderBuffer *buffer, int64_t displayTime, WstBufferInfo *wstBufferInfo)
 {
-    bool ret;
-    WstBufferInfo wstBufferInfo;
-    WstRect wstRect;
-    int x,y,w,h;
-
-    if (mWstClientSocket && mFrameRateChanged) {
-        mFrameRateChanged = false;
-        mWstClientSocket->sendRateVideoClientConnection(mFrameRateFractionNum, mFrameRateFractionDenom);
-    }
-
-    mWayland->getVideoBounds(&x, &y, &w, &h);
-
     //init wstBufferInfo,must set fd to -1 value
-    memset(&wstBufferInfo, 0, sizeof(WstBufferInfo));
+    memset(wstBufferInfo, 0, sizeof(WstBufferInfo));
     for (int i = 0; i < WST_MAX_PLANES; i++) {
-        wstBufferInfo.planeInfo[0].fd = -1;
-        wstBufferInfo.planeInfo[1].fd = -1;
-        wstBufferInfo.planeInfo[2].fd = -1;
+        wstBufferInfo->planeInfo[i].fd = -1;
     }
 
-    wstBufferInfo.bufferId = buffer->id;
-    wstBufferInfo.planeCount = buffer->dma.planeCnt;
+    wstBufferInfo->bufferId = buffer->id;
+    wstBufferInfo->planeCount = buffer->dma.planeCnt;
     TRACE(mLogCategory,"buffer width:%d,height:%d",buffer->dma.width,buffer->dma.height);
     for (int i = 0; i < buffer->dma.planeCnt; i++) {
-        wstBufferInfo.planeInfo[i].fd = buffer->dma.fd[i];
-        wstBufferInfo.planeInfo[i].stride = buffer->dma.stride[i];
-        wstBufferInfo.planeInfo[i].offset = buffer->dma.offset[i];
+        wstBufferInfo->planeInfo[i].fd = buffer->dma.fd[i];
+        wstBufferInfo->planeInfo[i].stride = buffer->dma.stride[i];
+        wstBufferInfo->planeInfo[i].offset = buffer->dma.offset[i];
         DEBUG(mLogCategory,"buffer id:%d,plane[%d],fd:%d,stride:%d,offset:%d",buffer->id,i,buffer->dma.fd[i],buffer->dma.stride[i],buffer->dma.offset[i]);
     }
 
-    wstBufferInfo.frameWidth = buffer->dma.width;
-    wstBufferInfo.frameHeight = buffer->dma.height;
-    wstBufferInfo.frameTime = displayTime;
+    wstBufferInfo->frameWidth = buffer->dma.width;
+    wstBufferInfo->frameHeight = buffer->dma.height;
+    wstBufferInfo->frameTime = displayTime;
 
     //change render lib video format to v4l2 support format
     if (mBufferFormat == VIDEO_FORMAT_NV12) {
-        wstBufferInfo.pixelFormat = V4L2_PIX_FMT_NV12;
+        wstBufferInfo->pixelFormat = V4L2_PIX_FMT_NV12;
     } else if (mBufferFormat == VIDEO_FORMAT_NV21) {
-        wstBufferInfo.pixelFormat = V4L2_PIX_FMT_NV21;
+        wstBufferInfo->pixelFormat = V4L2_PIX_FMT_NV21;
     } else {
         ERROR(mLogCategory,"unknown video buffer format:%d",mBufferFormat);
     }
+}
 
-    wstRect.x = x;
-    wstRect.y = y;
-    wstRect.w = w;
-    wstRect.h = h;
+void WstClientPlugin::prepareSendFrames(WstRect *wstRect)
+{
+    int x,y,w,h;
 
-    if (mWstClientSocket) {
-        ret = mWstClientSocket->sendFrameVideoClientConnection(&wstBufferInfo, &wstRect);
-        if (!ret) {
-            ERROR(mLogCategory,"send video frame to server fail");
-            handleFrameDropped(buffer);
-            handleBufferRelease(buffer);
-            return ERROR_FAILED_TRANSACTION;
-        }
+    if (mWstClientSocket && mFrameRateChanged) {
+        mFrameRateChanged = false;
+        mWstClientSocket->sendRateVideoClientConnection(mFrameRateFractionNum, mFrameRateFractionDenom);
+    }
+
+    mWayland->getVideoBounds(&x, &y, &w, &h);
+    wstRect->x = x;
+    wstRect->y = y;
+    wstRect->w = w;
+    wstRect->h = h;
+}
+
+bool WstClientPlugin::isLateFrame(RenderBuffer *buffer, int64_t displayTime)
+{
+    //drop a hopelessly late frame before it is sent to video server
+    if (!mImmediatelyOutput &&
+        mLateFrameFilter->isHopeless(displayTime, Tls::Times::getSystemTimeUs())) {
+        DEBUG(mLogCategory,"drop late frame,display time:%lld(pts:%lld ms)",displayTime,buffer->pts/1000000);
+        handleFrameDropped(buffer, PLUGIN_DROP_REASON_LATE);
+        handleBufferRelease(buffer);
+        return true;
     }
+    return false;
+}
 
+void WstClientPlugin::commitFrame(RenderBuffer *buffer, int64_t displayTime)
+{
+    mFrameMonitor->traceFrame(buffer, PLUGIN_FRAME_STAGE_QUEUED);
     //storage render buffer to manager
-    std::lock_guard<std::mutex> lck(mRenderLock);
     std::pair<int, RenderBuffer *> item(buffer->id, buffer);
     mRenderBuffersMap.insert(item);
     ++mCommitFrameCnt;
     ++mReadyDisplayFrameCnt;
     TRACE(mLogCategory,"committed to westeros cnt:%d,readyDisplayFramesCnt:%d",mCommitFrameCnt,mReadyDisplayFrameCnt);
+    mFrameMonitor->queueDepth(mReadyDisplayFrameCnt);
 
     //storage displayed render buffer
     std::pair<int, int64_t> displayitem(buffer->id, displayTime);
     mDisplayedFrameMap.insert(displayitem);
+}
+
+int WstClientPlugin::displayFrame(RenderBuffer *buffer, int64_t displayTime)
+{
+    bool ret;
+    WstBufferInfo wstBufferInfo;
+    WstRect wstRect;
+
+    mFrameMonitor->frameEntered(buffer, displayTime);
+    if (isLateFrame(buffer, displayTime)) {
+        return NO_ERROR;
+    }
+
+    prepareSendFrames(&wstRect);
+    fillBufferInfo(buffer, displayTime, &wstBufferInfo);
+
+    if (mWstClientSocket) {
+        ret = mWstClientSocket->sendFrameVideoClientConnection(&wstBufferInfo, &wstRect);
+        if (!ret) {
+            ERROR(mLogCategory,"send video frame to server fail");
+            handleFrameDropped(buffer, PLUGIN_DROP_REASON_ERROR);
+            handleBufferRelease(buffer);
+            return ERROR_FAILED_TRANSACTION;
+        }
+    }
+
+    std::lock_guard<std::mutex> lck(mRenderLock);
+    commitFrame(buffer, displayTime);
 
     return NO_ERROR;
 }
 
+int WstClientPlugin::displayFrames(RenderBuffer **buffers, int64_t *displayTimes, int count)
+{
+    WstBufferInfo wstBufferInfos[WST_MAX_BATCH_FRAMES];
+    RenderBuffer *sendBuffers[WST_MAX_BATCH_FRAMES];
+    int64_t sendTimes[WST_MAX_BATCH_FRAMES];
+    WstRect wstRect;
+    int sendCnt;
+    int sentCnt;
+    int ret = NO_ERROR;
+    int i = 0;
+
+    prepareSendFrames(&wstRect);
+    while (i < count) {
+        //one sendmmsg per WST_MAX_BATCH_FRAMES frames
+        sendCnt = 0;
+        for (; i < count && sendCnt < WST_MAX_BATCH_FRAMES; i++) {
+            mFrameMonitor->frameEntered(buffers[i], displayTimes[i]);
+            if (isLateFrame(buffers[i], displayTimes[i])) {
+                continue;
+            }
+            fillBufferInfo(buffers[i], displayTimes[i], &wstBufferInfos[sendCnt]);
+            sendBuffers[sendCnt] = buffers[i];
+            sendTimes[sendCnt] = displayTimes[i];
+            ++sendCnt;
+        }
+        if (sendCnt == 0) {
+            continue;
+        }
+
+        sentCnt = sendCnt;
+        if (mWstClientSocket) {
+            sentCnt = mWstClientSocket->sendFramesVideoClientConnection(wstBufferInfos, &wstRect, sendCnt);
+        }
+        for (int j = sentCnt; j < sendCnt; j++) {
+            ERROR(mLogCategory,"send video frame to server fail");
+            handleFrameDropped(sendBuffers[j], PLUGIN_DROP_REASON_ERROR);
+            handleBufferRelease(sendBuffers[j]);
+            ret = ERROR_FAILED_TRANSACTION;
+        }
+
+        std::lock_guard<std::mutex> lck(mRenderLock);
+        for (int j = 0; j < sentCnt; j++) {
+            commitFrame(sendBuffers[j], sendTimes[j]);
+        }
+    }
+
+    return ret;
+}
+
 int WstClientPlugin::flush()
 {
     int ret;
@@ -268,6 +366,7 @@ int WstClientPlugin::flush()
     if (mWstClientSocket) {
         mWstClientSocket->sendFlushVideoClientConnection(mKeepLastFrameOnFlush.value);
     }
+    mLateFrameFilter->reset();
     //drop frames those had committed to westeros
     std::lock_guard<std::mutex> lck(mRenderLock);
     for (auto item = mDisplayedFrameMap.begin(); item != mDisplayedFrameMap.end(); ) {
@@ -279,7 +378,7 @@ int WstClientPlugin::flush()
         mDisplayedFrameMap.erase(item++);
         RenderBuffer *renderbuffer = (RenderBuffer*) bufItem->second;
         if (renderbuffer) {
-            handleFrameDropped(renderbuffer);
+            handleFrameDropped(renderbuffer, PLUGIN_DROP_REASON_FLUSH);
         }
     }
 
@@ -347,7 +446,7 @@ int WstClientPlugin::closeWindow()
         mDisplayedFrameMap.erase(item++);
         RenderBuffer *renderbuffer = (RenderBuffer*) bufItem->second;
         if (renderbuffer) {
-            handleFrameDropped(renderbuffer);
+            handleFrameDropped(renderbuffer, PLUGIN_DROP_REASON_FLUSH);
         }
     }
     //release all frames those had committed to westeros server
@@ -372,6 +471,9 @@ int WstClientPlugin::closeWindow()
 
 int WstClientPlugin::getValue(PluginKey key, void *value)
 {
+    if (mFrameMonitor->getValue(key, value)) {
+        return NO_ERROR;
+    }
     switch (key) {
         case PLUGIN_KEY_KEEP_LAST_FRAME: {
             *(int *)value = mKeepLastFrame.value;
@@ -398,6 +500,9 @@ int WstClientPlugin::getValue(PluginKey key, void *value)
 
 int WstClientPlugin::setValue(PluginKey key, void *value)
 {
+    if (mFrameMonitor->setValue(key, value)) {
+        return NO_ERROR;
+    }
     switch (key) {
         case PLUGIN_KEY_WINDOW_SIZE: {
             RenderRect* rect = static_cast<RenderRect*>(value);
@@ -503,20 +608,23 @@ int WstClientPlugin::setValue(PluginKey key, void *value)
 
 void WstClientPlugin::handleBufferRelease(RenderBuffer *buffer)
 {
+    mFrameMonitor->frameReleased(buffer);
     if (mCallback) {
         mCallback->doBufferReleaseCallback(mUserData, (void *)buffer);
     }
 }
 
-void WstClientPlugin::handleFrameDisplayed(RenderBuffer *buffer)
+void WstClientPlugin::handleFrameDisplayed(RenderBuffer *buffer, int64_t presentTime)
 {
+    mFrameMonitor->frameDisplayed(buffer, presentTime);
     if (mCallback) {
         mCallback->doBufferDisplayedCallback(mUserData, (void *)buffer);
     }
 }
 
-void WstClientPlugin::handleFrameDropped(RenderBuffer *buffer)
+void WstClientPlugin::handleFrameDropped(RenderBuffer *buffer, PluginDropReason reason)
 {
+    mFrameMonitor->frameDropped(buffer, reason);
     if (mCallback) {
         mCallback->doBufferDropedCallback(mUserData, (void *)buffer);
     }
@@ -563,7 +671,10 @@ void WstClientPlugin::onWstSocketEvent(WstEvent *event)
     {
         case WST_REFRESH_RATE: {
             int rate = event->param;
-            INFO(mLogCategory,"refresh rate:%d",rate);
+            INFO(mLogCategory,"refresh rate:%d,period:%lld us",rate,event->lparam);
+            if (event->lparam > 0) {
+                mVsyncClock->setNominalPeriod(event->lparam);
+            }
         } break;
         case WST_BUFFER_RELEASE: {
             int bufferid = event->param;
@@ -598,7 +709,7 @@ void WstClientPlugin::onWstSocketEvent(WstEvent *event)
                 if (isDropped) {
                     WARNING(mLogCategory,"Frame droped,pts:%lld us,displaytime:%lld,readyDisplayFramesCnt:%d",\
                             renderbuffer->pts/1000,displaytime,mReadyDisplayFrameCnt);
-                    handleFrameDropped(renderbuffer);
+                    handleFrameDropped(renderbuffer, PLUGIN_DROP_REASON_COMPOSITOR);
                 }
                 handleBufferRelease(renderbuffer);
             }
@@ -608,6 +719,12 @@ void WstClientPlugin::onWstSocketEvent(WstEvent *event)
             int dropframes = event->param;
             int64_t frameTime = event->lparam;
             TRACE(mLogCategory,"WST_STATUS,dropframes:%d,frameTime:%lld",dropframes,frameTime);
+            /*video server sends status at the vsync it presents a frame,
+             but the message carries no vsync time, so the receive time is used.
+             it lags the real vsync by the socket delivery and wakeup latency,
+             the clock filters the jitter of it, the mean lag stays in the phase*/
+            int64_t presentTime = Tls::Times::getSystemTimeUs();
+            mVsyncClock->addVsync(presentTime);
             RenderBuffer *renderbuffer = NULL;
             if (mNumDroppedFrames != event->param) {
                 mNumDroppedFrames = event->param;
@@ -640,7 +757,7 @@ void WstClientPlugin::onWstSocketEvent(WstEvent *event)
                     INFO(mLogCategory, "post first frame");
                     handleMsgNotify(MSG_FIRST_FRAME,(void*)&renderbuffer->pts);
                 }
-                handleFrameDisplayed(renderbuffer);
+                handleFrameDisplayed(renderbuffer, presentTime);
             }
         } break;
         case WST_UNDERFLOW: {
@@ -20,6 +20,9 @@
 #include "wstclient_wayland.h"
 #include "wstclient_socket.h"
 #include "wst_essos.h"
+#include "VsyncClock.h"
+#include "LateFrameFilter.h"
+#include "FrameMonitor.h"
 #include <mutex>
 
 class WstClientPlugin : public RenderPlugin
@@ -34,6 +37,7 @@ class WstClientPlugin : public RenderPlugin
     virtual int openWindow();
     virtual int prepareFrame(RenderBuffer *buffer);
     virtual int displayFrame(RenderBuffer *buffer, int64_t displayTime);
+    virtual int displayFrames(RenderBuffer **buffers, int64_t *displayTimes, int count);
     virtual int flush();
     virtual int pause();
     virtual int resume();
@@ -43,12 +47,16 @@ class WstClientPlugin : public RenderPlugin
     virtual int setValue(PluginKey key, void *value);
     //buffer release callback
     void handleBufferRelease(RenderBuffer *buffer);
-    //buffer had displayed ,but not release
-    void handleFrameDisplayed(RenderBuffer *buffer);
+    //buffer had displayed ,but not release,presentTime is monotonic time it showed,us
+    void handleFrameDisplayed(RenderBuffer *buffer, int64_t presentTime);
     //buffer droped callback
-    void handleFrameDropped(RenderBuffer *buffer);
+    void handleFrameDropped(RenderBuffer *buffer, PluginDropReason reason);
     //plugin msg callback
     void handleMsgNotify(int type, void *detail);
+    //per frame trace,statistics and record
+    Tls::FrameMonitor *getFrameMonitor() {
+        return mFrameMonitor;
+    };
 
     void onWstSocketEvent(WstEvent *event);
 
@@ -74,6 +82,13 @@ class WstClientPlugin : public RenderPlugin
      * @return true send ok, false if failed
     */
     bool setCropFrameRect();
+    //send pending frame rate and get video rect before sending frames
+    void prepareSendFrames(WstRect *wstRect);
+    void fillBufferInfo(RenderBuffer *buffer, int64_t displayTime, WstBufferInfo *wstBufferInfo);
+    //drop and release buffer if it is hopelessly late
+    bool isLateFrame(RenderBuffer *buffer, int64_t displayTime);
+    //storage a frame sent to server, mRenderLock must be held
+    void commitFrame(RenderBuffer *buffer, int64_t displayTime);
     PluginCallback *mCallback;
     WstClientWayland *mWayland;
     WstClientSocket *mWstClientSocket;
@@ -112,6 +127,12 @@ class WstClientPlugin : public RenderPlugin
     int mFrameRateFractionNum;
     int mFrameRateFractionDenom;
     bool mFrameRateChanged;
+
+    //video server vsync timeline, fed by refresh rate and frame status
+    Tls::VsyncClock *mVsyncClock;
+    //drops hopelessly late frames in displayFrame
+    Tls::LateFrameFilter *mLateFrameFilter;
+    Tls::FrameMonitor *mFrameMonitor;
 };
 
 
@@ -37,6 +37,8 @@ WstClientSocket::WstClientSocket(WstClientPlugin *plugin, int logCategory)
 {
     mLogCategory = logCategory;
     mPlugin = plugin;
+    mServerRefreshRate = 0;
+    mServerRefreshPeriod = 0;
     mPoll = new Tls::Poll(true);
 }
 
@@ -485,26 +487,26 @@ void WstClientSocket::sendRateVideoClientConnection(int fpsNum, int fpsDenom )
     }
 }
 
-bool WstClientSocket::sendFrameVideoClientConnection(WstBufferInfo *wstBufferInfo, WstRect *wstRect)
+bool WstClientSocket::buildFrameMsg(WstBufferInfo *wstBufferInfo, WstRect *wstRect, WstFrameMsg *frameMsg)
 {
     bool result= false;
-    int sentLen;
-
-    struct msghdr msg;
     struct cmsghdr *cmsg;
-    struct iovec iov[1];
-    unsigned char mbody[4+64];
-    char cmbody[CMSG_SPACE(3*sizeof(int))];
-    int i, len;
+    int i;
     int *fd;
     int numFdToSend;
     int frameFd0 = -1, frameFd1 = -1, frameFd2 = -1;
-    int fdToSend0 = -1, fdToSend1 = -1, fdToSend2 = -1;
     int offset0, offset1, offset2;
     int stride0, stride1, stride2;
     uint32_t pixelFormat;
     int bufferId = -1;
     int vx, vy, vw, vh;
+    unsigned char *mbody = frameMsg->mbody;
+
+    frameMsg->fdToSend[0] = -1;
+    frameMsg->fdToSend[1] = -1;
+    frameMsg->fdToSend[2] = -1;
+    frameMsg->bufferId = -1;
+    frameMsg->frameTime = 0;
 
     if ( wstBufferInfo )
     {
@@ -547,16 +549,16 @@ bool WstClientSocket::sendFrameVideoClientConnection(WstBufferInfo *wstBufferInf
         //must change pixelformat to v4l2 support pixel format
         pixelFormat = wstBufferInfo->pixelFormat;
 
-        fdToSend0 = fcntl( frameFd0, F_DUPFD_CLOEXEC, 0 );
-        if ( fdToSend0 < 0 )
+        frameMsg->fdToSend[0] = fcntl( frameFd0, F_DUPFD_CLOEXEC, 0 );
+        if ( frameMsg->fdToSend[0] < 0 )
         {
             ERROR(mLogCategory,"wstSendFrameVideoClientConnection: failed to dup fd0");
             goto exit;
         }
         if ( frameFd1 >= 0 )
         {
-            fdToSend1 = fcntl( frameFd1, F_DUPFD_CLOEXEC, 0 );
-            if ( fdToSend1 < 0 )
+            frameMsg->fdToSend[1] = fcntl( frameFd1, F_DUPFD_CLOEXEC, 0 );
+            if ( frameMsg->fdToSend[1] < 0 )
             {
                 ERROR(mLogCategory,"wstSendFrameVideoClientConnection: failed to dup fd1");
                 goto exit;
@@ -565,8 +567,8 @@ bool WstClientSocket::sendFrameVideoClientConnection(WstBufferInfo *wstBufferInf
         }
         if ( frameFd2 >= 0 )
         {
-            fdToSend2 = fcntl( frameFd2, F_DUPFD_CLOEXEC, 0 );
-            if ( fdToSend2 < 0 )
+            frameMsg->fdToSend[2] = fcntl( frameFd2, F_DUPFD_CLOEXEC, 0 );
+            if ( frameMsg->fdToSend[2] < 0 )
             {
                 ERROR(mLogCategory,"wstSendFrameVideoClientConnection: failed to dup fd2");
                 goto exit;
@@ -603,69 +605,153 @@ bool WstClientSocket::sendFrameVideoClientConnection(WstBufferInfo *wstBufferInf
         i += putU32( &mbody[i], bufferId );
         i += putS64( &mbody[i], wstBufferInfo->frameTime );
 
-        iov[0].iov_base = (char*)mbody;
-        iov[0].iov_len = i;
+        frameMsg->iov[0].iov_base = (char*)mbody;
+        frameMsg->iov[0].iov_len = i;
 
-        cmsg = (struct cmsghdr*)cmbody;
+        cmsg = (struct cmsghdr*)frameMsg->cmbody;
         cmsg->cmsg_len = CMSG_LEN(numFdToSend*sizeof(int));
         cmsg->cmsg_level = SOL_SOCKET;
         cmsg->cmsg_type = SCM_RIGHTS;
 
-        msg.msg_name = NULL;
-        msg.msg_namelen = 0;
-        msg.msg_iov = iov;
-        msg.msg_iovlen = 1;
-        msg.msg_control = cmsg;
-        msg.msg_controllen = cmsg->cmsg_len;
-        msg.msg_flags = 0;
+        frameMsg->msg.msg_name = NULL;
+        frameMsg->msg.msg_namelen = 0;
+        frameMsg->msg.msg_iov = frameMsg->iov;
+        frameMsg->msg.msg_iovlen = 1;
+        frameMsg->msg.msg_control = cmsg;
+        frameMsg->msg.msg_controllen = cmsg->cmsg_len;
+        frameMsg->msg.msg_flags = 0;
 
         fd = (int*)CMSG_DATA(cmsg);
-        fd[0] = fdToSend0;
-        if ( fdToSend1 >= 0 )
+        fd[0] = frameMsg->fdToSend[0];
+        if ( frameMsg->fdToSend[1] >= 0 )
         {
-            fd[1] = fdToSend1;
+            fd[1] = frameMsg->fdToSend[1];
         }
-        if ( fdToSend2 >= 0 )
+        if ( frameMsg->fdToSend[2] >= 0 )
         {
-            fd[2] = fdToSend2;
+            fd[2] = frameMsg->fdToSend[2];
         }
+        frameMsg->bufferId = bufferId;
+        frameMsg->frameTime = wstBufferInfo->frameTime;
 
-        TRACE(mLogCategory,"send frame:bufferid %d, fd (%d, %d, %d [%d, %d, %d]),realtmUs:%lld", bufferId, frameFd0, frameFd1, frameFd2, fdToSend0, fdToSend1, fdToSend2,wstBufferInfo->frameTime);
+        TRACE(mLogCategory,"send frame:bufferid %d, fd (%d, %d, %d [%d, %d, %d]),realtmUs:%lld", bufferId, frameFd0, frameFd1, frameFd2, \
+            frameMsg->fdToSend[0], frameMsg->fdToSend[1], frameMsg->fdToSend[2],wstBufferInfo->frameTime);
+        result = true;
+    }
 
-        do
-        {
-            sentLen = sendmsg( mSocketFd, &msg, 0 );
-        } while ( (sentLen < 0) && (errno == EINTR));
+exit:
+    if ( !result )
+    {
+        releaseFrameMsg( frameMsg );
+    }
+    return result;
+}
 
-        if ( sentLen == iov[0].iov_len )
-        {
-            result = true;
-        }
-        else
+void WstClientSocket::releaseFrameMsg(WstFrameMsg *frameMsg)
+{
+    //the server owns its duplicates once sent, ours are closed
+    for ( int i = 0; i < WST_MAX_PLANES; i++ )
+    {
+        if ( frameMsg->fdToSend[i] >= 0 )
         {
-            ERROR(mLogCategory,"out: failed(%s) %d, sentLen(%d)%d, send frame %lld buffer %d ", \
-                 strerror(errno), errno, sentLen, iov[0].iov_len, wstBufferInfo->frameTime, bufferId);
+            close( frameMsg->fdToSend[i] );
+            frameMsg->fdToSend[i] = -1;
         }
     }
+}
 
-exit:
-    if ( fdToSend0 >= 0 )
+bool WstClientSocket::sendFrameVideoClientConnection(WstBufferInfo *wstBufferInfo, WstRect *wstRect)
+{
+    bool result= false;
+    int sentLen;
+    WstFrameMsg frameMsg;
+
+    if ( !buildFrameMsg( wstBufferInfo, wstRect, &frameMsg ) )
     {
-        close( fdToSend0 );
-        fdToSend0 = -1;
+        return false;
     }
-    if ( fdToSend1 >= 0 )
+
+    do
+    {
+        sentLen = sendmsg( mSocketFd, &frameMsg.msg, 0 );
+    } while ( (sentLen < 0) && (errno == EINTR));
+
+    if ( sentLen == frameMsg.iov[0].iov_len )
     {
-        close( fdToSend1 );
-        fdToSend1 = -1;
+        result = true;
     }
-    if ( fdToSend2 >= 0 )
+    else
     {
-        close( fdToSend2 );
-        fdToSend2 = -1;
+        ERROR(mLogCategory,"out: failed(%s) %d, sentLen(%d)%d, send frame %lld buffer %d ", \
+             strerror(errno), errno, sentLen, frameMsg.iov[0].iov_len, frameMsg.frameTime, frameMsg.bufferId);
     }
 
-   return result;
+    releaseFrameMsg( &frameMsg );
+    return result;
+}
+
+int WstClientSocket::sendFramesVideoClientConnection(WstBufferInfo *wstBufferInfos, WstRect *wstRect, int count)
+{
+    WstFrameMsg frameMsgs[WST_MAX_BATCH_FRAMES];
+    struct mmsghdr mmsgs[WST_MAX_BATCH_FRAMES];
+    int builtCnt = 0;
+    int sendCnt;
+    int sentCnt = 0;
+    int ret;
+
+    if ( count > WST_MAX_BATCH_FRAMES )
+    {
+        count = WST_MAX_BATCH_FRAMES;
+    }
+
+    //frames keep their order, stop at the first one failed to build
+    while ( builtCnt < count )
+    {
+        if ( !buildFrameMsg( &wstBufferInfos[builtCnt], wstRect, &frameMsgs[builtCnt] ) )
+        {
+            break;
+        }
+        //msghdr points into frameMsgs, it is copied after built in place
+        mmsgs[builtCnt].msg_hdr = frameMsgs[builtCnt].msg;
+        mmsgs[builtCnt].msg_len = 0;
+        ++builtCnt;
+    }
+
+    //every frame is still its own message with its own fds, server parsing is unchanged
+    sendCnt = builtCnt;
+    while ( sentCnt < sendCnt )
+    {
+        do
+        {
+            ret = sendmmsg( mSocketFd, &mmsgs[sentCnt], sendCnt - sentCnt, 0 );
+        } while ( (ret < 0) && (errno == EINTR));
+
+        if ( ret <= 0 )
+        {
+            ERROR(mLogCategory,"out: failed(%s) %d, send frames %d/%d ", strerror(errno), errno, sentCnt, sendCnt);
+            break;
+        }
+        //a short stream write splits a message, the stream is unusable after it
+        for ( int i = sentCnt; i < sentCnt + ret; i++ )
+        {
+            if ( mmsgs[i].msg_len != frameMsgs[i].iov[0].iov_len )
+            {
+                ERROR(mLogCategory,"out: sentLen(%d)%d, send frame %lld buffer %d ", \
+                     mmsgs[i].msg_len, frameMsgs[i].iov[0].iov_len, frameMsgs[i].frameTime, frameMsgs[i].bufferId);
+                ret = i - sentCnt;
+                sendCnt = i;
+                break;
+            }
+        }
+        sentCnt += ret;
+    }
+
+    for ( int i = 0; i < builtCnt; i++ )
+    {
+        releaseFrameMsg( &frameMsgs[i] );
+    }
+    TRACE(mLogCategory,"send frames:%d/%d",sentCnt,count);
+    return sentCnt;
 }
 
 void WstClientSocket::sendCropFrameSizeClientConnection(int x, int y, int w, int h)
@@ -789,11 +875,16 @@ void WstClientSocket::processMessagesVideoClientConnection()
                         int rate = getU32( &m[4] );
                         DEBUG(mLogCategory,"out: got rate %d from video server", rate);
                         mServerRefreshRate = rate;
+                        if ( rate > 0 )
+                        {
+                            mServerRefreshPeriod = 1000000LL/rate;
+                        }
                         if ( mPlugin )
                         {
                             WstEvent wstEvent;
                             wstEvent.event = WST_REFRESH_RATE;
                             wstEvent.param = rate;
+                            wstEvent.lparam = mServerRefreshPeriod;
                             mPlugin->onWstSocketEvent(&wstEvent);
                         }
                     }
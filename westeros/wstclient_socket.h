@@ -27,6 +27,7 @@ extern "C" {
 #endif
 
 #define WST_MAX_PLANES (3)
+#define WST_MAX_BATCH_FRAMES (16) //max frames sent by one sendmmsg
 #define AV_SYNC_SESSION_V_MONO 64 //when set it, AV_SYNC_MODE_VIDEO_MONO of sync mode must be selected
 
 #define SYNC_IMMEDIATE (255) //msync video sync type
@@ -119,6 +120,14 @@ class WstClientSocket : public Tls::Thread{
     void sendRectVideoClientConnection(int videoX, int videoY, int videoWidth, int videoHeight );
     void sendRateVideoClientConnection(int fpsNum, int fpsDenom );
     bool sendFrameVideoClientConnection(WstBufferInfo *wstBufferInfo, WstRect *wstRect);
+    /**
+     * @brief send frames to westeros server by one sendmmsg
+     *
+     * @param wstBufferInfos frames in display order
+     * @param count frame count, at most WST_MAX_BATCH_FRAMES are sent
+     * @return count of frames sent, they are the leading ones
+     */
+    int sendFramesVideoClientConnection(WstBufferInfo *wstBufferInfos, WstRect *wstRect, int count);
     void processMessagesVideoClientConnection();
     void sendKeepLastFrameVideoClientConnection(bool keep);
     void sendGetDefaultWindowSizeClientConnection();
@@ -127,6 +136,19 @@ class WstClientSocket : public Tls::Thread{
     void readyToRun();
     virtual bool threadLoop();
   private:
+    //a frame message ready to send, msg points into itself
+    typedef struct {
+        struct msghdr msg;
+        struct iovec iov[1];
+        unsigned char mbody[4+64];
+        char cmbody[CMSG_SPACE(3*sizeof(int))];
+        int fdToSend[WST_MAX_PLANES];
+        int bufferId;
+        int64_t frameTime;
+    } WstFrameMsg;
+    //dup frame fds and build frame message, fds are closed if it fails
+    bool buildFrameMsg(WstBufferInfo *wstBufferInfo, WstRect *wstRect, WstFrameMsg *frameMsg);
+    void releaseFrameMsg(WstFrameMsg *frameMsg);
     int mLogCategory;
     const char *mName;
     struct sockaddr_un mAddr;
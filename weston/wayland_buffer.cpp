@@ -43,21 +43,29 @@ WaylandBuffer::WaylandBuffer(WaylandDisplay *display, int logCategory)
 {
     mRenderBuffer = NULL;
     mWaylandWlWrap = NULL;
+    mWlBufferListened = false;
     mUsedByCompositor = false;
     mRedrawingPending = false;
     mRealTime = -1;
     mBufferFormat = VIDEO_FORMAT_UNKNOWN;
     mFrameWidth = 0;
     mFrameHeight = 0;
+    mPresentationFeedback = NULL;
+    mDropReported = false;
 }
 
 WaylandBuffer::~WaylandBuffer()
 {
+    mLock.lock();
+    //no presentation event may reach this object after it is gone
+    destroyPresentationFeedback();
+    RenderBuffer *renderBuffer = mRenderBuffer;
+    mRenderBuffer = NULL;
+    mLock.unlock();
     /*if weston obtains the wl_buffer,we need
      * notify user to release renderBuffer*/
-    if (mRenderBuffer) {
-        mDisplay->handleBufferReleaseCallback(this);
-        mRenderBuffer = NULL;
+    if (renderBuffer) {
+        mDisplay->handleBufferReleaseCallback(this, renderBuffer);
     }
     if (mWaylandWlWrap) {
         delete mWaylandWlWrap;
@@ -68,26 +76,36 @@ WaylandBuffer::~WaylandBuffer()
 void WaylandBuffer::bufferRelease (void *data, struct wl_buffer *wl_buffer)
 {
     WaylandBuffer* waylandBuffer = static_cast<WaylandBuffer*>(data);
-    TRACE(waylandBuffer->mLogCategory,"--wl_buffer:%p,renderBuffer:%p",wl_buffer,waylandBuffer->mRenderBuffer);
+    waylandBuffer->mLock.lock();
+    RenderBuffer *renderBuffer = waylandBuffer->mRenderBuffer;
+    waylandBuffer->mRenderBuffer = NULL;
     waylandBuffer->mUsedByCompositor = false;
+    waylandBuffer->mLock.unlock();
+    TRACE(waylandBuffer->mLogCategory,"--wl_buffer:%p,renderBuffer:%p",wl_buffer,renderBuffer);
     //sometimes this callback be called twice
-    //this cause double free,so check mRenderBuffer
-    if (waylandBuffer->mRenderBuffer) {
-        waylandBuffer->mDisplay->handleBufferReleaseCallback(waylandBuffer);
-        waylandBuffer->mRenderBuffer = NULL;
+    //this cause double free,so check renderBuffer
+    if (renderBuffer) {
+        waylandBuffer->mDisplay->handleBufferReleaseCallback(waylandBuffer, renderBuffer);
     }
 }
 
 void WaylandBuffer::bufferdroped (void *data, struct wl_buffer *wl_buffer)
 {
     WaylandBuffer* waylandBuffer = static_cast<WaylandBuffer*>(data);
-    WARNING(waylandBuffer->mLogCategory,"--droped wl_buffer:%p,renderBuffer:%p",wl_buffer,waylandBuffer->mRenderBuffer);
+    waylandBuffer->mLock.lock();
+    RenderBuffer *renderBuffer = waylandBuffer->mRenderBuffer;
+    waylandBuffer->mRenderBuffer = NULL;
     waylandBuffer->mUsedByCompositor = false;
+    //presentation feedback may have reported it already
+    bool dropReported = waylandBuffer->mDropReported;
+    waylandBuffer->mLock.unlock();
+    WARNING(waylandBuffer->mLogCategory,"--droped wl_buffer:%p,renderBuffer:%p",wl_buffer,renderBuffer);
 
-    if (waylandBuffer->mRenderBuffer) {
-        waylandBuffer->mDisplay->handleFrameDropedCallback(waylandBuffer);
-        waylandBuffer->mDisplay->handleBufferReleaseCallback(waylandBuffer);
-        waylandBuffer->mRenderBuffer = NULL;
+    if (renderBuffer) {
+        if (!dropReported) {
+            waylandBuffer->mDisplay->handleFrameDropedCallback(waylandBuffer, renderBuffer);
+        }
+        waylandBuffer->mDisplay->handleBufferReleaseCallback(waylandBuffer, renderBuffer);
     }
 }
 
@@ -104,17 +122,93 @@ static const struct wl_buffer_listener buffer_listener = {
 void WaylandBuffer::frameDisplayedCallback(void *data, struct wl_callback *callback, uint32_t time)
 {
     WaylandBuffer* waylandBuffer = static_cast<WaylandBuffer*>(data);
+    //weston is ready for a new frame,the frame is reported by presentation feedback
+    if (waylandBuffer->mDisplay->getPresentation()) {
+        waylandBuffer->mDisplay->setRedrawingPending(false);
+        wl_callback_destroy (callback);
+        return;
+    }
+    int64_t presentTime = waylandBuffer->mDisplay->handleFrameCallbackTime(time);
     waylandBuffer->mDisplay->setRedrawingPending(false);
     waylandBuffer->mLock.lock();
-    bool redrawing = waylandBuffer->mRedrawingPending;
+    RenderBuffer *renderBuffer = waylandBuffer->mRedrawingPending? waylandBuffer->mRenderBuffer: NULL;
     waylandBuffer->mRedrawingPending = false;
     waylandBuffer->mLock.unlock();
-    if (waylandBuffer->mRenderBuffer && redrawing) {
-        waylandBuffer->mDisplay->handleFrameDisplayedCallback(waylandBuffer);
+    if (renderBuffer) {
+        waylandBuffer->mDisplay->handleFrameDisplayedCallback(waylandBuffer, renderBuffer, presentTime);
     }
     wl_callback_destroy (callback);
 }
 
+void WaylandBuffer::presentationSyncOutput(void *data, struct wp_presentation_feedback *feedback,
+                    struct wl_output *output)
+{
+}
+
+void WaylandBuffer::presentationPresented(void *data, struct wp_presentation_feedback *feedback,
+                    uint32_t secHi, uint32_t secLo, uint32_t nsec, uint32_t refresh,
+                    uint32_t seqHi, uint32_t seqLo, uint32_t flags)
+{
+    WaylandBuffer* waylandBuffer = static_cast<WaylandBuffer*>(data);
+    int64_t presentTime = waylandBuffer->mDisplay->handlePresentationTime(secHi, secLo, nsec, seqHi, seqLo, flags);
+    waylandBuffer->mLock.lock();
+    //attach destroyed it for a newer commit while the event was dispatched
+    if (feedback != waylandBuffer->mPresentationFeedback) {
+        waylandBuffer->mLock.unlock();
+        return;
+    }
+    waylandBuffer->destroyPresentationFeedback();
+    RenderBuffer *renderBuffer = waylandBuffer->mRedrawingPending? waylandBuffer->mRenderBuffer: NULL;
+    waylandBuffer->mRedrawingPending = false;
+    if (renderBuffer) {
+        //the time the frame turned into light, not the time weston asked a new frame
+        renderBuffer->time = presentTime;
+    }
+    waylandBuffer->mLock.unlock();
+    TRACE(waylandBuffer->mLogCategory,"presented renderBuffer:%p,time:%lld us,seq:%u,flags:0x%x",
+            renderBuffer,presentTime,seqLo,flags);
+    if (renderBuffer) {
+        waylandBuffer->mDisplay->handleFrameDisplayedCallback(waylandBuffer, renderBuffer, presentTime);
+    }
+}
+
+void WaylandBuffer::presentationDiscarded(void *data, struct wp_presentation_feedback *feedback)
+{
+    WaylandBuffer* waylandBuffer = static_cast<WaylandBuffer*>(data);
+    waylandBuffer->mLock.lock();
+    //attach destroyed it for a newer commit while the event was dispatched
+    if (feedback != waylandBuffer->mPresentationFeedback) {
+        waylandBuffer->mLock.unlock();
+        return;
+    }
+    waylandBuffer->destroyPresentationFeedback();
+    RenderBuffer *renderBuffer = waylandBuffer->mRedrawingPending? waylandBuffer->mRenderBuffer: NULL;
+    waylandBuffer->mRedrawingPending = false;
+    //superseded before it was shown, it is released with the wl_buffer
+    if (renderBuffer) {
+        waylandBuffer->mDropReported = true;
+    }
+    waylandBuffer->mLock.unlock();
+    TRACE(waylandBuffer->mLogCategory,"discarded renderBuffer:%p",renderBuffer);
+    if (renderBuffer) {
+        waylandBuffer->mDisplay->handleFrameDropedCallback(waylandBuffer, renderBuffer);
+    }
+}
+
+void WaylandBuffer::destroyPresentationFeedback()
+{
+    if (mPresentationFeedback) {
+        wp_presentation_feedback_destroy(mPresentationFeedback);
+        mPresentationFeedback = NULL;
+    }
+}
+
+static const struct wp_presentation_feedback_listener presentation_feedback_listener = {
+    WaylandBuffer::presentationSyncOutput,
+    WaylandBuffer::presentationPresented,
+    WaylandBuffer::presentationDiscarded,
+};
+
 static const struct wl_callback_listener frame_callback_listener = {
   WaylandBuffer::frameDisplayedCallback
 };
@@ -124,15 +218,12 @@ int WaylandBuffer::constructWlBuffer(RenderBuffer *buf)
     struct wl_buffer * wlbuffer = NULL;
     WaylandDisplay::AmlConfigAPIList *amlConfigAPI = mDisplay->getAmlConfigAPIList();
 
+    mLock.lock();
     mRenderBuffer = buf;
-    if (mWaylandWlWrap) {
-        return NO_ERROR;
-    }
-
-    if (buf->flag & BUFFER_FLAG_DMA_BUFFER) {
+    mLock.unlock();
+    if (!mWaylandWlWrap && (buf->flag & BUFFER_FLAG_DMA_BUFFER)) {
         WaylandDmaBuffer *waylanddma = new WaylandDmaBuffer(mDisplay, mLogCategory);
-        wlbuffer = waylanddma->constructWlBuffer(&buf->dma, mBufferFormat);
-        if (!wlbuffer) {
+        if (waylanddma->requestWlBuffer(&buf->dma, mBufferFormat) != NO_ERROR) {
             delete waylanddma;
             ERROR(mLogCategory,"create wl_buffer fail");
             return ERROR_INVALID_OPERATION;
@@ -142,7 +233,24 @@ int WaylandBuffer::constructWlBuffer(RenderBuffer *buf)
         mFrameHeight = buf->dma.height;
     }
 
+    if (!mWaylandWlWrap) {
+        return NO_ERROR;
+    }
+    //an async create request is not answered yet,listen when it is used
+    wlbuffer = mWaylandWlWrap->getWlBuffer();
+    if (!wlbuffer) {
+        if (mWaylandWlWrap->isPending()) {
+            return NO_ERROR;
+        }
+        ERROR(mLogCategory,"create wl_buffer fail");
+        return ERROR_INVALID_OPERATION;
+    }
+    if (mWlBufferListened) {
+        return NO_ERROR;
+    }
+
     /*register buffer release listen*/
+    mWlBufferListened = true;
     if (amlConfigAPI->enableDropFrame) {
         wl_buffer_add_listener (wlbuffer, &buffer_with_drop_listener, this);
     } else {
@@ -165,21 +273,30 @@ void WaylandBuffer::attach(struct wl_surface *surface)
 {
     struct wl_callback *callback;
     struct wl_buffer *wlbuffer = NULL;
-    if (mUsedByCompositor) {
-        DEBUG(mLogCategory,"buffer used by compositor");
-        return;
-    }
-
     //callback when this frame displayed
     callback = wl_surface_frame (surface);
     wl_callback_add_listener (callback, &frame_callback_listener, this);
     mDisplay->setRedrawingPending(true);
 
+    mLock.lock();
+    //a wl_buffer weston still holds is attached again to show a new frame in it
+    if (mUsedByCompositor) {
+        DEBUG(mLogCategory,"attach buffer used by compositor");
+    }
+    //feedback of the commit that follows,the one of a previous commit is stale
+    destroyPresentationFeedback();
+    mDropReported = false;
+    if (mDisplay->getPresentation()) {
+        mPresentationFeedback = wp_presentation_feedback(mDisplay->getPresentation(), surface);
+        wp_presentation_feedback_add_listener(mPresentationFeedback, &presentation_feedback_listener, this);
+    }
+    mUsedByCompositor = true;
+    mRedrawingPending = true;
+    mLock.unlock();
+
     wlbuffer = getWlBuffer();
     if (wlbuffer) {
         wl_surface_attach (surface, wlbuffer, 0, 0);
+        mWaylandWlWrap->setUsed();
     }
-
-    mUsedByCompositor = true;
-    mRedrawingPending = true;
 }
\ No newline at end of file
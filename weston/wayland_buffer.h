@@ -21,6 +21,8 @@
 
 class WaylandDisplay;
 class WaylandWindow;
+struct wp_presentation_feedback;
+struct wl_output;
 
 /**
  * @brief create waylandbuffer include wl_buffer to use
@@ -37,12 +39,30 @@ class WaylandBuffer {
   public:
     WaylandBuffer(WaylandDisplay *display, int logCategory);
     virtual ~WaylandBuffer();
+    /**
+     * @brief bind the render buffer and create the wl_buffer on first use,
+     * it never waits for weston, call it again before attach to pick up
+     * a wl_buffer whose async create request was pending
+     */
     int constructWlBuffer(RenderBuffer *buf);
     void forceRedrawing() {
         mLock.lock();
         mRedrawingPending = false;
         mLock.unlock();
     };
+    /**
+     * @brief take the frame of latest commit from frame callback and
+     * presentation feedback, they won't report it any more
+     *
+     * @return true if the frame was not reported yet
+     */
+    bool takeRedrawingPending() {
+        mLock.lock();
+        bool redrawing = mRedrawingPending;
+        mRedrawingPending = false;
+        mLock.unlock();
+        return redrawing;
+    };
     void setRenderRealTime(int64_t realTime) {
         mRealTime = realTime;
     };
@@ -56,6 +76,7 @@ class WaylandBuffer {
     };
     RenderBuffer *getRenderBuffer()
     {
+        Tls::Mutex::Autolock _l(mLock);
         return mRenderBuffer;
     };
     WaylandDisplay *getWaylandDisplay()
@@ -64,6 +85,7 @@ class WaylandBuffer {
     };
     bool isFree()
     {
+        Tls::Mutex::Autolock _l(mLock);
         return !mUsedByCompositor;
     };
     int getFrameWidth() {
@@ -72,22 +94,45 @@ class WaylandBuffer {
     int getFrameHeight() {
         return mFrameHeight;
     };
+    /**
+     * @brief get the dmabuf format and modifier of the dma wl_buffer
+     *
+     * @return false if no dma wl_buffer is created
+     */
+    bool getDmaFormat(uint32_t *format, uint64_t *modifier) {
+        return mWaylandWlWrap? mWaylandWlWrap->getDmaFormat(format, modifier): false;
+    };
     struct wl_buffer *getWlBuffer();
     static void bufferRelease (void *data, struct wl_buffer *wl_buffer);
     static void bufferdroped (void *data, struct wl_buffer *wl_buffer);
     static void frameDisplayedCallback(void *data, struct wl_callback *callback, uint32_t time);
+    static void presentationSyncOutput(void *data, struct wp_presentation_feedback *feedback,
+                    struct wl_output *output);
+    static void presentationPresented(void *data, struct wp_presentation_feedback *feedback,
+                    uint32_t secHi, uint32_t secLo, uint32_t nsec, uint32_t refresh,
+                    uint32_t seqHi, uint32_t seqLo, uint32_t flags);
+    static void presentationDiscarded(void *data, struct wp_presentation_feedback *feedback);
   private:
+    //the only place feedback is destroyed, mLock must be held
+    void destroyPresentationFeedback();
     int mLogCategory;
     WaylandDisplay *mDisplay;
     RenderBuffer *mRenderBuffer;
     WaylandWLWrap *mWaylandWlWrap; //wl_buffer wrapper
+    bool mWlBufferListened; //release listener is added to the wl_buffer
     int64_t mRealTime;
     bool mUsedByCompositor;
     RenderVideoFormat mBufferFormat;
     int mFrameWidth;
     int mFrameHeight;
+    /*guards render buffer,compositor use,redrawing and presentation
+     state,they are changed by render and display threads*/
     mutable Tls::Mutex mLock;
     bool mRedrawingPending;
+    /*presentation feedback of latest commit, it reports the frame
+     displayed or dropped when wp_presentation is supported*/
+    struct wp_presentation_feedback *mPresentationFeedback;
+    bool mDropReported; //the frame of latest commit was reported dropped
 };
 
 #endif /*__WAYLAND_BUFFER_H__*/
\ No newline at end of file
@@ -14,14 +14,22 @@
  * limitations under the License.
  */
 #include <string>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <drm_fourcc.h>
 #include "wayland_display.h"
 #include "ErrorCode.h"
 #include "Logger.h"
+#include "Times.h"
 #include "wayland_plugin.h"
 #include "wayland_videoformat.h"
 #include "wayland_shm.h"
+#include "wayland_shm_pool.h"
 #include "wayland_dma.h"
+#include "wayland_dma_feedback.h"
 #include "wayland_buffer.h"
+#include "PixelConverter.h"
 
 #ifndef MAX
 #  define MAX(a,b)  ((a) > (b)? (a) : (b))
@@ -33,6 +41,13 @@
 
 #define TAG "rlib:wayland_display"
 
+#ifndef DRM_FORMAT_MOD_INVALID
+#define DRM_FORMAT_MOD_INVALID 0x00ffffffffffffffULL
+#endif
+#ifndef DRM_FORMAT_MOD_LINEAR
+#define DRM_FORMAT_MOD_LINEAR 0ULL
+#endif
+
 void WaylandDisplay::dmabuf_modifiers(void *data, struct zwp_linux_dmabuf_v1 *zwp_linux_dmabuf,
          uint32_t format, uint32_t modifier_hi, uint32_t modifier_lo)
 {
@@ -41,13 +56,19 @@ void WaylandDisplay::dmabuf_modifiers(void *data, struct zwp_linux_dmabuf_v1 *zw
     if (wl_dmabuf_format_to_video_format (format) != VIDEO_FORMAT_UNKNOWN) {
         TRACE(self->mLogCategory,"regist dmabuffer format:%d (%s) hi:%x,lo:%x",format,print_dmabuf_format_name(format),modifier_hi,modifier_lo);
         uint64_t modifier = ((uint64_t)modifier_hi << 32) | modifier_lo;
-        auto item = self->mDmaBufferFormats.find(format);
-        if (item == self->mDmaBufferFormats.end()) {
-            std::pair<uint32_t ,uint64_t> item(format, modifier);
-            self->mDmaBufferFormats.insert(item);
-        } else { //found format
-            item->second = modifier;
+        //feedback formats carry the compositor preference, keep them
+        if (self->mDefaultFeedback || self->mSurfaceFeedback) {
+            return;
         }
+        //keep every modifier, the last advertised one is preferred
+        std::vector<DmaBufferModifier> &modifiers = self->mDmaBufferFormats[format];
+        for (auto &item : modifiers) {
+            if (item.modifier == modifier) {
+                return;
+            }
+        }
+        DmaBufferModifier item = {modifier, false};
+        modifiers.insert(modifiers.begin(), item);
     }
 }
 
@@ -92,6 +113,17 @@ static const struct wl_shm_listener shm_listener = {
   WaylandDisplay::shmFormat
 };
 
+void WaylandDisplay::presentationClockId(void *data, struct wp_presentation *presentation, uint32_t clockId)
+{
+    WaylandDisplay *self = static_cast<WaylandDisplay *>(data);
+    INFO(self->mLogCategory,"presentation clock id:%u",clockId);
+    self->mPresentationClock = clockId;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+  WaylandDisplay::presentationClockId
+};
+
 void WaylandDisplay::outputHandleGeometry( void *data,
                                   struct wl_output *output,
                                   int x,
@@ -138,6 +170,10 @@ void WaylandDisplay::outputHandleMode( void *data,
         }
 
         DEBUG(self->mLogCategory,"wl_output: %p (%dx%d) refreshrate:%d,select output index %d",output, width, height,refreshRate,self->mSelectOutputIndex);
+        //refresh rate is mHz
+        if (output == self->mCurrentDisplayOutput->wlOutput && refreshRate > 0 && self->mWaylandPlugin) {
+            self->mWaylandPlugin->getVsyncClock()->setNominalPeriod(1000000000LL/refreshRate);
+        }
         if (self->mCurrentDisplayOutput->width > 0 &&
             self->mCurrentDisplayOutput->height > 0) {
             self->updateDisplayOutput();
@@ -501,11 +537,22 @@ WaylandDisplay::registryHandleGlobal (void *data, struct wl_registry *registry,
         //    &zwp_fullscreen_shell_v1_interface, 1);
     } else if (strcmp (interface, "wp_viewporter") == 0) {
         self->mViewporter = (struct wp_viewporter *)wl_registry_bind (registry, name, &wp_viewporter_interface, 1);
+    } else if (strcmp (interface, "wp_presentation") == 0) {
+        self->mPresentation = (struct wp_presentation *)wl_registry_bind (registry, name, &wp_presentation_interface, 1);
+        wp_presentation_add_listener (self->mPresentation, &presentation_listener, (void *)self);
     } else if (strcmp (interface, "zwp_linux_dmabuf_v1") == 0) {
         if (version < 3)
             return;
-        self->mDmabuf = (struct zwp_linux_dmabuf_v1 *)wl_registry_bind (registry, name, &zwp_linux_dmabuf_v1_interface, 3);
+        self->mDmabuf = (struct zwp_linux_dmabuf_v1 *)wl_registry_bind (registry, name, &zwp_linux_dmabuf_v1_interface, MIN(version, 4));
         zwp_linux_dmabuf_v1_add_listener (self->mDmabuf, &dmabuf_listener, (void *)self);
+        //version 4 sends no format/modifier events, formats come from feedback
+        if (version >= 4) {
+            self->mDefaultFeedback = new WaylandDmaFeedback(self, self->mLogCategory);
+            if (self->mDefaultFeedback->create(self->mDmabuf, NULL) != NO_ERROR) {
+                delete self->mDefaultFeedback;
+                self->mDefaultFeedback = NULL;
+            }
+        }
     }  else if (strcmp (interface, "wl_output") == 0) {
         int i = 0;
         uint32_t oriName = self->mCurrentDisplayOutput->name;
@@ -613,7 +660,19 @@ WaylandDisplay::WaylandDisplay(WaylandPlugin *plugin, int logCategory)
     mCompositor = NULL;
     mXdgWmBase = NULL;
     mViewporter = NULL;
+    mPresentation = NULL;
+    mPresentationClock = CLOCK_MONOTONIC;
     mDmabuf = NULL;
+    mDefaultFeedback = NULL;
+    mSurfaceFeedback = NULL;
+    mHasSurfaceFeedback = false;
+    mScanoutState = PLUGIN_SCANOUT_STATE_UNKNOWN;
+    mScanoutDmaFormat = 0;
+    mScanoutModifier = 0;
+    mScanoutFallback = false;
+    mPreferredScanoutFormat = 0;
+    mPreferredScanoutModifier = DRM_FORMAT_MOD_INVALID;
+    mDmaBufferModifier = DRM_FORMAT_MOD_LINEAR;
     mShm = NULL;
     mSeat = NULL;
     mPointer = NULL;
@@ -632,7 +691,11 @@ WaylandDisplay::WaylandDisplay(WaylandPlugin *plugin, int logCategory)
     mVideoViewport = NULL;
     mNoBorderUpdate = false;
     mAreaShmBuffer = NULL;
+    mShmPool = new WaylandShmPool(this, mLogCategory);
+    mRawShmPool = new WaylandShmPool(this, mLogCategory);
     mCommitCnt = 0;
+    memset(&mCommittedVideoRect, 0, sizeof(struct Rectangle));
+    mFlushPending = false;
     mReCommitAreaSurface = false;
     mAreaSurface = NULL;
     mAreaSurfaceWrapper = NULL;
@@ -674,6 +737,14 @@ WaylandDisplay::~WaylandDisplay()
         delete mPoll;
         mPoll = NULL;
     }
+    if (mShmPool) {
+        delete mShmPool;
+        mShmPool = NULL;
+    }
+    if (mRawShmPool) {
+        delete mRawShmPool;
+        mRawShmPool = NULL;
+    }
 }
 
 char *WaylandDisplay::require_xdg_runtime_dir()
@@ -775,10 +846,21 @@ void WaylandDisplay::closeDisplay()
         mViewporter = NULL;
     }
 
+    if (mPresentation) {
+        wp_presentation_destroy (mPresentation);
+        mPresentation = NULL;
+    }
+
+    if (mDefaultFeedback) {
+        delete mDefaultFeedback;
+        mDefaultFeedback = NULL;
+    }
+
     if (mDmabuf) {
         zwp_linux_dmabuf_v1_destroy (mDmabuf);
         mDmabuf = NULL;
     }
+    mDmaBufferFormats.clear();
 
     if (mXdgWmBase) {
         xdg_wm_base_destroy (mXdgWmBase);
@@ -843,19 +925,203 @@ int WaylandDisplay::toDmaBufferFormat(RenderVideoFormat format, uint32_t *outDma
     TRACE(mLogCategory,"render video format:%d -> dmabuf format:%d",format,dmaformat);
     *outDmaformat = (uint32_t)dmaformat;
 
-    /*get dmaformat and modifiers*/
+    Tls::Mutex::Autolock _l(mMutex);
+    /*the modifier is the real layout of the buffer,compositor
+     formats only tell whether it can be imported*/
+    *outDmaformatModifiers = mDmaBufferModifier;
     auto item = mDmaBufferFormats.find(dmaformat);
-    if (item == mDmaBufferFormats.end()) { //not found
-        WARNING(mLogCategory,"Not found dmabuf for render video format :%d",format);
-        *outDmaformatModifiers = 0;
-        return NO_ERROR;
+    if (item == mDmaBufferFormats.end() || item->second.empty()) { //not found
+        ERROR(mLogCategory,"compositor did not advertise dmabuf format %s for render video format:%d",
+                print_dmabuf_format_name(dmaformat),format);
+        return ERROR_NOT_FOUND;
     }
-
-    *outDmaformatModifiers = (uint64_t)item->second;
+    for (auto &modifier : item->second) {
+        if (modifier.modifier == mDmaBufferModifier) {
+            return NO_ERROR;
+        }
+    }
+    WARNING(mLogCategory,"compositor did not advertise dmabuf format:%s modifier:%llx,import may fail",
+            print_dmabuf_format_name(dmaformat),mDmaBufferModifier);
 
     return NO_ERROR;
 }
 
+void WaylandDisplay::setDmaBufferFormats(const DmaBufferFormatMap &formats, bool surfaceFeedback)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    if (!surfaceFeedback && mHasSurfaceFeedback) {
+        TRACE(mLogCategory,"ignore default feedback, surface feedback is used");
+        return;
+    }
+    mHasSurfaceFeedback = surfaceFeedback;
+    mDmaBufferFormats = formats;
+    for (auto &item : mDmaBufferFormats) {
+        bool scanout = false;
+        for (auto &modifier : item.second) {
+            scanout = scanout || modifier.scanout;
+        }
+        DEBUG(mLogCategory,"dmabuf format:%s modifiers:%d scanout:%d",
+                print_dmabuf_format_name(item.first),(int)item.second.size(),scanout);
+    }
+    if (surfaceFeedback) {
+        updateScanoutState();
+    }
+}
+
+void WaylandDisplay::updateScanoutState()
+{
+    int state = PLUGIN_SCANOUT_STATE_UNKNOWN;
+    bool otherModifier = false; //the format can be scanout with another modifier
+
+    /*compositor puts a scanout tranche in surface feedback when the video
+     is on a plane or only its format/modifier keeps it off a plane,
+     the tranche is gone if it is composited for other reasons*/
+    if (mHasSurfaceFeedback && mScanoutDmaFormat != 0) {
+        state = PLUGIN_SCANOUT_STATE_COMPOSITED;
+        auto item = mDmaBufferFormats.find(mScanoutDmaFormat);
+        if (item != mDmaBufferFormats.end()) {
+            for (auto &modifier : item->second) {
+                if (!modifier.scanout) {
+                    continue;
+                }
+                if (modifier.modifier == mScanoutModifier) {
+                    state = PLUGIN_SCANOUT_STATE_DIRECT;
+                    break;
+                }
+                otherModifier = true;
+            }
+        }
+    }
+
+    /*advise the first scanout modifier of the committed format,
+     otherwise the first scanout format,app reallocates buffers in it*/
+    mPreferredScanoutFormat = 0;
+    mPreferredScanoutModifier = DRM_FORMAT_MOD_INVALID;
+    if (mHasSurfaceFeedback) {
+        for (auto &item : mDmaBufferFormats) {
+            for (auto &modifier : item.second) {
+                if (!modifier.scanout) {
+                    continue;
+                }
+                if (mPreferredScanoutFormat == 0 || (item.first == mScanoutDmaFormat &&
+                    mPreferredScanoutFormat != mScanoutDmaFormat)) {
+                    mPreferredScanoutFormat = item.first;
+                    mPreferredScanoutModifier = modifier.modifier;
+                }
+                break;
+            }
+        }
+    }
+
+    if (state == mScanoutState) {
+        return;
+    }
+
+    bool fallback = mScanoutState == PLUGIN_SCANOUT_STATE_DIRECT && state == PLUGIN_SCANOUT_STATE_COMPOSITED;
+    if (fallback) {
+        WARNING(mLogCategory,"compositor fell back to gpu composition,dmabuf format:%s modifier:%llx",
+                print_dmabuf_format_name(mScanoutDmaFormat),mScanoutModifier);
+    } else {
+        INFO(mLogCategory,"scanout state %d -> %d,dmabuf format:%s modifier:%llx",mScanoutState,state,
+                print_dmabuf_format_name(mScanoutDmaFormat),mScanoutModifier);
+    }
+    mScanoutState = state;
+    if (fallback) {
+        mScanoutFallback = true;
+    } else if (state != PLUGIN_SCANOUT_STATE_COMPOSITED) {
+        mScanoutFallback = false;
+    }
+    mWaylandPlugin->getFrameMonitor()->scanoutState(state, fallback);
+
+    if (state != PLUGIN_SCANOUT_STATE_COMPOSITED) {
+        return;
+    }
+    if (otherModifier) {
+        //only the allocator can change the buffer layout, app gets it by PLUGIN_KEY_SCANOUT_FORMAT
+        INFO(mLogCategory,"compositor can scanout dmabuf format:%s with modifier:%llx",
+                print_dmabuf_format_name(mPreferredScanoutFormat),mPreferredScanoutModifier);
+        return;
+    }
+    //the video format or geometry must be changed by app, tell what compositor can scanout
+    bool hasScanoutTranche = false;
+    for (auto &item : mDmaBufferFormats) {
+        for (auto &modifier : item.second) {
+            if (modifier.scanout) {
+                INFO(mLogCategory,"compositor can scanout dmabuf format:%s modifier:%llx",
+                        print_dmabuf_format_name(item.first),modifier.modifier);
+                hasScanoutTranche = true;
+            }
+        }
+    }
+    if (!hasScanoutTranche) {
+        WARNING(mLogCategory,"no scanout tranche,video surface geometry or stacking keeps it off planes");
+    }
+}
+
+void WaylandDisplay::checkScanout(WaylandBuffer *waylandBuf)
+{
+    uint32_t format;
+    uint64_t modifier;
+
+    if (!waylandBuf->getDmaFormat(&format, &modifier)) {
+        return;
+    }
+    Tls::Mutex::Autolock _l(mMutex);
+    if (format != mScanoutDmaFormat || modifier != mScanoutModifier) {
+        mScanoutDmaFormat = format;
+        mScanoutModifier = modifier;
+        updateScanoutState();
+    }
+    if (mScanoutState != PLUGIN_SCANOUT_STATE_UNKNOWN) {
+        mWaylandPlugin->getFrameMonitor()->frameScanout(mScanoutState == PLUGIN_SCANOUT_STATE_DIRECT);
+    }
+}
+
+void WaylandDisplay::getScanoutFormat(PluginScanoutFormat *scanoutFormat)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    scanoutFormat->scanoutState = mScanoutState;
+    scanoutFormat->fallback = mScanoutFallback? 1: 0;
+    scanoutFormat->videoFormat = mPreferredScanoutFormat != 0?
+            (int)wl_dmabuf_format_to_video_format(mPreferredScanoutFormat): (int)VIDEO_FORMAT_UNKNOWN;
+    scanoutFormat->modifier = mPreferredScanoutModifier;
+}
+
+bool WaylandDisplay::isDmaBufferModifierAdvertised(uint32_t dmaformat, uint64_t modifier)
+{
+    //implicit modifier leaves the layout to the import, it may fail
+    if (modifier == DRM_FORMAT_MOD_INVALID) {
+        return false;
+    }
+    Tls::Mutex::Autolock _l(mMutex);
+    auto item = mDmaBufferFormats.find(dmaformat);
+    if (item == mDmaBufferFormats.end()) {
+        return false;
+    }
+    for (auto &advertised : item->second) {
+        if (advertised.modifier == modifier) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WaylandDisplay::canScanout(RenderVideoFormat format)
+{
+    uint32_t dmaformat = video_format_to_wl_dmabuf_format (format);
+    Tls::Mutex::Autolock _l(mMutex);
+    auto item = mDmaBufferFormats.find(dmaformat);
+    if (item == mDmaBufferFormats.end()) {
+        return false;
+    }
+    for (auto &modifier : item->second) {
+        if (modifier.scanout) {
+            return true;
+        }
+    }
+    return false;
+}
+
 int WaylandDisplay::toShmBufferFormat(RenderVideoFormat format, uint32_t *outformat)
 {
     if (!outformat) {
@@ -888,6 +1154,19 @@ void WaylandDisplay::setVideoBufferFormat(RenderVideoFormat format)
     mBufferFormat = format;
 };
 
+void WaylandDisplay::setDmaBufferModifier(uint64_t modifier)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    TRACE(mLogCategory,"set dma buffer modifier: %llx",modifier);
+    mDmaBufferModifier = modifier;
+}
+
+uint64_t WaylandDisplay::getDmaBufferModifier()
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    return mDmaBufferModifier;
+}
+
 void WaylandDisplay::setDisplayOutput(int output)
 {
     TRACE(mLogCategory,"select display output: %d",output);
@@ -917,6 +1196,54 @@ void WaylandDisplay::setPip(int pip)
     mPip = pip;
 }
 
+void WaylandDisplay::setRedrawingPending(bool val)
+{
+    mRedrawingPending = val;
+    //weston is ready for a new frame, wake up post thread
+    if (!val && mWaylandPlugin) {
+        mWaylandPlugin->wakeupPostThread();
+    }
+}
+
+int64_t WaylandDisplay::handleFrameCallbackTime(uint32_t timeMs)
+{
+    int64_t nowMs = Tls::Times::getSystemTimeMs();
+    //extend the 32 bits ms time with current monotonic time
+    int64_t timeUs = (nowMs - (int32_t)((uint32_t)nowMs - timeMs)) * 1000LL;
+
+    if (mWaylandPlugin) {
+        mWaylandPlugin->getVsyncClock()->addVsync(timeUs);
+    }
+    return timeUs;
+}
+
+int64_t WaylandDisplay::handlePresentationTime(uint32_t secHi, uint32_t secLo, uint32_t nsec,
+                    uint32_t seqHi, uint32_t seqLo, uint32_t flags)
+{
+    int64_t sec = ((int64_t)secHi << 32) | secLo;
+    int64_t timeUs = sec * 1000000LL + nsec / 1000;
+    int64_t sequence = ((int64_t)seqHi << 32) | seqLo;
+
+    //move the time to monotonic clock if compositor uses another one
+    if (mPresentationClock != CLOCK_MONOTONIC) {
+        struct timespec ts;
+        if (clock_gettime((clockid_t)mPresentationClock, &ts) == 0) {
+            int64_t clockNowUs = (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+            timeUs += Tls::Times::getSystemTimeUs() - clockNowUs;
+        }
+    }
+
+    //only a vsync'd flip is on the vblank timeline
+    if (mWaylandPlugin && (flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC)) {
+        if (sequence > 0) {
+            mWaylandPlugin->getVsyncClock()->addVsync(timeUs, sequence);
+        } else {
+            mWaylandPlugin->getVsyncClock()->addVsync(timeUs);
+        }
+    }
+    return timeUs;
+}
+
 void WaylandDisplay::updateDisplayOutput()
 {
     if (!mCurrentDisplayOutput->wlOutput || !mXdgToplevel || !mXdgSurface)
@@ -954,6 +1281,14 @@ void WaylandDisplay::createCommonWindowSurface()
 
     mAreaSurface = wl_compositor_create_surface (mCompositor);
     mVideoSurface = wl_compositor_create_surface (mCompositor);
+    //video surface feedback tells the formats that can be scanout
+    if (mDmabuf && zwp_linux_dmabuf_v1_get_version(mDmabuf) >= ZWP_LINUX_DMABUF_V1_GET_SURFACE_FEEDBACK_SINCE_VERSION) {
+        mSurfaceFeedback = new WaylandDmaFeedback(this, mLogCategory);
+        if (mSurfaceFeedback->create(mDmabuf, mVideoSurface) != NO_ERROR) {
+            delete mSurfaceFeedback;
+            mSurfaceFeedback = NULL;
+        }
+    }
     mAreaSurfaceWrapper = (struct wl_surface *)wl_proxy_create_wrapper (mAreaSurface);
     mVideoSurfaceWrapper = (struct wl_surface *)wl_proxy_create_wrapper (mVideoSurface);
 
@@ -1028,10 +1363,9 @@ void WaylandDisplay::createXdgShellWindowSurface()
 
 void WaylandDisplay::destroyWindowSurfaces()
 {
-    if (mAreaShmBuffer) {
-        delete mAreaShmBuffer;
-        mAreaShmBuffer = NULL;
-    }
+    //area shm buffer is owned by shm pool
+    mAreaShmBuffer = NULL;
+    mShmPool->clear();
 
     //clean all wayland buffers
     cleanAllWaylandBuffer();
@@ -1056,9 +1390,21 @@ void WaylandDisplay::destroyWindowSurfaces()
         mVideoSubSurface = NULL;
     }
 
+    //surface feedback must be destroyed before its surface
+    if (mSurfaceFeedback) {
+        delete mSurfaceFeedback;
+        mSurfaceFeedback = NULL;
+        Tls::Mutex::Autolock _l(mMutex);
+        mHasSurfaceFeedback = false;
+        mScanoutDmaFormat = 0;
+        mScanoutModifier = 0;
+        updateScanoutState();
+    }
+
     if (mVideoSurface) {
         wl_surface_destroy (mVideoSurface);
         mVideoSurface = NULL;
+        memset(&mCommittedVideoRect, 0, sizeof(struct Rectangle));
     }
 
     if (mAreaSurfaceWrapper) {
@@ -1193,9 +1539,12 @@ void WaylandDisplay::resizeVideoSurface(bool commit)
 
     wl_subsurface_set_position (mVideoSubSurface, res.x, res.y);
 
-    if (commit) {
+    //the committed video geometry is unchanged, don't wake up weston
+    if (commit && memcmp(&res, &mCommittedVideoRect, sizeof(struct Rectangle)) != 0) {
         wl_surface_damage (mVideoSurfaceWrapper, 0, 0, res.w, res.h);
         wl_surface_commit (mVideoSurfaceWrapper);
+        mCommittedVideoRect = res;
+        requestFlush();
     }
 
     //top level setting
@@ -1235,6 +1584,11 @@ int  WaylandDisplay::prepareFrameBuffer(RenderBuffer * buf)
     WaylandBuffer *waylandBuf = NULL;
     int ret;
 
+    //raw frames are copied to a shm buffer when displayed
+    if (!(buf->flag & BUFFER_FLAG_DMA_BUFFER)) {
+        return NO_ERROR;
+    }
+
     waylandBuf = findWaylandBuffer(buf);
     if (waylandBuf == NULL) {
         waylandBuf = new WaylandBuffer(this, mLogCategory);
@@ -1257,14 +1611,46 @@ waylandbuf_fail:
 }
 
 void WaylandDisplay::displayFrameBuffer(RenderBuffer * buf, int64_t realDisplayTime)
+{
+    commitFrameBuffer(buf, realDisplayTime);
+    flushDisplay();
+}
+
+void WaylandDisplay::displayFrameBuffers(RenderBuffer **bufs, int64_t *realDisplayTimes, int count)
+{
+    for (int i = 0; i < count; i++) {
+        commitFrameBuffer(bufs[i], realDisplayTimes[i]);
+    }
+    //all commits reach weston with one flush
+    flushDisplay();
+}
+
+void WaylandDisplay::flushDisplay()
+{
+    if (mFlushPending.exchange(false, std::memory_order_acq_rel)) {
+        wl_display_flush (mWlDisplay);
+    }
+}
+
+void WaylandDisplay::requestFlush()
+{
+    //only the first request of a tick wakes up display thread
+    if (!mFlushPending.exchange(true, std::memory_order_acq_rel) && mPoll) {
+        mPoll->wakeup();
+    }
+}
+
+bool WaylandDisplay::commitFrameBuffer(RenderBuffer * buf, int64_t realDisplayTime)
 {
     WaylandBuffer *waylandBuf = NULL;
     struct wl_buffer * wlbuffer = NULL;
+    bool held = false; //weston holds the wl_buffer of this frame
+    RenderBuffer *replacedBuf = NULL;
     int ret;
 
     if (!buf) {
         ERROR(mLogCategory,"Error input params, waylandbuffer is null");
-        return;
+        return false;
     }
 
     //must commit areasurface first, because weston xdg surface maybe timeout
@@ -1272,10 +1658,19 @@ void WaylandDisplay::displayFrameBuffer(RenderBuffer * buf, int64_t realDisplayT
     if (!mReCommitAreaSurface) {
         mReCommitAreaSurface = true;
         wl_surface_commit (mAreaSurface);
+        markFlush();
     }
 
     TRACE(mLogCategory,"display renderBuffer:%p,PTS:%lld,realtime:%lld",buf, buf->pts, realDisplayTime);
 
+    //if no wl_output, drop this buffer
+    if (mCurrentDisplayOutput->wlOutput == NULL) {
+        TRACE(mLogCategory,"No wl_output");
+        mWaylandPlugin->handleFrameDropped(buf, PLUGIN_DROP_REASON_ERROR);
+        mWaylandPlugin->handleBufferRelease(buf);
+        return false;
+    }
+
     if (buf->flag & BUFFER_FLAG_DMA_BUFFER) {
         if (buf->dma.width <=0 || buf->dma.height <=0) {
             buf->dma.width = mVideoWidth;
@@ -1283,30 +1678,103 @@ void WaylandDisplay::displayFrameBuffer(RenderBuffer * buf, int64_t realDisplayT
         }
         waylandBuf = findWaylandBuffer(buf);
         if (waylandBuf) {
+            //the same dma buffer is displayed again before weston released it
+            held = !waylandBuf->isFree();
+            if (held) {
+                replacedBuf = waylandBuf->getRenderBuffer();
+            }
             waylandBuf->setRenderRealTime(realDisplayTime);
             ret = waylandBuf->constructWlBuffer(buf);
             if (ret != NO_ERROR) {
                 WARNING(mLogCategory,"dmabufConstructWlBuffer fail,release waylandbuf");
                 //delete waylanBuf,WaylandBuffer object destruct will call release callback
+                removeWaylandBuffer(buf);
                 goto waylandbuf_fail;
             }
+            //the create request sent at prepare time is not answered yet,
+            //don't stall the display path waiting for weston
+            if (!waylandBuf->getWlBuffer()) {
+                WARNING(mLogCategory,"wl_buffer is pending,drop renderbuf:%p",buf);
+                mWaylandPlugin->handleFrameDropped(buf, PLUGIN_DROP_REASON_ERROR);
+                mWaylandPlugin->handleBufferRelease(buf);
+                return false;
+            }
+            mWaylandPlugin->getFrameMonitor()->traceFrame(buf, PLUGIN_FRAME_STAGE_READY);
         } else {
             ERROR(mLogCategory,"NOT found wayland buffer,please prepare buffer first");
             goto waylandbuf_fail;
         }
+    } else if (buf->flag & BUFFER_FLAG_RAW_BUFFER) {
+        int width = buf->dma.width > 0 ? buf->dma.width : mVideoWidth;
+        int height = buf->dma.height > 0 ? buf->dma.height : mVideoHeight;
+        RenderVideoFormat shmFormat = getRawShmFormat();
+        if (shmFormat == VIDEO_FORMAT_UNKNOWN) {
+            ERROR(mLogCategory,"weston can't show raw buffer of format %d",mBufferFormat);
+            goto rawbuf_fail;
+        }
+        WaylandShmBuffer *shmBuf = mRawShmPool->acquire(width, height, shmFormat, false);
+        if (!shmBuf) {
+            WARNING(mLogCategory,"no shm buffer,drop renderbuf:%p",buf);
+            goto rawbuf_fail;
+        }
+        ret = shmBuf->copyFrame(mBufferFormat, buf->raw.dataPtr, buf->raw.size);
+        if (ret != NO_ERROR) {
+            WARNING(mLogCategory,"copy raw buffer fail,drop renderbuf:%p",buf);
+            goto rawbuf_fail;
+        }
+        mWaylandPlugin->getFrameMonitor()->traceFrame(buf, PLUGIN_FRAME_STAGE_READY);
+        //the shm buffer is recycled by pool on its own,buf is given back when its commit is reported
+        commitShmBuffer(shmBuf, buf, realDisplayTime);
+        mWaylandPlugin->getFrameMonitor()->traceFrame(buf, PLUGIN_FRAME_STAGE_POSTED);
+        return true;
     }
 
     if (waylandBuf) {
         wlbuffer = waylandBuf->getWlBuffer();
     }
-    //if no wl_output, drop this buffer
-    if (mCurrentDisplayOutput->wlOutput == NULL) {
-        TRACE(mLogCategory,"No wl_output");
-        mWaylandPlugin->handleFrameDropped(buf);
-        mWaylandPlugin->handleBufferRelease(buf);
-        return;
-    }
-    if (wlbuffer) {
+    if (wlbuffer && held) {
+        {
+            Tls::Mutex::Autolock _l(mRenderMutex);
+            //the frame takes the place of the held one, both are released with the wl_buffer once
+            for (auto item = mCommittedBufferMap.begin(); item != mCommittedBufferMap.end(); item++) {
+                if (item->second == waylandBuf) {
+                    mCommittedBufferMap.erase(item);
+                    break;
+                }
+            }
+            std::pair<int64_t, WaylandBuffer *> item(buf->pts, waylandBuf);
+            mCommittedBufferMap.insert(item);
+        }
+        /*the very frame is shown again at the same place,nothing on screen changes.
+         no commit means no presentation event,the frame stays on screen,so it is
+         taken as shown at the next vblank of the presentation timeline*/
+        if (replacedBuf == buf && memcmp(&mVideoRect, &mCommittedVideoRect, sizeof(struct Rectangle)) == 0) {
+            int64_t presentTime = mWaylandPlugin->getVsyncClock()->getNextVsyncTime(Tls::Times::getSystemTimeUs());
+            TRACE(mLogCategory,"skip commit,wl_buffer:%p is held by weston,renderbuf:%p,present:%lld us",wlbuffer,buf,presentTime);
+            mWaylandPlugin->getFrameMonitor()->traceFrame(buf, PLUGIN_FRAME_STAGE_POSTED);
+            mWaylandPlugin->handleFrameDisplayed(buf, presentTime);
+            return true;
+        }
+        if (replacedBuf && replacedBuf != buf) {
+            //the frame committed before is superseded,report it if weston did not
+            if (waylandBuf->takeRedrawingPending()) {
+                mWaylandPlugin->handleFrameDropped(replacedBuf, PLUGIN_DROP_REASON_COMPOSITOR);
+            }
+            mWaylandPlugin->handleBufferRelease(replacedBuf);
+        }
+        //new contents or geometry,weston must sample the wl_buffer again
+        Tls::Mutex::Autolock _l(mRenderMutex);
+        TRACE(mLogCategory,"++attach held,renderbuf:%p,wl_buffer:%p(0,0,%d,%d)",buf,wlbuffer,mVideoRect.w,mVideoRect.h);
+        waylandBuf->attach(mVideoSurfaceWrapper);
+        if (mAmlConfigAPIList.enableSetPts) {
+            wl_surface_set_pts(mVideoSurfaceWrapper, realDisplayTime >> 32, realDisplayTime & 0xFFFFFFFF);
+        }
+        wl_surface_damage (mVideoSurfaceWrapper, 0, 0, mVideoRect.w, mVideoRect.h);
+        wl_surface_commit (mVideoSurfaceWrapper);
+        mCommittedVideoRect = mVideoRect;
+        markFlush();
+        mWaylandPlugin->getFrameMonitor()->traceFrame(buf, PLUGIN_FRAME_STAGE_POSTED);
+    } else if (wlbuffer) {
         Tls::Mutex::Autolock _l(mRenderMutex);
         ++mCommitCnt;
         uint32_t hiPts = realDisplayTime >> 32;
@@ -1322,6 +1790,10 @@ void WaylandDisplay::displayFrameBuffer(RenderBuffer * buf, int64_t realDisplayT
 
         wl_surface_damage (mVideoSurfaceWrapper, 0, 0, mVideoRect.w, mVideoRect.h);
         wl_surface_commit (mVideoSurfaceWrapper);
+        mCommittedVideoRect = mVideoRect;
+        markFlush();
+        mWaylandPlugin->getFrameMonitor()->traceFrame(buf, PLUGIN_FRAME_STAGE_POSTED);
+        checkScanout(waylandBuf);
         //insert this buffer to committed weston buffer manager
         std::pair<int64_t, WaylandBuffer *> item(buf->pts, waylandBuf);
         mCommittedBufferMap.insert(item);
@@ -1331,27 +1803,29 @@ void WaylandDisplay::displayFrameBuffer(RenderBuffer * buf, int64_t realDisplayT
         cleanSurface();
     }
 
-    wl_display_flush (mWlDisplay);
-
-    return;
+    return true;
 waylandbuf_fail:
     //notify dropped
-    mWaylandPlugin->handleFrameDropped(buf);
+    mWaylandPlugin->handleFrameDropped(buf, PLUGIN_DROP_REASON_ERROR);
     //notify app release this buf
     mWaylandPlugin->handleBufferRelease(buf);
     //delete waylandbuf
     delete waylandBuf;
     waylandBuf = NULL;
-    return;
+    return false;
+rawbuf_fail:
+    //the shm buffer stays free in pool
+    mWaylandPlugin->handleFrameDropped(buf, PLUGIN_DROP_REASON_ERROR);
+    mWaylandPlugin->handleBufferRelease(buf);
+    return false;
 }
 
-void WaylandDisplay::handleBufferReleaseCallback(WaylandBuffer *buf)
+void WaylandDisplay::handleBufferReleaseCallback(WaylandBuffer *buf, RenderBuffer *renderBuffer)
 {
     {
         Tls::Mutex::Autolock _l(mRenderMutex);
         --mCommitCnt;
         //remove buffer if this buffer is ready to release
-        RenderBuffer *renderBuffer = buf->getRenderBuffer();
         auto item = mCommittedBufferMap.find(renderBuffer->pts);
         if (item != mCommittedBufferMap.end()) {
             mCommittedBufferMap.erase(item);
@@ -1360,23 +1834,20 @@ void WaylandDisplay::handleBufferReleaseCallback(WaylandBuffer *buf)
             return;
         }
     }
-    RenderBuffer *renderBuffer = buf->getRenderBuffer();
     TRACE(mLogCategory,"handle release renderBuffer :%p,priv:%p,PTS:%lld,realtime:%lld us,commitCnt:%d",renderBuffer,renderBuffer->priv,renderBuffer->pts/1000,buf->getRenderRealTime(),mCommitCnt);
     mWaylandPlugin->handleBufferRelease(renderBuffer);
 }
 
-void WaylandDisplay::handleFrameDisplayedCallback(WaylandBuffer *buf)
+void WaylandDisplay::handleFrameDisplayedCallback(WaylandBuffer *buf, RenderBuffer *renderBuffer, int64_t presentTime)
 {
-    RenderBuffer *renderBuffer = buf->getRenderBuffer();
     TRACE(mLogCategory,"handle displayed renderBuffer :%p,PTS:%lld us,realtime:%lld us",renderBuffer,renderBuffer->pts/1000,buf->getRenderRealTime());
-    mWaylandPlugin->handleFrameDisplayed(renderBuffer);
+    mWaylandPlugin->handleFrameDisplayed(renderBuffer, presentTime);
 }
 
-void WaylandDisplay::handleFrameDropedCallback(WaylandBuffer *buf)
+void WaylandDisplay::handleFrameDropedCallback(WaylandBuffer *buf, RenderBuffer *renderBuffer)
 {
-    RenderBuffer *renderBuffer = buf->getRenderBuffer();
     TRACE(mLogCategory,"handle droped renderBuffer :%p,PTS:%lld us,realtime:%lld us",renderBuffer,renderBuffer->pts/1000,buf->getRenderRealTime());
-    mWaylandPlugin->handleFrameDropped(renderBuffer);
+    mWaylandPlugin->handleFrameDropped(renderBuffer, PLUGIN_DROP_REASON_COMPOSITOR);
 }
 
 
@@ -1397,6 +1868,8 @@ bool WaylandDisplay::threadLoop()
       wl_display_dispatch_queue_pending (mWlDisplay, mWlQueue);
     }
 
+    //write requests of dispatched callbacks and of requestFlush
+    mFlushPending.store(false, std::memory_order_release);
     wl_display_flush (mWlDisplay);
 
     /*poll timeout value must > 300 ms,otherwise zwp_linux_dmabuf will create failed,
@@ -1406,7 +1879,8 @@ bool WaylandDisplay::threadLoop()
         WARNING(mLogCategory,"poll error");
         wl_display_cancel_read(mWlDisplay);
         return false;
-    } else if (ret == 0) { //poll time out
+    } else if (ret == 0) { //poll time out or woken up by requestFlush
+        wl_display_cancel_read(mWlDisplay);
         return true; //run loop
     }
 
@@ -1482,38 +1956,48 @@ void WaylandDisplay::updateBorders()
     }
 
     RenderVideoFormat format = VIDEO_FORMAT_BGRA;
-    mAreaShmBuffer = new WaylandShmBuffer(this, mLogCategory);
-    struct wl_buffer *wlbuf = mAreaShmBuffer->constructWlBuffer(width, height, format);
-    if (wlbuf == NULL) {
-        delete mAreaShmBuffer;
-        mAreaShmBuffer = NULL;
+    //the attached border buffer still fits,attach it again
+    if (!mAreaShmBuffer || mAreaShmBuffer->getWidth() != width ||
+        mAreaShmBuffer->getHeight() != height) {
+        mAreaShmBuffer = mShmPool->acquire(width, height, format, true);
+    }
+    if (mAreaShmBuffer == NULL) {
+        wl_surface_attach(mAreaSurfaceWrapper, NULL, 0, 0);
+        return;
     }
 
-    wl_surface_attach(mAreaSurfaceWrapper, wlbuf, 0, 0);
+    mShmPool->attach(mAreaShmBuffer, mAreaSurfaceWrapper);
 }
 
-std::size_t WaylandDisplay::calculateDmaBufferHash(RenderDmaBuffer &dmabuf)
+void WaylandDisplay::makeWaylandBufferKey(RenderDmaBuffer &dmabuf, WaylandBufferKey *key)
 {
-    std::string hashString("");
-    for (int i = 0; i < dmabuf.planeCnt; i++) {
-        char hashtmp[1024];
-        snprintf (hashtmp, 1024, "%d%d%d%d%d%d", dmabuf.width,dmabuf.height,dmabuf.planeCnt,
-                dmabuf.stride[i],dmabuf.offset[i],dmabuf.fd[i]);
-        std::string tmp(hashtmp);
-        hashString += tmp;
-    }
+    int planeCnt = dmabuf.planeCnt < RENDER_MAX_PLANES ? dmabuf.planeCnt : RENDER_MAX_PLANES;
+    struct stat st;
 
-    std::size_t hashval = std::hash<std::string>()(hashString);
-    //TRACE(mLogCategory,"hashstr:%s,val:%zu",hashString.c_str(),hashval);
-    return hashval;
+    memset(key, 0, sizeof(WaylandBufferKey));
+    key->width = dmabuf.width;
+    key->height = dmabuf.height;
+    key->planeCnt = dmabuf.planeCnt;
+    for (int i = 0; i < planeCnt; i++) {
+        //an invalid fd keeps zero identity, it fails to import anyway
+        if (fstat(dmabuf.fd[i], &st) == 0) {
+            key->dev[i] = st.st_dev;
+            key->ino[i] = st.st_ino;
+        } else {
+            WARNING(mLogCategory,"fstat fd[%d]:%d failed %d",i,dmabuf.fd[i],errno);
+        }
+        key->fd[i] = dmabuf.fd[i];
+        key->stride[i] = dmabuf.stride[i];
+        key->offset[i] = dmabuf.offset[i];
+    }
 }
 
 void WaylandDisplay::addWaylandBuffer(RenderBuffer * buf, WaylandBuffer *waylandbuf)
 {
     if (buf->flag & BUFFER_FLAG_DMA_BUFFER) {
-        std::size_t hashval = calculateDmaBufferHash(buf->dma);
-        std::pair<std::size_t, WaylandBuffer *> item(hashval, waylandbuf);
-        //TRACE(mLogCategory,"fd:%d,w:%d,h:%d,%p,hash:%zu",buf->dma.fd[0],buf->dma.width,buf->dma.height,waylandbuf,hashval);
+        WaylandBufferKey key;
+        makeWaylandBufferKey(buf->dma, &key);
+        std::pair<WaylandBufferKey, WaylandBuffer *> item(key, waylandbuf);
         mWaylandBuffersMap.insert(item);
     }
 
@@ -1535,10 +2019,18 @@ void WaylandDisplay::addWaylandBuffer(RenderBuffer * buf, WaylandBuffer *wayland
     TRACE(mLogCategory,"mWaylandBuffersMap size:%d",mWaylandBuffersMap.size());
 }
 
+void WaylandDisplay::removeWaylandBuffer(RenderBuffer * buf)
+{
+    WaylandBufferKey key;
+    makeWaylandBufferKey(buf->dma, &key);
+    mWaylandBuffersMap.erase(key);
+}
+
 WaylandBuffer* WaylandDisplay::findWaylandBuffer(RenderBuffer * buf)
 {
-    std::size_t hashval = calculateDmaBufferHash(buf->dma);
-    auto item = mWaylandBuffersMap.find(hashval);
+    WaylandBufferKey key;
+    makeWaylandBufferKey(buf->dma, &key);
+    auto item = mWaylandBuffersMap.find(key);
     if (item == mWaylandBuffersMap.end()) {
         return NULL;
     }
@@ -1546,6 +2038,117 @@ WaylandBuffer* WaylandDisplay::findWaylandBuffer(RenderBuffer * buf)
     return (WaylandBuffer*) item->second;
 }
 
+RenderVideoFormat WaylandDisplay::getRawShmFormat()
+{
+    uint32_t shmFormat;
+
+    //show raw frames as is if weston accepts the format,
+    //otherwise convert them to xrgb8888 which every compositor supports
+    if (toShmBufferFormat(mBufferFormat, &shmFormat) == NO_ERROR &&
+        Tls::PixelConverter::canConvert(mBufferFormat, mBufferFormat)) {
+        return mBufferFormat;
+    }
+    if (Tls::PixelConverter::canConvert(mBufferFormat, VIDEO_FORMAT_BGRx) &&
+        toShmBufferFormat(VIDEO_FORMAT_BGRx, &shmFormat) == NO_ERROR) {
+        return VIDEO_FORMAT_BGRx;
+    }
+    return VIDEO_FORMAT_UNKNOWN;
+}
+
+void WaylandDisplay::rawFrameCallback(void *data, struct wl_callback *callback, uint32_t time)
+{
+    WaylandDisplay *self = static_cast<WaylandDisplay *>(data);
+    int64_t presentTime = self->handleFrameCallbackTime(time);
+    self->setRedrawingPending(false);
+    //with wp_presentation the frame is reported by its feedback,not found here
+    self->handleRawFrameDone(callback, NULL, presentTime);
+    wl_callback_destroy (callback);
+}
+
+void WaylandDisplay::rawPresentationSyncOutput(void *data, struct wp_presentation_feedback *feedback,
+                    struct wl_output *output)
+{
+}
+
+void WaylandDisplay::rawPresentationPresented(void *data, struct wp_presentation_feedback *feedback,
+                    uint32_t secHi, uint32_t secLo, uint32_t nsec, uint32_t refresh,
+                    uint32_t seqHi, uint32_t seqLo, uint32_t flags)
+{
+    WaylandDisplay *self = static_cast<WaylandDisplay *>(data);
+    int64_t presentTime = self->handlePresentationTime(secHi, secLo, nsec, seqHi, seqLo, flags);
+    self->handleRawFrameDone(NULL, feedback, presentTime);
+    wp_presentation_feedback_destroy(feedback);
+}
+
+void WaylandDisplay::rawPresentationDiscarded(void *data, struct wp_presentation_feedback *feedback)
+{
+    WaylandDisplay *self = static_cast<WaylandDisplay *>(data);
+    self->handleRawFrameDone(NULL, feedback, -1);
+    wp_presentation_feedback_destroy(feedback);
+}
+
+static const struct wl_callback_listener raw_frame_callback_listener = {
+    WaylandDisplay::rawFrameCallback
+};
+
+static const struct wp_presentation_feedback_listener raw_presentation_feedback_listener = {
+    WaylandDisplay::rawPresentationSyncOutput,
+    WaylandDisplay::rawPresentationPresented,
+    WaylandDisplay::rawPresentationDiscarded,
+};
+
+void WaylandDisplay::handleRawFrameDone(struct wl_callback *callback, struct wp_presentation_feedback *feedback, int64_t presentTime)
+{
+    RenderBuffer *buf = NULL;
+    {
+        Tls::Mutex::Autolock _l(mRenderMutex);
+        for (auto item = mRawFrames.begin(); item != mRawFrames.end(); item++) {
+            if ((callback && item->callback == callback) || (feedback && item->feedback == feedback)) {
+                buf = item->buf;
+                mRawFrames.erase(item);
+                break;
+            }
+        }
+    }
+    if (!buf) {
+        return;
+    }
+    TRACE(mLogCategory,"raw renderBuffer:%p,PTS:%lld us,present:%lld us",buf,buf->pts/1000,presentTime);
+    if (presentTime >= 0) {
+        mWaylandPlugin->handleFrameDisplayed(buf, presentTime);
+    } else {
+        //superseded before it was shown
+        mWaylandPlugin->handleFrameDropped(buf, PLUGIN_DROP_REASON_COMPOSITOR);
+    }
+    mWaylandPlugin->handleBufferRelease(buf);
+}
+
+void WaylandDisplay::commitShmBuffer(WaylandShmBuffer *shmBuf, RenderBuffer *buf, int64_t realDisplayTime)
+{
+    Tls::Mutex::Autolock _l(mRenderMutex);
+    RawFrame frame = {buf, NULL, NULL};
+    struct wl_callback *callback = wl_surface_frame (mVideoSurfaceWrapper);
+    wl_callback_add_listener (callback, &raw_frame_callback_listener, this);
+    setRedrawingPending(true);
+    if (mPresentation) {
+        frame.feedback = wp_presentation_feedback(mPresentation, mVideoSurfaceWrapper);
+        wp_presentation_feedback_add_listener(frame.feedback, &raw_presentation_feedback_listener, this);
+    } else {
+        frame.callback = callback;
+    }
+    mRawFrames.push_back(frame);
+
+    TRACE(mLogCategory,"++attach shm,wl_buffer:%p(0,0,%d,%d)",shmBuf->getWlBuffer(),mVideoRect.w,mVideoRect.h);
+    mRawShmPool->attach(shmBuf, mVideoSurfaceWrapper);
+    if (mAmlConfigAPIList.enableSetPts) {
+        wl_surface_set_pts(mVideoSurfaceWrapper, realDisplayTime >> 32, realDisplayTime & 0xFFFFFFFF);
+    }
+    wl_surface_damage (mVideoSurfaceWrapper, 0, 0, mVideoRect.w, mVideoRect.h);
+    wl_surface_commit (mVideoSurfaceWrapper);
+    mCommittedVideoRect = mVideoRect;
+    markFlush();
+}
+
 void WaylandDisplay::cleanAllWaylandBuffer()
 {
     //free all obtain buff
@@ -1554,6 +2157,20 @@ void WaylandDisplay::cleanAllWaylandBuffer()
         mWaylandBuffersMap.erase(item++);
         delete waylandbuf;
     }
+    //raw frames whose commit was not reported, dispatch is stopped already
+    std::list<RawFrame> rawFrames;
+    {
+        Tls::Mutex::Autolock _l(mRenderMutex);
+        rawFrames.swap(mRawFrames);
+    }
+    for (auto &frame : rawFrames) {
+        if (frame.feedback) {
+            wp_presentation_feedback_destroy(frame.feedback);
+        }
+        mWaylandPlugin->handleFrameDropped(frame.buf, PLUGIN_DROP_REASON_FLUSH);
+        mWaylandPlugin->handleBufferRelease(frame.buf);
+    }
+    mRawShmPool->clear();
 }
 
 void WaylandDisplay::flushBuffers()
@@ -1563,7 +2180,7 @@ void WaylandDisplay::flushBuffers()
     for (auto item = mCommittedBufferMap.begin(); item != mCommittedBufferMap.end(); item++) {
         WaylandBuffer *waylandbuf = (WaylandBuffer*)item->second;
         waylandbuf->forceRedrawing();
-        handleFrameDisplayedCallback(waylandbuf);
+        handleFrameDisplayedCallback(waylandbuf, waylandbuf->getRenderBuffer(), 0);
     }
 }
 
@@ -1574,6 +2191,8 @@ void WaylandDisplay::cleanSurface()
     wl_surface_commit (mVideoSurfaceWrapper);
     wl_surface_attach (mAreaSurfaceWrapper, NULL, 0, 0);
     wl_surface_commit (mAreaSurfaceWrapper);
+    memset(&mCommittedVideoRect, 0, sizeof(struct Rectangle));
+    markFlush();
 }
 
 void WaylandDisplay::setKeepLastFrame(int keep)
@@ -17,9 +17,11 @@
 #define __WAYLAND_DISPLAY_H__
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <poll.h>
 #include <list>
+#include <atomic>
 #include <unordered_map>
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
@@ -28,8 +30,10 @@
 #include "linux-dmabuf-unstable-v1-client-protocol.h"
 #include "linux-explicit-synchronization-unstable-v1-client-protocol.h"
 #include "viewporter-client-protocol.h"
+#include "presentation-time-client-protocol.h"
 #include "weston-direct-display-client-protocol.h"
 #include "aml-config-client-protocol.h"
+#include "wayland_dma_feedback.h"
 #include "wayland-cursor.h"
 #include "Thread.h"
 #include "Poll.h"
@@ -41,8 +45,48 @@ using namespace std;
 
 class WaylandPlugin;
 class WaylandShmBuffer;
+class WaylandShmPool;
+class WaylandDmaFeedback;
 class WaylandBuffer;
 
+/**
+ * @brief identity of a dma buffer,it keys reused wayland buffers.
+ * planes are identified by fd and dma buffer inode. since kernel 5.3
+ * every dma buffer has its own inode, so a fd number reused by a new
+ * dma buffer is not aliased. older kernels give all dma buffers one
+ * anon inode, there the fd tells buffers apart.
+ * it is plain data, unused planes and padding are zero, so it is
+ * hashed and compared as a whole without formatting
+ */
+typedef struct _WaylandBufferKey {
+    uint64_t dev[RENDER_MAX_PLANES];
+    uint64_t ino[RENDER_MAX_PLANES];
+    int fd[RENDER_MAX_PLANES];
+    int width;
+    int height;
+    int planeCnt;
+    uint32_t stride[RENDER_MAX_PLANES];
+    uint32_t offset[RENDER_MAX_PLANES];
+} WaylandBufferKey;
+
+struct WaylandBufferKeyHash {
+    std::size_t operator()(const WaylandBufferKey &key) const {
+        //fnv-1a over 32 bits words, padding is zeroed
+        const uint32_t *words = (const uint32_t *)&key;
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (std::size_t i = 0; i < sizeof(WaylandBufferKey)/sizeof(uint32_t); i++) {
+            hash = (hash ^ words[i]) * 0x100000001b3ULL;
+        }
+        return (std::size_t)(hash ^ (hash >> 32));
+    };
+};
+
+struct WaylandBufferKeyEqual {
+    bool operator()(const WaylandBufferKey &a, const WaylandBufferKey &b) const {
+        return memcmp(&a, &b, sizeof(WaylandBufferKey)) == 0;
+    };
+};
+
 class WaylandDisplay : public Tls::Thread{
   public:
     typedef struct {
@@ -68,10 +112,41 @@ class WaylandDisplay : public Tls::Thread{
     void closeDisplay();
     /**
      * @brief change RenderVideoFormat to wayland protocol dma buffer format
-     * and get the matched dmabuffer modifiers
+     * and get the modifier of the dma buffers set by setDmaBufferModifier,
+     * compositor formats are only checked, a modifier it did not advertise
+     * is warned and still used
      *
+     * @return ERROR_NOT_FOUND if compositor did not advertise the format
      */
     int toDmaBufferFormat(RenderVideoFormat format, uint32_t *outDmaformat /*out param*/, uint64_t *outDmaformatModifiers /*out param*/);
+    /**
+     * @brief check whether compositor advertised the dmabuf format with
+     * this explicit modifier, only such buffers are safe to create with
+     * create_immed, a failed import of them is not expected
+     */
+    bool isDmaBufferModifierAdvertised(uint32_t dmaformat, uint64_t modifier);
+    /**
+     * @brief replace the dmabuf formats and modifiers with the ones
+     * of a dmabuf feedback, once surface feedback is received,
+     * default feedback is ignored
+     *
+     * @param formats format -> modifiers in compositor preference order
+     * @param surfaceFeedback true if formats is from video surface feedback
+     */
+    void setDmaBufferFormats(const DmaBufferFormatMap &formats, bool surfaceFeedback);
+    /**
+     * @brief check whether compositor can scanout the format directly,
+     * only known with dmabuf feedback
+     *
+     * @param format RenderVideoFormat
+     * @return true if a modifier of the format is in a scanout tranche
+     */
+    bool canScanout(RenderVideoFormat format);
+    /**
+     * @brief get the scanout state and the format and modifier compositor
+     * can scanout the video in, app reallocates its buffers in them
+     */
+    void getScanoutFormat(PluginScanoutFormat *scanoutFormat);
     /**
      * @brief change RenderVideoFormat to wayland protocol shm buffer format
      *
@@ -89,6 +164,12 @@ class WaylandDisplay : public Tls::Thread{
     RenderVideoFormat getVideoBufferFormat() {
         return mBufferFormat;
     };
+    /**
+     * @brief set the format modifier of the dma buffers app posts,
+     * RenderDmaBuffer carries none, default is DRM_FORMAT_MOD_LINEAR
+     */
+    void setDmaBufferModifier(uint64_t modifier);
+    uint64_t getDmaBufferModifier();
     struct wl_display *getWlDisplay() {
         return mWlDisplay;
     };
@@ -146,9 +227,7 @@ class WaylandDisplay : public Tls::Thread{
     */
     void setPip(int pip);
 
-    void setRedrawingPending(bool val) {
-        mRedrawingPending = val;
-    };
+    void setRedrawingPending(bool val);
 
     bool isRedrawingPending() {
         return mRedrawingPending;
@@ -161,12 +240,59 @@ class WaylandDisplay : public Tls::Thread{
     void setWindowSize(int x, int y, int w, int h);
     int  prepareFrameBuffer(RenderBuffer * buf);
     void displayFrameBuffer(RenderBuffer * buf, int64_t realDisplayTime);
+    //commit frames in order and flush wayland display once
+    void displayFrameBuffers(RenderBuffer **bufs, int64_t *realDisplayTimes, int count);
     void setOpaque();
     void flushBuffers();
+    /**
+     * @brief protocol requests were queued,they are written by the
+     * next flushDisplay of this tick or the display thread
+     */
+    void markFlush() {
+        mFlushPending.store(true, std::memory_order_release);
+    };
+    /**
+     * @brief write queued requests to compositor if any, it is
+     * called once at the end of a display tick
+     */
+    void flushDisplay();
+    /**
+     * @brief let display thread write queued requests, for paths that
+     * are not followed by flushDisplay, requests of one tick share
+     * one wakeup and one flush
+     */
+    void requestFlush();
     void ensureFullscreen(bool fullscreen);
-    void handleBufferReleaseCallback(WaylandBuffer *buf);
-    void handleFrameDisplayedCallback(WaylandBuffer *buf);
-    void handleFrameDropedCallback(WaylandBuffer *buf);
+    //renderBuffer is the frame buf held,buf no longer holds it when released
+    void handleBufferReleaseCallback(WaylandBuffer *buf, RenderBuffer *renderBuffer);
+    //presentTime is monotonic time the frame showed,us,0 if unknown
+    void handleFrameDisplayedCallback(WaylandBuffer *buf, RenderBuffer *renderBuffer, int64_t presentTime);
+    /**
+     * @brief feed frame callback time to vsync clock,weston sends frame
+     * callback at the repaint of a vsync
+     * @param timeMs frame callback time,low 32 bits of monotonic ms
+     * @return frame callback time extended to monotonic us
+     */
+    int64_t handleFrameCallbackTime(uint32_t timeMs);
+    /**
+     * @brief feed a wp_presentation presented time to vsync clock,
+     * the time is the hardware flip of the frame, and a vsync'd
+     * presentation carries the vblank sequence
+     * @param secHi,secLo,nsec presentation time in presentation clock
+     * @param seqHi,seqLo vblank counter, 0 if unknown
+     * @param flags wp_presentation_feedback_kind bits
+     * @return presentation time in monotonic us
+     */
+    int64_t handlePresentationTime(uint32_t secHi, uint32_t secLo, uint32_t nsec,
+                    uint32_t seqHi, uint32_t seqLo, uint32_t flags);
+    /**
+     * @brief wp_presentation if compositor supports it, frames are
+     * reported displayed or dropped by its feedback instead of frame callbacks
+     */
+    struct wp_presentation *getPresentation() {
+        return mPresentation;
+    };
+    void handleFrameDropedCallback(WaylandBuffer *buf, RenderBuffer *renderBuffer);
 
     //thread func
     void readyToRun();
@@ -180,6 +306,14 @@ class WaylandDisplay : public Tls::Thread{
             uint32_t id, const char *interface, uint32_t version);
     static void registryHandleGlobalRemove (void *data, struct wl_registry *registry, uint32_t name);
     static void shmFormat (void *data, struct wl_shm *wl_shm, uint32_t format);
+    static void presentationClockId (void *data, struct wp_presentation *presentation, uint32_t clockId);
+    static void rawFrameCallback(void *data, struct wl_callback *callback, uint32_t time);
+    static void rawPresentationSyncOutput(void *data, struct wp_presentation_feedback *feedback,
+                    struct wl_output *output);
+    static void rawPresentationPresented(void *data, struct wp_presentation_feedback *feedback,
+                    uint32_t secHi, uint32_t secLo, uint32_t nsec, uint32_t refresh,
+                    uint32_t seqHi, uint32_t seqLo, uint32_t flags);
+    static void rawPresentationDiscarded(void *data, struct wp_presentation_feedback *feedback);
     static void outputHandleGeometry( void *data,
                                   struct wl_output *output,
                                   int x,
@@ -268,10 +402,25 @@ class WaylandDisplay : public Tls::Thread{
     void resizeVideoSurface(bool commit);
     void videoCenterRect(Rectangle src, Rectangle dst, Rectangle *result, bool scaling);
     void updateBorders();
-    std::size_t calculateDmaBufferHash(RenderDmaBuffer &dmabuf);
+    void makeWaylandBufferKey(RenderDmaBuffer &dmabuf, WaylandBufferKey *key);
+    /*count a committed dma frame by scanout state,the state is
+     re-evaluated if its dmabuf format or modifier changed*/
+    void checkScanout(WaylandBuffer *waylandBuf);
+    /*evaluate scanout state from surface feedback, mMutex must be held*/
+    void updateScanoutState();
     void cleanSurface();
+    //attach and commit a frame without flushing,true if display needs a flush
+    bool commitFrameBuffer(RenderBuffer * buf, int64_t realDisplayTime);
     void addWaylandBuffer(RenderBuffer * buf, WaylandBuffer *waylandbuf);
     WaylandBuffer* findWaylandBuffer(RenderBuffer * buf);
+    void removeWaylandBuffer(RenderBuffer * buf);
+    //the shm format raw frames are copied to,VIDEO_FORMAT_UNKNOWN if none
+    RenderVideoFormat getRawShmFormat();
+    //attach and commit a shm buffer raw frame buf is copied to,buf is held until the commit is reported
+    void commitShmBuffer(WaylandShmBuffer *shmBuf, RenderBuffer *buf, int64_t realDisplayTime);
+    /*report and release the raw frame committed with callback or feedback,
+     presentTime < 0 if compositor discarded it*/
+    void handleRawFrameDone(struct wl_callback *callback, struct wp_presentation_feedback *feedback, int64_t presentTime);
     void cleanAllWaylandBuffer();
 
     WaylandPlugin *mWaylandPlugin;
@@ -284,6 +433,8 @@ class WaylandDisplay : public Tls::Thread{
     struct wl_subcompositor *mSubCompositor;
     struct xdg_wm_base *mXdgWmBase;
     struct wp_viewporter *mViewporter;
+    struct wp_presentation *mPresentation;
+    uint32_t mPresentationClock; //clockid_t of presentation timestamps
     struct zwp_linux_dmabuf_v1 *mDmabuf;
     struct wl_shm *mShm;
     struct wl_seat *mSeat;
@@ -301,7 +452,20 @@ class WaylandDisplay : public Tls::Thread{
     int mLogCategory;
 
     std::list<uint32_t> mShmFormats;
-    std::unordered_map<uint32_t, uint64_t> mDmaBufferFormats;
+    DmaBufferFormatMap mDmaBufferFormats;
+    WaylandDmaFeedback *mDefaultFeedback;
+    WaylandDmaFeedback *mSurfaceFeedback;
+    bool mHasSurfaceFeedback; //formats are from surface feedback
+    /*direct scanout state of the video surface, refer to PluginScanoutState,
+     it is known with surface feedback and a committed dma frame*/
+    int mScanoutState;
+    uint32_t mScanoutDmaFormat; //dmabuf format and modifier of latest committed dma frame
+    uint64_t mScanoutModifier;
+    bool mScanoutFallback; //fell back from direct scanout and still composited
+    //format and modifier of the first scanout tranche,the committed format is preferred
+    uint32_t mPreferredScanoutFormat;
+    uint64_t mPreferredScanoutModifier;
+    uint64_t mDmaBufferModifier; //layout of dma buffers posted by app
     RenderVideoFormat mBufferFormat;
 
     mutable Tls::Mutex mBufferMutex;
@@ -320,7 +484,8 @@ class WaylandDisplay : public Tls::Thread{
     struct xdg_toplevel *mXdgToplevel;
     struct wp_viewport *mAreaViewport;
     struct wp_viewport *mVideoViewport;
-    WaylandShmBuffer *mAreaShmBuffer;
+    WaylandShmBuffer *mAreaShmBuffer; //owned by mShmPool
+    WaylandShmPool *mShmPool;
     bool mXdgSurfaceConfigured;
     Tls::Condition mConfigureCond;
     Tls::Mutex mConfigureMutex;
@@ -345,9 +510,25 @@ class WaylandDisplay : public Tls::Thread{
 
     //the count display buffer of committed to weston
     int mCommitCnt;
+    /* video rectangle of latest video surface commit, a frame whose wl_buffer
+     is still held by weston is not committed again if it is unchanged */
+    struct Rectangle mCommittedVideoRect;
+    //requests are queued but not written to compositor
+    std::atomic<bool> mFlushPending;
 
     /*store waylandbuffers when set reusing waylandbuffer flag*/
-    std::unordered_map<std::size_t, WaylandBuffer *> mWaylandBuffersMap;
+    std::unordered_map<WaylandBufferKey, WaylandBuffer *, WaylandBufferKeyHash, WaylandBufferKeyEqual> mWaylandBuffersMap;
+    /*shm buffers that raw frames are copied into,recycled once weston releases them,
+     it is apart from mShmPool so the border buffer is never trimmed by video*/
+    WaylandShmPool *mRawShmPool;
+    /*a committed raw frame,it is reported by presentation feedback of its
+     commit,or by frame callback if wp_presentation is not supported*/
+    typedef struct _RawFrame {
+        RenderBuffer *buf;
+        struct wl_callback *callback;
+        struct wp_presentation_feedback *feedback;
+    } RawFrame;
+    std::list<RawFrame> mRawFrames; //guarded by mRenderMutex
     bool mNoBorderUpdate;
 
     /*store committed to weston waylandbuffer,key is pts*/
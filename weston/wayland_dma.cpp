@@ -30,22 +30,50 @@
 #include "wayland_dma.h"
 #include "Logger.h"
 #include "wayland_display.h"
+#include "wayland_videoformat.h"
 #include "ErrorCode.h"
+#include "Times.h"
 
 #define TAG "rlib:wayland_dma"
 
+/*a params reply may be in dispatch on the display thread while its
+ owner is destroyed on the render thread,so reply handlers get the
+ owner from the params user data under this lock,and the owner
+ clears the user data under it before it goes away*/
+static Tls::Mutex g_paramsMutex;
+//params user data of a pending create its reply handler destroys
+static char g_orphanedParams;
+
 WaylandDmaBuffer::WaylandDmaBuffer(WaylandDisplay *display, int logCategory)
     : mDisplay(display),
     mLogCategory(logCategory)
 {
     mRenderDmaBuffer = {0,};
     mWlBuffer = NULL;
+    mParams = NULL;
+    mCreatePending = false;
+    mFailed = false;
+    mDmaFormat = 0;
+    mModifier = 0;
     mData = NULL;
     mSize = 0;
 }
 
 WaylandDmaBuffer::~WaylandDmaBuffer()
 {
+    Tls::Mutex::Autolock _g(g_paramsMutex);
+    Tls::Mutex::Autolock _l(mMutex);
+    if (mParams) {
+        if (mCreatePending) {
+            //do not wait for the reply, its handler destroys params and the wl_buffer
+            DEBUG(mLogCategory,"leave pending params %p to its reply",mParams);
+            zwp_linux_buffer_params_v1_set_user_data (mParams, &g_orphanedParams);
+        } else {
+            zwp_linux_buffer_params_v1_set_user_data (mParams, NULL);
+            zwp_linux_buffer_params_v1_destroy (mParams);
+        }
+        mParams = NULL;
+    }
     //release wl_buffer
     if (mWlBuffer) {
         TRACE(mLogCategory,"destroy wl_buffer %p",mWlBuffer);
@@ -58,20 +86,47 @@ void WaylandDmaBuffer::dmabufCreateSuccess(void *data,
             struct zwp_linux_buffer_params_v1 *params,
             struct wl_buffer *new_buffer)
 {
-    WaylandDmaBuffer *waylandDma = static_cast<WaylandDmaBuffer*>(data);
+    Tls::Mutex::Autolock _g(g_paramsMutex);
+    void *owner = zwp_linux_buffer_params_v1_get_user_data (params);
+    if (owner == &g_orphanedParams) {
+        wl_buffer_destroy (new_buffer);
+        zwp_linux_buffer_params_v1_destroy (params);
+        return;
+    } else if (!owner) {
+        wl_buffer_destroy (new_buffer);
+        return;
+    }
+    WaylandDmaBuffer *waylandDma = static_cast<WaylandDmaBuffer*>(owner);
     TRACE(waylandDma->mLogCategory,"++create dma wl_buffer:%p ",new_buffer);
     Tls::Mutex::Autolock _l(waylandDma->mMutex);
     waylandDma->mWlBuffer = new_buffer;
+    zwp_linux_buffer_params_v1_destroy (params);
+    waylandDma->mParams = NULL;
+    waylandDma->mCreatePending = false;
     waylandDma->mCondition.signal();
 }
 
 void WaylandDmaBuffer::dmabufCreateFail(void *data,
             struct zwp_linux_buffer_params_v1 *params)
 {
-    WaylandDmaBuffer *waylandDma = static_cast<WaylandDmaBuffer*>(data);
+    Tls::Mutex::Autolock _g(g_paramsMutex);
+    void *owner = zwp_linux_buffer_params_v1_get_user_data (params);
+    if (owner == &g_orphanedParams) {
+        zwp_linux_buffer_params_v1_destroy (params);
+        return;
+    } else if (!owner) {
+        //owner destroyed params already
+        return;
+    }
+    WaylandDmaBuffer *waylandDma = static_cast<WaylandDmaBuffer*>(owner);
     Tls::Mutex::Autolock _l(waylandDma->mMutex);
-    TRACE(waylandDma->mLogCategory,"!!!create dma wl_buffer fail");
-    waylandDma->mWlBuffer = NULL;
+    ERROR(waylandDma->mLogCategory,"!!!create dma wl_buffer fail,format:%s,modifier:%llx",
+            print_dmabuf_format_name(waylandDma->mDmaFormat),waylandDma->mModifier);
+    //a create_immed wl_buffer is inert after failed, it is hidden and destroyed with this object
+    zwp_linux_buffer_params_v1_destroy (params);
+    waylandDma->mParams = NULL;
+    waylandDma->mCreatePending = false;
+    waylandDma->mFailed = true;
     waylandDma->mCondition.signal();
 }
 
@@ -80,11 +135,11 @@ static const struct zwp_linux_buffer_params_v1_listener dmabuf_params_listener =
   WaylandDmaBuffer::dmabufCreateFail
 };
 
-struct wl_buffer *WaylandDmaBuffer::constructWlBuffer(RenderDmaBuffer *dmabuf, RenderVideoFormat format)
+int WaylandDmaBuffer::requestWlBuffer(RenderDmaBuffer *dmabuf, RenderVideoFormat format)
 {
     struct zwp_linux_buffer_params_v1 *params = NULL;
+    struct wl_buffer *wlbuffer = NULL;
     int ret;
-    int64_t timeout;
     uint64_t formatModifier = 0;
     uint32_t flags = 0;
     uint32_t dmabufferFormat;
@@ -92,27 +147,29 @@ struct wl_buffer *WaylandDmaBuffer::constructWlBuffer(RenderDmaBuffer *dmabuf, R
     ret = mDisplay->toDmaBufferFormat(format, &dmabufferFormat, &formatModifier);
     if (ret != NO_ERROR) {
         ERROR(mLogCategory,"Error change render video format to dmabuffer format fail");
-        return NULL;
+        return ERROR_INVALID_OPERATION;
     }
 
     //check dma buffer
     if (dmabuf->planeCnt < 0) {
         ERROR(mLogCategory,"Error dmabuf plane count is 0");
-        return NULL;
+        return ERROR_INVALID_OPERATION;
     }
     for (int i = 0; i < dmabuf->planeCnt; i++) {
         if (dmabuf->fd[i] <= 0) {
             ERROR(mLogCategory,"Error dmabuf plane fd is 0");
-            return NULL;
+            return ERROR_INVALID_OPERATION;
         }
     }
 
     memcpy(&mRenderDmaBuffer, dmabuf, sizeof(RenderDmaBuffer));
+    mDmaFormat = dmabufferFormat;
+    mModifier = formatModifier;
 
     params = zwp_linux_dmabuf_v1_create_params (mDisplay->getDmaBuf());
     if (!params) {
         ERROR(mLogCategory, "zwp_linux_dmabuf_v1_create_params fail");
-        return NULL;
+        return ERROR_INVALID_OPERATION;
     }
     //told weston to direct display drm buffer
     if (mDisplay->getWlDirectDisplay()) {
@@ -129,25 +186,65 @@ struct wl_buffer *WaylandDmaBuffer::constructWlBuffer(RenderDmaBuffer *dmabuf, R
                    formatModifier & 0xffffffff);
     }
 
-    /* Request buffer creation */
     zwp_linux_buffer_params_v1_add_listener (params, &dmabuf_params_listener, (void *)this);
+    /*create_immed hands back the wl_buffer at once, no round trip to weston is needed,
+     but weston kills the client if the import fails, so it is only used for
+     a format and explicit modifier that weston advertised*/
+    if (zwp_linux_dmabuf_v1_get_version (mDisplay->getDmaBuf()) >= ZWP_LINUX_BUFFER_PARAMS_V1_CREATE_IMMED_SINCE_VERSION &&
+        mDisplay->isDmaBufferModifierAdvertised(dmabufferFormat, formatModifier)) {
+        TRACE(mLogCategory,"zwp_linux_buffer_params_v1_create_immed,dma width:%d,height:%d,dmabufferformat:%d",dmabuf->width,dmabuf->height,dmabufferFormat);
+        wlbuffer = zwp_linux_buffer_params_v1_create_immed (params, dmabuf->width, dmabuf->height, dmabufferFormat, flags);
+        if (!wlbuffer) {
+            ERROR(mLogCategory,"zwp_linux_buffer_params_v1_create_immed fail");
+            zwp_linux_buffer_params_v1_destroy (params);
+            return ERROR_INVALID_OPERATION;
+        }
+        TRACE(mLogCategory,"++create dma wl_buffer:%p ",wlbuffer);
+        //keep params until the wl_buffer is used, a failed event may come
+        Tls::Mutex::Autolock _l(mMutex);
+        mParams = params;
+        mWlBuffer = wlbuffer;
+        return NO_ERROR;
+    }
+
+    /* Request buffer creation, the reply is dispatched by the display thread */
+    {
+        Tls::Mutex::Autolock _l(mMutex);
+        mParams = params;
+        mCreatePending = true;
+    }
     TRACE(mLogCategory,"zwp_linux_buffer_params_v1_create,dma width:%d,height:%d,dmabufferformat:%d",dmabuf->width,dmabuf->height,dmabufferFormat);
     zwp_linux_buffer_params_v1_create (params, dmabuf->width, dmabuf->height, dmabufferFormat, flags);
+    //display thread writes it and reads the reply
+    mDisplay->requestFlush();
 
-    /* Wait for the request answer */
-    wl_display_flush (mDisplay->getWlDisplay());
+    return NO_ERROR;
+}
+
+void WaylandDmaBuffer::setUsed()
+{
+    Tls::Mutex::Autolock _g(g_paramsMutex);
     Tls::Mutex::Autolock _l(mMutex);
-    if (!mWlBuffer) { //if this wlbuffer had created,don't wait zwp linux buffer callback
-        mWlBuffer =(struct wl_buffer *)0xffffffff;
-        while (mWlBuffer == (struct wl_buffer *)0xffffffff) { //try wait for 1000 ms
-            if (ERROR_TIMED_OUT == mCondition.waitRelative(mMutex, 1000/*microsecond*/)) {
-                WARNING(mLogCategory,"zwp_linux_buffer_params_v1_create timeout");
-                mWlBuffer = NULL;
+    //weston has the buffer now, an import failure is its protocol error
+    if (mParams && !mCreatePending) {
+        zwp_linux_buffer_params_v1_set_user_data (mParams, NULL);
+        zwp_linux_buffer_params_v1_destroy (mParams);
+        mParams = NULL;
+    }
+}
+
+struct wl_buffer *WaylandDmaBuffer::waitWlBuffer(int timeoutMs)
+{
+    Tls::Mutex::Autolock _l(mMutex);
+    if (mCreatePending && timeoutMs > 0) {
+        int64_t deadline = Tls::Times::getSystemTimeMs() + timeoutMs;
+        while (mCreatePending) {
+            int64_t left = deadline - Tls::Times::getSystemTimeMs();
+            if (left <= 0) {
+                break;
             }
+            mCondition.waitRelative(mMutex, left);
         }
     }
-    //destroy zwp linux buffer params
-    zwp_linux_buffer_params_v1_destroy (params);
-
-    return mWlBuffer;
-}
\ No newline at end of file
+    return (mCreatePending || mFailed) ? NULL : mWlBuffer;
+}
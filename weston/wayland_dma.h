@@ -28,7 +28,8 @@ class WaylandDmaBuffer : public WaylandWLWrap
     WaylandDmaBuffer(WaylandDisplay *display, int logCategory);
     virtual ~WaylandDmaBuffer();
     virtual struct wl_buffer *getWlBuffer() {
-        return mWlBuffer;
+        Tls::Mutex::Autolock _l(mMutex);
+        return mFailed ? NULL : mWlBuffer;
     };
     virtual void *getDataPtr() {
         return mData;
@@ -36,7 +37,36 @@ class WaylandDmaBuffer : public WaylandWLWrap
     virtual int getSize() {
         return mSize;
     };
-    struct wl_buffer *constructWlBuffer(RenderDmaBuffer *dmabuf, RenderVideoFormat format);
+    virtual bool isPending() {
+        Tls::Mutex::Autolock _l(mMutex);
+        return mCreatePending;
+    };
+    virtual void setUsed();
+    virtual bool getDmaFormat(uint32_t *format, uint64_t *modifier) {
+        *format = mDmaFormat;
+        *modifier = mModifier;
+        return true;
+    };
+    /**
+     * @brief request a wl_buffer for the dma buffer without waiting
+     * for the compositor. create_immed is used when the compositor
+     * advertised the format with this explicit modifier, so the wl_buffer
+     * is usable at once, its failed event is still listened until the
+     * wl_buffer is used. otherwise the wl_buffer is pending until the
+     * create reply is dispatched
+     *
+     * @param dmabuf the dma buffer
+     * @param format the video format of the dma buffer
+     * @return NO_ERROR if the wl_buffer was created or requested
+     */
+    int requestWlBuffer(RenderDmaBuffer *dmabuf, RenderVideoFormat format);
+    /**
+     * @brief wait for a pending wl_buffer request
+     *
+     * @param timeoutMs the max wait time in ms, 0 returns at once
+     * @return the wl_buffer, NULL if the request failed or is still pending
+     */
+    struct wl_buffer *waitWlBuffer(int timeoutMs);
     static void dmabufCreateSuccess(void *data,
             struct zwp_linux_buffer_params_v1 *params,
             struct wl_buffer *new_buffer);
@@ -45,7 +75,13 @@ class WaylandDmaBuffer : public WaylandWLWrap
   private:
     WaylandDisplay *mDisplay;
     RenderDmaBuffer mRenderDmaBuffer;
+    uint32_t mDmaFormat; //dmabuf format and modifier told to compositor
+    uint64_t mModifier;
     struct wl_buffer *mWlBuffer;
+    //alive while an async create is pending or a create_immed one is unused
+    struct zwp_linux_buffer_params_v1 *mParams;
+    bool mCreatePending; //async create is not answered yet
+    bool mFailed; //compositor failed to import the dma buffer
     mutable Tls::Mutex mMutex;
     Tls::Condition mCondition;
     void *mData;
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include "wayland_dma_feedback.h"
+#include "wayland_display.h"
+#include "wayland_videoformat.h"
+#include "ErrorCode.h"
+#include "Logger.h"
+
+#define TAG "rlib:wayland_dma_feedback"
+
+/*entry of format table, defined by linux-dmabuf protocol*/
+typedef struct {
+    uint32_t format;
+    uint32_t padding;
+    uint64_t modifier;
+} DmaFormatTableEntry;
+
+static const struct zwp_linux_dmabuf_feedback_v1_listener dmabuf_feedback_listener = {
+    WaylandDmaFeedback::feedbackDone,
+    WaylandDmaFeedback::feedbackFormatTable,
+    WaylandDmaFeedback::feedbackMainDevice,
+    WaylandDmaFeedback::feedbackTrancheDone,
+    WaylandDmaFeedback::feedbackTrancheTargetDevice,
+    WaylandDmaFeedback::feedbackTrancheFormats,
+    WaylandDmaFeedback::feedbackTrancheFlags,
+};
+
+WaylandDmaFeedback::WaylandDmaFeedback(WaylandDisplay *display, int logCategory)
+    : mDisplay(display),
+    mLogCategory(logCategory)
+{
+    mFeedback = NULL;
+    mSurface = false;
+    mFormatTable = NULL;
+    mFormatTableSize = 0;
+    mTrancheFlags = 0;
+}
+
+WaylandDmaFeedback::~WaylandDmaFeedback()
+{
+    if (mFeedback) {
+        zwp_linux_dmabuf_feedback_v1_destroy(mFeedback);
+        mFeedback = NULL;
+    }
+    unmapFormatTable();
+}
+
+int WaylandDmaFeedback::create(struct zwp_linux_dmabuf_v1 *dmabuf, struct wl_surface *surface)
+{
+    if (!dmabuf) {
+        return ERROR_PARAM_NULL;
+    }
+    if (zwp_linux_dmabuf_v1_get_version(dmabuf) < ZWP_LINUX_DMABUF_V1_GET_DEFAULT_FEEDBACK_SINCE_VERSION) {
+        return ERROR_INVALID_OPERATION;
+    }
+    if (surface) {
+        mFeedback = zwp_linux_dmabuf_v1_get_surface_feedback(dmabuf, surface);
+    } else {
+        mFeedback = zwp_linux_dmabuf_v1_get_default_feedback(dmabuf);
+    }
+    if (!mFeedback) {
+        ERROR(mLogCategory,"get %s dmabuf feedback fail",surface? "surface":"default");
+        return ERROR_UNKNOWN;
+    }
+    mSurface = surface? true: false;
+    zwp_linux_dmabuf_feedback_v1_add_listener(mFeedback, &dmabuf_feedback_listener, this);
+    return NO_ERROR;
+}
+
+void WaylandDmaFeedback::unmapFormatTable()
+{
+    if (mFormatTable) {
+        munmap(mFormatTable, mFormatTableSize);
+        mFormatTable = NULL;
+    }
+    mFormatTableSize = 0;
+}
+
+void WaylandDmaFeedback::feedbackDone(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback)
+{
+    WaylandDmaFeedback *self = static_cast<WaylandDmaFeedback *>(data);
+    DEBUG(self->mLogCategory,"%s dmabuf feedback done, formats:%d",
+            self->mSurface? "surface":"default",(int)self->mPendingFormats.size());
+    self->mDisplay->setDmaBufferFormats(self->mPendingFormats, self->mSurface);
+    self->mPendingFormats.clear();
+}
+
+void WaylandDmaFeedback::feedbackFormatTable(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    int32_t fd, uint32_t size)
+{
+    WaylandDmaFeedback *self = static_cast<WaylandDmaFeedback *>(data);
+    //a new table replaces the previous one
+    self->unmapFormatTable();
+    //the table is shared by compositor, it must be mapped private
+    void *table = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (table == MAP_FAILED) {
+        ERROR(self->mLogCategory,"mmap dmabuf format table fail,size:%u",size);
+        return;
+    }
+    self->mFormatTable = table;
+    self->mFormatTableSize = size;
+    TRACE(self->mLogCategory,"dmabuf format table entries:%d",(int)(size / sizeof(DmaFormatTableEntry)));
+}
+
+void WaylandDmaFeedback::feedbackMainDevice(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    struct wl_array *device)
+{
+    //buffers are allocated by app, the device compositor prefers is not used
+}
+
+void WaylandDmaFeedback::feedbackTrancheDone(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback)
+{
+    WaylandDmaFeedback *self = static_cast<WaylandDmaFeedback *>(data);
+    DmaFormatTableEntry *entries = (DmaFormatTableEntry *)self->mFormatTable;
+    uint32_t entryCnt = self->mFormatTableSize / sizeof(DmaFormatTableEntry);
+    bool scanout = (self->mTrancheFlags & ZWP_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_FLAGS_SCANOUT)? true: false;
+
+    TRACE(self->mLogCategory,"tranche done,indices:%d,scanout:%d",
+            (int)self->mTrancheIndices.size(),scanout);
+
+    for (auto index : self->mTrancheIndices) {
+        if (!entries || index >= entryCnt) {
+            WARNING(self->mLogCategory,"invalid format table index:%d,entries:%u",index,entryCnt);
+            continue;
+        }
+        uint32_t format = entries[index].format;
+        uint64_t modifier = entries[index].modifier;
+        if (wl_dmabuf_format_to_video_format(format) == VIDEO_FORMAT_UNKNOWN) {
+            continue;
+        }
+        //tranches come in preference order,keep the order of modifiers
+        std::vector<DmaBufferModifier> &modifiers = self->mPendingFormats[format];
+        bool found = false;
+        for (auto &item : modifiers) {
+            if (item.modifier == modifier) {
+                item.scanout = item.scanout || scanout;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            DmaBufferModifier item = {modifier, scanout};
+            modifiers.push_back(item);
+        }
+    }
+
+    //the next tranche starts with no flags and formats
+    self->mTrancheIndices.clear();
+    self->mTrancheFlags = 0;
+}
+
+void WaylandDmaFeedback::feedbackTrancheTargetDevice(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    struct wl_array *device)
+{
+    //tranches are told apart by flags only, the target device is not used
+}
+
+void WaylandDmaFeedback::feedbackTrancheFormats(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    struct wl_array *indices)
+{
+    WaylandDmaFeedback *self = static_cast<WaylandDmaFeedback *>(data);
+    uint16_t *index = (uint16_t *)indices->data;
+    size_t cnt = indices->size / sizeof(uint16_t);
+    //formats may be sent in several events of one tranche
+    self->mTrancheIndices.insert(self->mTrancheIndices.end(), index, index + cnt);
+}
+
+void WaylandDmaFeedback::feedbackTrancheFlags(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    uint32_t flags)
+{
+    WaylandDmaFeedback *self = static_cast<WaylandDmaFeedback *>(data);
+    self->mTrancheFlags = flags;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WAYLAND_DMA_FEEDBACK_H__
+#define __WAYLAND_DMA_FEEDBACK_H__
+#include <vector>
+#include <unordered_map>
+#include "linux-dmabuf-unstable-v1-client-protocol.h"
+
+class WaylandDisplay;
+
+/**
+ * @brief a drm format modifier advertised by compositor,
+ * scanout is true if the modifier is in a scanout tranche,
+ * buffers of it can be put on a plane without composition
+ */
+typedef struct _DmaBufferModifier {
+    uint64_t modifier;
+    bool scanout;
+} DmaBufferModifier;
+
+/*dmabuf format -> modifiers in compositor preference order*/
+typedef std::unordered_map<uint32_t, std::vector<DmaBufferModifier>> DmaBufferFormatMap;
+
+/**
+ * @brief listens zwp_linux_dmabuf_feedback_v1 (dmabuf version 4),
+ * it collects the format table and tranches of one feedback and
+ * hands the format/modifier set to display when done is received.
+ * default feedback is for all surfaces,surface feedback is for
+ * video surface and changes when the surface moves on/off a plane
+ */
+class WaylandDmaFeedback {
+  public:
+    WaylandDmaFeedback(WaylandDisplay *display, int logCategory);
+    virtual ~WaylandDmaFeedback();
+    /**
+     * @brief request feedback from compositor
+     *
+     * @param dmabuf the bound zwp_linux_dmabuf_v1, version must >= 4
+     * @param surface get surface feedback of it, NULL get default feedback
+     * @return int 0 success,other fail
+     */
+    int create(struct zwp_linux_dmabuf_v1 *dmabuf, struct wl_surface *surface);
+    bool isSurfaceFeedback() {
+        return mSurface;
+    };
+    static void feedbackDone(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback);
+    static void feedbackFormatTable(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    int32_t fd, uint32_t size);
+    static void feedbackMainDevice(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    struct wl_array *device);
+    static void feedbackTrancheDone(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback);
+    static void feedbackTrancheTargetDevice(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    struct wl_array *device);
+    static void feedbackTrancheFormats(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    struct wl_array *indices);
+    static void feedbackTrancheFlags(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                    uint32_t flags);
+  private:
+    void unmapFormatTable();
+    WaylandDisplay *mDisplay;
+    struct zwp_linux_dmabuf_feedback_v1 *mFeedback;
+    bool mSurface;
+    /*format table shared by compositor, 16 bytes per entry*/
+    void *mFormatTable;
+    uint32_t mFormatTableSize;
+    /*the tranche being received*/
+    uint32_t mTrancheFlags;
+    std::vector<uint16_t> mTrancheIndices;
+    /*formats collected since last done*/
+    DmaBufferFormatMap mPendingFormats;
+    int mLogCategory;
+};
+
+#endif /*__WAYLAND_DMA_FEEDBACK_H__*/
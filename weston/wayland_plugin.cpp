@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <unistd.h>
 #include "wayland_plugin.h"
 #include "wayland_display.h"
 #include "Logger.h"
@@ -21,14 +22,28 @@
 
 #define TAG "rlib:wayland_plugin"
 
+/*max frames queued for posting, decoders hold far fewer buffers*/
+#define FRAME_POST_QUEUE_SIZE 64
+/*max frames handled at once by displayFrames*/
+#define FRAME_POST_BATCH_SIZE 16
+/*retry time if weston not send frame callback of the last committed buffer*/
+#define REDRAWING_RETRY_TIME_US (4*1000)
+
 WaylandPlugin::WaylandPlugin(int logCatgory)
     : mRenderLock("renderlock"),
-    mLogCategory(logCatgory)
+    mLogCategory(logCatgory),
+    mPostLock("postlock")
 {
+    mFrameMonitor = new Tls::FrameMonitor(mLogCategory);
+    mVsyncClock = new Tls::VsyncClock();
+    mLateFrameFilter = new Tls::LateFrameFilter(mVsyncClock);
     mDisplay = new WaylandDisplay(this, logCatgory);
-    mQueue = new Tls::Queue();
+    mQueue = new Tls::SpscQueue(FRAME_POST_QUEUE_SIZE);
+    mScheduler = new Tls::FrameScheduler(FRAME_POST_QUEUE_SIZE);
     mPaused = false;
     mImmediatelyOutput = false;
+    mPresentAheadUs = 0;
+    mPostWaiting = false;
 }
 
 WaylandPlugin::~WaylandPlugin()
@@ -37,10 +52,25 @@ WaylandPlugin::~WaylandPlugin()
         delete mDisplay;
     }
     if (mQueue) {
-        mQueue->flush();
         delete mQueue;
         mQueue = NULL;
     }
+    if (mScheduler) {
+        delete mScheduler;
+        mScheduler = NULL;
+    }
+    if (mLateFrameFilter) {
+        delete mLateFrameFilter;
+        mLateFrameFilter = NULL;
+    }
+    if (mVsyncClock) {
+        delete mVsyncClock;
+        mVsyncClock = NULL;
+    }
+    if (mFrameMonitor) {
+        delete mFrameMonitor;
+        mFrameMonitor = NULL;
+    }
     TRACE(mLogCategory,"desconstruct");
 }
 
@@ -119,6 +149,19 @@ int WaylandPlugin::prepareFrame(RenderBuffer *buffer)
     return NO_ERROR;
 }
 
+bool WaylandPlugin::isLateFrame(RenderBuffer *buffer, int64_t displayTime)
+{
+    //drop a hopelessly late frame before it is queued or attached
+    if (!mImmediatelyOutput && !mPaused && mDisplay->getWlOutput() &&
+        mLateFrameFilter->isHopeless(displayTime, Tls::Times::getSystemTimeUs() + mPresentAheadUs)) {
+        DEBUG(mLogCategory,"drop late frame,display:%lld(pts:%lld ms)",displayTime,buffer->pts/1000000);
+        handleFrameDropped(buffer, PLUGIN_DROP_REASON_LATE);
+        handleBufferRelease(buffer);
+        return true;
+    }
+    return false;
+}
+
 int WaylandPlugin::displayFrame(RenderBuffer *buffer, int64_t displayTime)
 {
     /* if weston can't support pts feature,
@@ -126,27 +169,106 @@ int WaylandPlugin::displayFrame(RenderBuffer *buffer, int64_t displayTime)
      * weston in post thread
      */
     WaylandDisplay::AmlConfigAPIList *amlconfig = mDisplay->getAmlConfigAPIList();
+
+    mFrameMonitor->frameEntered(buffer, displayTime);
+    if (isLateFrame(buffer, displayTime)) {
+        return NO_ERROR;
+    }
+
     if (!amlconfig->enableSetPts) {
         buffer->time = displayTime;
-        mQueue->push(buffer);
+        if (mQueue->push(buffer) != Q_OK) {
+            ERROR(mLogCategory,"post queue full,cnt:%d",mQueue->getCnt());
+            handleFrameDropped(buffer, PLUGIN_DROP_REASON_QUEUE_FULL);
+            handleBufferRelease(buffer);
+            return NO_ERROR;
+        }
+        mFrameMonitor->traceFrame(buffer, PLUGIN_FRAME_STAGE_QUEUED);
         DEBUG(mLogCategory,"queue size:%d",mQueue->getCnt());
+        wakeupPostThread();
     } else {
         mDisplay->displayFrameBuffer(buffer, displayTime);
     }
     return NO_ERROR;
 }
 
+int WaylandPlugin::displayFrames(RenderBuffer **buffers, int64_t *displayTimes, int count)
+{
+    RenderBuffer *frames[FRAME_POST_BATCH_SIZE];
+    int64_t frameTimes[FRAME_POST_BATCH_SIZE];
+    WaylandDisplay::AmlConfigAPIList *amlconfig = mDisplay->getAmlConfigAPIList();
+    int frameCnt;
+    int queuedCnt;
+    int i = 0;
+
+    while (i < count) {
+        frameCnt = 0;
+        for (; i < count && frameCnt < FRAME_POST_BATCH_SIZE; i++) {
+            mFrameMonitor->frameEntered(buffers[i], displayTimes[i]);
+            if (isLateFrame(buffers[i], displayTimes[i])) {
+                continue;
+            }
+            buffers[i]->time = displayTimes[i];
+            frames[frameCnt] = buffers[i];
+            frameTimes[frameCnt] = displayTimes[i];
+            ++frameCnt;
+        }
+        if (frameCnt == 0) {
+            continue;
+        }
+
+        if (amlconfig->enableSetPts) {
+            mDisplay->displayFrameBuffers(frames, frameTimes, frameCnt);
+            continue;
+        }
+        //post thread is woken once for the whole batch
+        for (int j = 0; j < frameCnt; j++) {
+            mFrameMonitor->traceFrame(frames[j], PLUGIN_FRAME_STAGE_QUEUED);
+        }
+        queuedCnt = (int)mQueue->pushBatch((void **)frames, frameCnt);
+        for (int j = queuedCnt; j < frameCnt; j++) {
+            ERROR(mLogCategory,"post queue full,cnt:%d",mQueue->getCnt());
+            handleFrameDropped(frames[j], PLUGIN_DROP_REASON_QUEUE_FULL);
+            handleBufferRelease(frames[j]);
+        }
+        DEBUG(mLogCategory,"queue size:%d",mQueue->getCnt());
+        if (queuedCnt > 0) {
+            wakeupPostThread();
+        }
+    }
+    return NO_ERROR;
+}
+
 void WaylandPlugin::queueFlushCallback(void *userdata,void *data)
 {
     WaylandPlugin* plugin = static_cast<WaylandPlugin *>(userdata);
-    plugin->handleFrameDropped((RenderBuffer *)data);
+    plugin->handleFrameDropped((RenderBuffer *)data, PLUGIN_DROP_REASON_FLUSH);
     plugin->handleBufferRelease((RenderBuffer *)data);
 }
 
+void WaylandPlugin::fetchQueuedFrames()
+{
+    RenderBuffer *buffer;
+    while (mQueue->pop((void **)&buffer) == Q_OK)
+    {
+        if (mScheduler->push(buffer, buffer->time) != Q_OK) {
+            ERROR(mLogCategory,"schedule frame fail,display:%lld",buffer->time);
+            handleFrameDropped(buffer, PLUGIN_DROP_REASON_QUEUE_FULL);
+            handleBufferRelease(buffer);
+        }
+    }
+    mFrameMonitor->queueDepth(mScheduler->getCnt());
+}
+
 int WaylandPlugin::flush()
 {
-    RenderBuffer *entity;
-    mQueue->flushAndCallback(this, WaylandPlugin::queueFlushCallback);
+    {
+        Tls::Mutex::Autolock _l(mPostLock);
+        fetchQueuedFrames();
+        mScheduler->flushAndCallback(this, WaylandPlugin::queueFlushCallback);
+        mPostCondition.signal();
+    }
+    mLateFrameFilter->reset();
     mDisplay->flushBuffers();
     return NO_ERROR;
 }
@@ -159,6 +281,7 @@ int WaylandPlugin::pause()
 int WaylandPlugin::resume()
 {
     mPaused = false;
+    signalPostThread();
     return NO_ERROR;
 }
 
@@ -167,7 +290,9 @@ int WaylandPlugin::closeDisplay()
     RenderBuffer *entity;
     Tls::Mutex::Autolock _l(mRenderLock);
     mDisplay->closeDisplay();
-    while (mQueue->pop((void **)&entity) == Q_OK)
+    Tls::Mutex::Autolock _lp(mPostLock);
+    fetchQueuedFrames();
+    while (mScheduler->popEarliest((void **)&entity, NULL) == Q_OK)
     {
         handleBufferRelease(entity);
     }
@@ -180,6 +305,8 @@ int WaylandPlugin::closeWindow()
     Tls::Mutex::Autolock _l(mRenderLock);
     if (isRunning()) {
         DEBUG(mLogCategory,"stop frame post thread");
+        requestExit();
+        signalPostThread();
         requestExitAndWait();
     }
     return NO_ERROR;
@@ -188,6 +315,9 @@ int WaylandPlugin::closeWindow()
 
 int WaylandPlugin::getValue(PluginKey key, void *value)
 {
+    if (mFrameMonitor->getValue(key, value)) {
+        return NO_ERROR;
+    }
     switch (key) {
         case PLUGIN_KEY_SELECT_DISPLAY_OUTPUT: {
             *(int *)(value) = mDisplay->getDisplayOutput();
@@ -197,12 +327,24 @@ int WaylandPlugin::getValue(PluginKey key, void *value)
             *(int *)(value) = mDisplay->getCurrentOutputCrtcIndex();
             //DEBUG(mLogCategory,"get current crtc output index:%d",*(int *)value);
         } break;
+        case PLUGIN_KEY_PRESENT_AHEAD_MARGIN: {
+            *(int *)(value) = (int)mPresentAheadUs;
+        } break;
+        case PLUGIN_KEY_DMABUF_MODIFIER: {
+            *(uint64_t *)(value) = mDisplay->getDmaBufferModifier();
+        } break;
+        case PLUGIN_KEY_SCANOUT_FORMAT: {
+            mDisplay->getScanoutFormat(static_cast<PluginScanoutFormat *>(value));
+        } break;
     }
     return NO_ERROR;
 }
 
 int WaylandPlugin::setValue(PluginKey key, void *value)
 {
+    if (mFrameMonitor->setValue(key, value)) {
+        return NO_ERROR;
+    }
     switch (key) {
         case PLUGIN_KEY_WINDOW_SIZE: {
             RenderRect* rect = static_cast<RenderRect*>(value);
@@ -240,26 +382,40 @@ int WaylandPlugin::setValue(PluginKey key, void *value)
             DEBUG(mLogCategory, "Set keep last frame:%d",keep);
             mDisplay->setKeepLastFrame(keep);
         } break;
+        case PLUGIN_KEY_PRESENT_AHEAD_MARGIN: {
+            int margin = *(int *) (value);
+            DEBUG(mLogCategory, "Set present ahead margin:%d us",margin);
+            mPresentAheadUs = margin > 0? margin: 0;
+            signalPostThread();
+        } break;
+        case PLUGIN_KEY_DMABUF_MODIFIER: {
+            uint64_t modifier = *(uint64_t *) (value);
+            DEBUG(mLogCategory, "Set dmabuf modifier:%llx",modifier);
+            mDisplay->setDmaBufferModifier(modifier);
+        } break;
     }
     return 0;
 }
 
 void WaylandPlugin::handleBufferRelease(RenderBuffer *buffer)
 {
+    mFrameMonitor->frameReleased(buffer);
     if (mCallback) {
         mCallback->doBufferReleaseCallback(mUserData, (void *)buffer);
     }
 }
 
-void WaylandPlugin::handleFrameDisplayed(RenderBuffer *buffer)
+void WaylandPlugin::handleFrameDisplayed(RenderBuffer *buffer, int64_t presentTime)
 {
+    mFrameMonitor->frameDisplayed(buffer, presentTime);
     if (mCallback) {
         mCallback->doBufferDisplayedCallback(mUserData, (void *)buffer);
     }
 }
 
-void WaylandPlugin::handleFrameDropped(RenderBuffer *buffer)
+void WaylandPlugin::handleFrameDropped(RenderBuffer *buffer, PluginDropReason reason)
 {
+    mFrameMonitor->frameDropped(buffer, reason);
     if (mCallback) {
         mCallback->doBufferDropedCallback(mUserData, (void *)buffer);
     }
@@ -273,48 +429,65 @@ bool WaylandPlugin::threadLoop()
 {
     RenderBuffer *curFrameEntity = NULL;
     RenderBuffer *expiredFrameEntity = NULL;
-    int64_t nowMonotime = Tls::Times::getSystemTimeUs();
+    int64_t nowMonotime;
+    int64_t earliestTime;
+    int64_t nextVsyncTime;
+    int64_t expireTime;
+    int64_t waitTimeUs = -1; //wait until signaled
+    bool waitRedrawing = false;
+
+    Tls::Mutex::Autolock _l(mPostLock);
+    if (isExitPending()) {
+        return false;
+    }
+    fetchQueuedFrames();
+    nowMonotime = Tls::Times::getSystemTimeUs();
 
-    //if queue is empty or paused, loop next
-    if (mQueue->isEmpty() || mPaused) {
-        goto tag_next;
+    //if queue is empty or paused, wait new frame or resume
+    if (mScheduler->isEmpty() || mPaused) {
+        goto tag_wait;
     }
 
     //if weston has no wl_outout,it means weston can't display frames
     //so we should display buffer to display to drop buffers
     if (mDisplay->getWlOutput() == NULL) {
-        mQueue->pop((void **)&expiredFrameEntity);
+        mScheduler->popEarliest((void **)&expiredFrameEntity, NULL);
         goto tag_post;
     }
 
-    //if weston obtains a buffer rendering,we can't send buffer to weston
+    //if weston obtains a buffer rendering,we can't send buffer to weston,
+    //wait frame callback, retry later in case weston never sends it
     if (mDisplay->isRedrawingPending()) {
-        goto tag_next;
+        waitRedrawing = true;
+        waitTimeUs = REDRAWING_RETRY_TIME_US;
+        goto tag_wait;
     }
 
     //we output video frame asap
     if (mImmediatelyOutput) {
         //pop the peeked frame
-        mQueue->pop((void **)&expiredFrameEntity);
+        mScheduler->popEarliest((void **)&expiredFrameEntity, NULL);
         goto tag_post;
     }
 
-    while (mQueue->peek((void **)&curFrameEntity, 0) == Q_OK)
-    {
-        //no frame expired,loop next
-        if (nowMonotime < curFrameEntity->time) {
-            break;
-        }
-
-        //pop the peeked frame
-        mQueue->pop((void **)&curFrameEntity);
+    /*a frame posted now is shown at the first vsync after the present ahead margin,
+     frames whose nearest vsync is not later than it are due*/
+    if (mVsyncClock->isValid()) {
+        nextVsyncTime = mVsyncClock->getNextVsyncTime(nowMonotime + mPresentAheadUs);
+        expireTime = nextVsyncTime + mVsyncClock->getPeriodUs()/2 - 1;
+    } else {
+        expireTime = nowMonotime + mPresentAheadUs;
+    }
 
+    //pop all expired frames in display time order, only the newest one is shown
+    while (mScheduler->popExpired(expireTime, (void **)&curFrameEntity, NULL) == Q_OK)
+    {
         //drop last expired frame,got a new expired frame
         if (expiredFrameEntity) {
             WARNING(mLogCategory,"drop,now:%lld,display:%lld(pts:%lld ms),n-d:%lld ms",
                 nowMonotime,expiredFrameEntity->time,expiredFrameEntity->pts/1000000,
                 (nowMonotime - expiredFrameEntity->time)/1000);
-            handleFrameDropped(expiredFrameEntity);
+            handleFrameDropped(expiredFrameEntity, PLUGIN_DROP_REASON_EXPIRED);
             handleBufferRelease(expiredFrameEntity);
             expiredFrameEntity = NULL;
         }
@@ -324,8 +497,18 @@ bool WaylandPlugin::threadLoop()
 
 tag_post:
     if (!expiredFrameEntity) {
-        //TRACE(mLogCategory,"no frame expire");
-        goto tag_next;
+        //no frame expire, sleep until the earliest frame is due
+        if (mScheduler->peekEarliest((void **)&curFrameEntity, &earliestTime) == Q_OK) {
+            //it is due once the vsync before its nearest vsync is within the margin
+            if (mVsyncClock->isValid()) {
+                earliestTime = mVsyncClock->getVsyncTime(mVsyncClock->getSequence(earliestTime) - 1) + 1;
+            }
+            waitTimeUs = earliestTime - mPresentAheadUs - nowMonotime;
+            if (waitTimeUs <= 0) {
+                return true;
+            }
+        }
+        goto tag_wait;
     }
 
     if (mDisplay) {
@@ -334,12 +517,39 @@ tag_post:
             (nowMonotime - expiredFrameEntity->time)/1000);
         mDisplay->displayFrameBuffer(expiredFrameEntity, expiredFrameEntity->time);
     }
+    return true;
 
-tag_next:
-    usleep(4*1000);
+tag_wait:
+    mPostWaiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    //double check wakeup conditions after publishing waiting state
+    if (mQueue->isEmpty() && !isExitPending() &&
+        !(waitRedrawing && !mDisplay->isRedrawingPending())) {
+        if (waitTimeUs < 0) {
+            mPostCondition.wait(mPostLock);
+        } else {
+            mPostCondition.waitRelativeUs(mPostLock, waitTimeUs);
+        }
+    }
+    mPostWaiting.store(false);
     return true;
 }
 
+void WaylandPlugin::wakeupPostThread()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mPostWaiting.load()) {
+        Tls::Mutex::Autolock _l(mPostLock);
+        mPostCondition.signal();
+    }
+}
+
+void WaylandPlugin::signalPostThread()
+{
+    Tls::Mutex::Autolock _l(mPostLock);
+    mPostCondition.signal();
+}
+
 void *makePluginInstance(int id)
 {
     int category =Logger_init(id);
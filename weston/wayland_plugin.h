@@ -17,8 +17,14 @@
 #define __WAYLAND_PLUGIN_H__
 #include "render_plugin.h"
 #include "wayland_display.h"
+#include <atomic>
 #include "Thread.h"
-#include "Queue.h"
+#include "Condition.h"
+#include "SpscQueue.h"
+#include "FrameScheduler.h"
+#include "VsyncClock.h"
+#include "LateFrameFilter.h"
+#include "FrameMonitor.h"
 
 class WaylandPlugin : public RenderPlugin, public Tls::Thread
 {
@@ -32,6 +38,7 @@ class WaylandPlugin : public RenderPlugin, public Tls::Thread
     virtual int openWindow();
     virtual int prepareFrame(RenderBuffer *buffer);
     virtual int displayFrame(RenderBuffer *buffer, int64_t displayTime);
+    virtual int displayFrames(RenderBuffer **buffers, int64_t *displayTimes, int count);
     virtual int flush();
     virtual int pause();
     virtual int resume();
@@ -47,12 +54,28 @@ class WaylandPlugin : public RenderPlugin, public Tls::Thread
     virtual bool threadLoop();
     //buffer release callback
     virtual void handleBufferRelease(RenderBuffer *buffer);
-    //buffer had displayed ,but not release
-    virtual void handleFrameDisplayed(RenderBuffer *buffer);
+    //buffer had displayed ,but not release,presentTime is monotonic time it showed,us
+    virtual void handleFrameDisplayed(RenderBuffer *buffer, int64_t presentTime);
     //buffer droped callback
-    virtual void handleFrameDropped(RenderBuffer *buffer);
+    virtual void handleFrameDropped(RenderBuffer *buffer, PluginDropReason reason);
     static void queueFlushCallback(void *userdata,void *data);
+    //wake up post thread if it is sleeping, lock free when it is busy
+    void wakeupPostThread();
+    //per frame trace,statistics and record
+    Tls::FrameMonitor *getFrameMonitor() {
+        return mFrameMonitor;
+    };
+    //display vsync timeline, fed by weston frame callbacks
+    Tls::VsyncClock *getVsyncClock() {
+        return mVsyncClock;
+    };
   private:
+    //drop and release buffer if it is hopelessly late
+    bool isLateFrame(RenderBuffer *buffer, int64_t displayTime);
+    //always wake up post thread, for control paths
+    void signalPostThread();
+    //move frames from mQueue to mScheduler, mPostLock must be held
+    void fetchQueuedFrames();
     PluginCallback *mCallback;
     WaylandDisplay *mDisplay;
 
@@ -63,7 +86,21 @@ class WaylandPlugin : public RenderPlugin, public Tls::Thread
     int mFrameHeight;
 
     void *mUserData;
-    Tls::Queue *mQueue;
+    /*serialize the consumer side of mQueue, post thread, flush and close,
+     the producer displayFrame never takes it*/
+    mutable Tls::Mutex mPostLock;
+    Tls::SpscQueue *mQueue;
+    //frames ordered by display time, only used with mPostLock held
+    Tls::FrameScheduler *mScheduler;
+    //post thread sleeps on it until a frame is due or a new frame, flush, resume arrives
+    Tls::Condition mPostCondition;
+    std::atomic<bool> mPostWaiting;
+    //post frames this early before their display time, us
+    int64_t mPresentAheadUs;
+    Tls::VsyncClock *mVsyncClock;
+    //drops hopelessly late frames in displayFrame, producer side only
+    Tls::LateFrameFilter *mLateFrameFilter;
+    Tls::FrameMonitor *mFrameMonitor;
     bool mPaused;
     /*immediately output video frame to display*/
     bool mImmediatelyOutput;
@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <sys/epoll.h>
+#include <sys/syscall.h>
 #include <string.h>
 #include <stdlib.h>
 #include "wayland_shm.h"
@@ -30,6 +31,25 @@
 
 #define TAG "rlib:wayland_shm"
 
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (1024 + 9)
+#endif
+#ifndef F_SEAL_SEAL
+#define F_SEAL_SEAL 0x0001
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#endif
+#ifndef F_SEAL_GROW
+#define F_SEAL_GROW 0x0004
+#endif
+
 WaylandShmBuffer::WaylandShmBuffer(WaylandDisplay *display, int logCategory)
 {
     mDisplay = display;
@@ -37,61 +57,44 @@ WaylandShmBuffer::WaylandShmBuffer(WaylandDisplay *display, int logCategory)
     mStride = 0;
     mData = NULL;
     mSize = 0;
+    mDirty = false;
+    mBusy = false;
     mWidth = 0;
     mHeight = 0;
     mFormat = VIDEO_FORMAT_UNKNOWN;
+    memset(&mLayout, 0, sizeof(mLayout));
     mLogCategory = logCategory;
 }
 
 WaylandShmBuffer::~WaylandShmBuffer()
 {
-
+    if (mWlBuffer) {
+        wl_buffer_destroy(mWlBuffer);
+        mWlBuffer = NULL;
+    }
+    if (mData) {
+        munmap(mData, mSize);
+        mData = NULL;
+    }
 }
 
 struct wl_buffer *WaylandShmBuffer::constructWlBuffer(int width, int height, RenderVideoFormat format)
 {
     struct wl_shm_pool *pool;
-    int fd;
+    int fd = -1;
     int ret;
 
     mWidth = width;
     mHeight = height;
     mFormat = format;
 
-    switch (format)
-    {
-        case VIDEO_FORMAT_YUY2:
-        case VIDEO_FORMAT_YVYU:
-        case VIDEO_FORMAT_UYVY:
-        case VIDEO_FORMAT_VYUY: {
-            mStride = ROUND_UP_4 (width * 2);
-            mSize = mStride * height;
-        } break;
-        case VIDEO_FORMAT_AYUV:
-        case VIDEO_FORMAT_RGBx:
-        case VIDEO_FORMAT_RGBA:
-        case VIDEO_FORMAT_BGRA:
-        case VIDEO_FORMAT_xRGB:
-        case VIDEO_FORMAT_ARGB:
-        case VIDEO_FORMAT_xBGR:
-        case VIDEO_FORMAT_ABGR:
-        case VIDEO_FORMAT_r210:
-        case VIDEO_FORMAT_Y410:
-        case VIDEO_FORMAT_VUYA:
-        case VIDEO_FORMAT_BGR10A2_LE:
-        case VIDEO_FORMAT_BGRx: {
-            mStride = width * 4;
-            mSize = mStride * height;
-        } break;
-
-        default:
-            break;
-    }
-
-    if (mStride <= 0 || mSize <= 0) {
+    //planar formats keep chroma stride half of luma stride as wl_shm expects
+    if (Tls::PixelConverter::getLayout(format, width, height, 4, &mLayout) != NO_ERROR) {
         WARNING(mLogCategory,"Unsupport format");
         goto tag_err;
     }
+    mStride = mLayout.stride[0];
+    mSize = mLayout.size;
 
     fd = createAnonymousFile(mSize);
     if (fd < 0) {
@@ -102,10 +105,12 @@ struct wl_buffer *WaylandShmBuffer::constructWlBuffer(int width, int height, Ren
     mData = mmap(NULL, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (mData == MAP_FAILED) {
         ERROR(mLogCategory,"mmap failed: %s",strerror(errno));
+        mData = NULL;
         goto tag_err;
     }
-    //init buffer data,set alpha transparent
-    memset(mData, 0x00, mSize);
+    //pages of a new file read as zero,that is alpha transparent,
+    //so no memset is needed until the buffer is written
+    mDirty = false;
 
     if (mDisplay->getShm() == NULL) {
         ERROR(mLogCategory,"Shm is null");
@@ -137,6 +142,38 @@ tag_err:
     return NULL;
 }
 
+int WaylandShmBuffer::copyFrame(RenderVideoFormat format, const void *data, int size)
+{
+    Tls::PixelLayout srcLayout;
+    int ret;
+
+    if (!data || !mData) {
+        ERROR(mLogCategory,"frame or shm data is null");
+        return ERROR_PARAM_NULL;
+    }
+    ret = Tls::PixelConverter::getLayout(format, mWidth, mHeight, 1, &srcLayout);
+    if (ret != NO_ERROR || size < srcLayout.size) {
+        ERROR(mLogCategory,"frame size %d too small for %dx%d format %d",size,mWidth,mHeight,format);
+        return ERROR_BAD_VALUE;
+    }
+    ret = Tls::PixelConverter::convert(format, (const uint8_t *)data, &srcLayout,
+                    mFormat, (uint8_t *)mData, &mLayout, mWidth, mHeight);
+    if (ret != NO_ERROR) {
+        ERROR(mLogCategory,"convert format %d to %d fail",format,mFormat);
+        return ret;
+    }
+    mDirty = true;
+    return NO_ERROR;
+}
+
+void WaylandShmBuffer::clear()
+{
+    if (mData && mDirty) {
+        memset(mData, 0x00, mSize);
+        mDirty = false;
+    }
+}
+
 int WaylandShmBuffer::createAnonymousFile(off_t size)
 {
     char filename[1024];
@@ -145,6 +182,26 @@ int WaylandShmBuffer::createAnonymousFile(off_t size)
     int fd = -1;
     int ret;
 
+#ifdef __NR_memfd_create
+    /*a sealed memfd can't be shrunk under weston's mapping and
+     needs no file in XDG_RUNTIME_DIR*/
+    fd = syscall(__NR_memfd_create, "rlib-wayland-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd >= 0) {
+        do {
+            ret = ftruncate(fd, size);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            ERROR(mLogCategory,"ftruncate memfd fail: %s",strerror(errno));
+            goto tag_err;
+        }
+        if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+            WARNING(mLogCategory,"seal memfd fail: %s",strerror(errno));
+        }
+        return fd;
+    }
+    TRACE(mLogCategory,"memfd_create fail: %s,use XDG_RUNTIME_DIR",strerror(errno));
+#endif
+
     path = getenv("XDG_RUNTIME_DIR");
     if (!path) {
         WARNING(mLogCategory,"not set XDG_RUNTIME_DIR env");
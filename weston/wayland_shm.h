@@ -16,8 +16,10 @@
 #ifndef __WAYLAND_SHM_H__
 #define __WAYLAND_SHM_H__
 #include <sys/types.h>
+#include <atomic>
 #include "render_plugin.h"
 #include "wayland_wlwrap.h"
+#include "PixelConverter.h"
 
 class WaylandDisplay;
 
@@ -45,6 +47,38 @@ class WaylandShmBuffer : public WaylandWLWrap
     RenderVideoFormat getFormat() {
         return mFormat;
     }
+    const Tls::PixelLayout *getLayout() {
+        return &mLayout;
+    };
+    /**
+     * @brief copy a frame of the buffer size into the buffer,
+     * it is converted if format differs from the buffer format
+     *
+     * @param format the video format of the frame
+     * @param data,size the tightly packed frame data
+     * @return NO_ERROR on success
+     */
+    int copyFrame(RenderVideoFormat format, const void *data, int size);
+    /**
+     * @brief zero the buffer data if it was written since
+     * it was created or last cleared
+     */
+    void clear();
+    /**
+     * @brief mark the buffer data written,the next clear will zero it
+     */
+    void setDirty() {
+        mDirty = true;
+    };
+    /**
+     * @brief busy from attach until weston sends wl_buffer.release
+     */
+    void setBusy(bool busy) {
+        mBusy = busy;
+    };
+    bool isBusy() {
+        return mBusy;
+    };
   private:
     int createAnonymousFile(off_t size);
     WaylandDisplay *mDisplay;
@@ -52,9 +86,12 @@ class WaylandShmBuffer : public WaylandWLWrap
     void *mData;
     int mStride;
     int mSize;
+    bool mDirty; //data written since created or cleared
+    std::atomic<bool> mBusy; //attached and not released by weston
     int mWidth;
     int mHeight;
     RenderVideoFormat mFormat;
+    Tls::PixelLayout mLayout;
 
     int mLogCategory;
 };
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wayland-client.h>
+#include "wayland_shm_pool.h"
+#include "wayland_shm.h"
+#include "wayland_display.h"
+#include "Logger.h"
+
+#define TAG "rlib:wayland_shm_pool"
+
+static const struct wl_buffer_listener shm_buffer_listener = {
+    WaylandShmPool::bufferRelease,
+    WaylandShmPool::bufferdroped,
+};
+
+WaylandShmPool::WaylandShmPool(WaylandDisplay *display, int logCategory)
+    : mDisplay(display),
+    mLogCategory(logCategory)
+{
+}
+
+WaylandShmPool::~WaylandShmPool()
+{
+    clear();
+}
+
+void WaylandShmPool::bufferRelease(void *data, struct wl_buffer *wl_buffer)
+{
+    WaylandShmBuffer *shmBuffer = static_cast<WaylandShmBuffer *>(data);
+    shmBuffer->setBusy(false);
+}
+
+void WaylandShmPool::bufferdroped(void *data, struct wl_buffer *wl_buffer)
+{
+    WaylandShmBuffer *shmBuffer = static_cast<WaylandShmBuffer *>(data);
+    shmBuffer->setBusy(false);
+}
+
+WaylandShmBuffer *WaylandShmPool::acquire(int width, int height, RenderVideoFormat format, bool zeroed)
+{
+    WaylandShmBuffer *freeBuf = NULL;
+    int freeCnt = 0;
+
+    for (auto item = mBuffers.begin(); item != mBuffers.end(); ++item) {
+        WaylandShmBuffer *shmBuffer = *item;
+        if (shmBuffer->isBusy()) {
+            continue;
+        }
+        if (!freeBuf && shmBuffer->getWidth() == width &&
+            shmBuffer->getHeight() == height && shmBuffer->getFormat() == format) {
+            freeBuf = shmBuffer;
+        } else {
+            freeCnt++;
+        }
+    }
+
+    //keep the free buffers of other sizes under the limit,oldest go first
+    for (auto item = mBuffers.begin(); item != mBuffers.end() && freeCnt > SHM_POOL_MAX_FREE; ) {
+        WaylandShmBuffer *shmBuffer = *item;
+        if (shmBuffer->isBusy() || shmBuffer == freeBuf) {
+            item++;
+            continue;
+        }
+        TRACE(mLogCategory,"delete shm buffer %dx%d format:%d",shmBuffer->getWidth(),shmBuffer->getHeight(),shmBuffer->getFormat());
+        item = mBuffers.erase(item);
+        delete shmBuffer;
+        freeCnt--;
+    }
+
+    if (freeBuf) {
+        //reused buffers go to the tail,so trimming drops the least recently used
+        mBuffers.remove(freeBuf);
+        mBuffers.push_back(freeBuf);
+        if (zeroed) {
+            freeBuf->clear();
+        }
+        return freeBuf;
+    }
+
+    freeBuf = new WaylandShmBuffer(mDisplay, mLogCategory);
+    struct wl_buffer *wlbuffer = freeBuf->constructWlBuffer(width, height, format);
+    if (!wlbuffer) {
+        ERROR(mLogCategory,"create shm buffer %dx%d format:%d fail",width,height,format);
+        delete freeBuf;
+        return NULL;
+    }
+    wl_buffer_add_listener(wlbuffer, &shm_buffer_listener, freeBuf);
+    mBuffers.push_back(freeBuf);
+    TRACE(mLogCategory,"new shm buffer %dx%d format:%d,pool size:%d",width,height,format,mBuffers.size());
+    return freeBuf;
+}
+
+void WaylandShmPool::attach(WaylandShmBuffer *buffer, struct wl_surface *surface)
+{
+    buffer->setBusy(true);
+    wl_surface_attach(surface, buffer->getWlBuffer(), 0, 0);
+}
+
+void WaylandShmPool::clear()
+{
+    for (auto item = mBuffers.begin(); item != mBuffers.end(); ++item) {
+        delete *item;
+    }
+    mBuffers.clear();
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2021 Amlogic Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WAYLAND_SHM_POOL_H__
+#define __WAYLAND_SHM_POOL_H__
+#include <list>
+#include "render_plugin.h"
+
+class WaylandDisplay;
+class WaylandShmBuffer;
+
+/*max free shm buffers kept for reuse*/
+#define SHM_POOL_MAX_FREE 4
+
+/**
+ * @brief recycles shm buffers by size and format, a buffer is
+ * busy from attach until weston releases it, then it can be
+ * acquired again without creating a file,mmap or memset
+ */
+class WaylandShmPool {
+  public:
+    WaylandShmPool(WaylandDisplay *display, int logCategory);
+    virtual ~WaylandShmPool();
+    /**
+     * @brief get a free shm buffer, a new one is created if
+     * none of the given size and format is free
+     *
+     * @param width,height the buffer size
+     * @param format the video format of the buffer
+     * @param zeroed zero the buffer data if it was written before
+     * @return the shm buffer owned by pool, NULL if creating fail
+     */
+    WaylandShmBuffer *acquire(int width, int height, RenderVideoFormat format, bool zeroed);
+    /**
+     * @brief attach the buffer to surface, it is busy until released by weston
+     */
+    void attach(WaylandShmBuffer *buffer, struct wl_surface *surface);
+    /**
+     * @brief destroy all shm buffers
+     */
+    void clear();
+    static void bufferRelease(void *data, struct wl_buffer *wl_buffer);
+    static void bufferdroped(void *data, struct wl_buffer *wl_buffer);
+  private:
+    WaylandDisplay *mDisplay;
+    std::list<WaylandShmBuffer *> mBuffers;
+    int mLogCategory;
+};
+
+#endif /*__WAYLAND_SHM_POOL_H__*/
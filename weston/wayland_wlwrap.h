@@ -15,6 +15,7 @@
  */
 #ifndef __WAYLAND_WLWRAP_H__
 #define __WAYLAND_WLWRAP_H__
+#include <stdint.h>
 
 class WaylandWLWrap {
   public:
@@ -23,6 +24,26 @@ class WaylandWLWrap {
     virtual struct wl_buffer *getWlBuffer() = 0;
     virtual void *getDataPtr() = 0;
     virtual int getSize() = 0;
+    /**
+     * @brief the wl_buffer was requested asynchronously and
+     * the compositor has not answered yet
+     */
+    virtual bool isPending() {
+        return false;
+    };
+    /**
+     * @brief the wl_buffer is attached to a surface the first time
+     */
+    virtual void setUsed() {};
+    /**
+     * @brief get the dmabuf format and modifier the wl_buffer
+     * was created with
+     *
+     * @return false if it is not a dma buffer
+     */
+    virtual bool getDmaFormat(uint32_t *format, uint64_t *modifier) {
+        return false;
+    };
 };
 
 #endif /*__WAYLAND_WLWRAP_H__*/
\ No newline at end of file